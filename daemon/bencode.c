@@ -6,6 +6,7 @@
 #include <assert.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 
 /* set to 0 for alloc debugging, e.g. through valgrind */
 #define BENCODE_MIN_BUFFER_PIECE_LEN	512
@@ -27,6 +28,10 @@ struct __bencode_free_list {
 };
 struct __bencode_hash {
 	struct bencode_item *buckets[BENCODE_HASH_BUCKETS];
+	/* optional direct-mapped index of well-known keys, see bencode_dictionary_index() */
+	bencode_key_lookup_t index_lookup;
+	struct bencode_item **index;
+	unsigned int index_len;
 };
 
 
@@ -99,6 +104,7 @@ int bencode_buffer_init(bencode_buffer_t *buf) {
 		return -1;
 	buf->free_list = NULL;
 	buf->error = 0;
+	buf->incomplete = 0;
 	return 0;
 }
 
@@ -459,7 +465,7 @@ static bencode_item_t *__bencode_decode_dictionary(bencode_buffer_t *buf, const
 	hash = (void *) ret->__buf;
 	memset(hash, 0, sizeof(*hash));
 
-	while (s < end) {
+	while (1) {
 		key = __bencode_decode(buf, s, end);
 		if (!key)
 			return NULL;
@@ -470,8 +476,6 @@ static bencode_item_t *__bencode_decode_dictionary(bencode_buffer_t *buf, const
 			return NULL;
 		__bencode_container_add(ret, key);
 
-		if (s >= end)
-			return NULL;
 		value = __bencode_decode(buf, s, end);
 		if (!value)
 			return NULL;
@@ -498,7 +502,7 @@ static bencode_item_t *__bencode_decode_list(bencode_buffer_t *buf, const char *
 		return NULL;
 	__bencode_list_init(ret);
 
-	while (s < end) {
+	while (1) {
 		item = __bencode_decode(buf, s, end);
 		if (!item)
 			return NULL;
@@ -511,37 +515,67 @@ static bencode_item_t *__bencode_decode_list(bencode_buffer_t *buf, const char *
 	return ret;
 }
 
+/* Bounded replacement for strtoull(), as the input is not necessarily null-terminated. Rejects
+ * leading zeros and requires at least one more byte to follow the number. */
+static const char *__bencode_decode_number(bencode_buffer_t *buf, const char *s, const char *end,
+		unsigned long long *out)
+{
+	const char *orig = s;
+	unsigned long long n = 0;
+
+	while (s < end && *s >= '0' && *s <= '9') {
+		if (n > (ULLONG_MAX - 9) / 10)
+			return NULL;
+		n = n * 10 + (*s - '0');
+		s++;
+	}
+	if (s >= end) {
+		buf->incomplete = 1;
+		return NULL;
+	}
+	if (s == orig)
+		return NULL;
+	if (*orig == '0' && s - orig > 1)
+		return NULL;
+
+	*out = n;
+	return s;
+}
+
 static bencode_item_t *__bencode_decode_integer(bencode_buffer_t *buf, const char *s, const char *end) {
 	long long int i;
+	unsigned long long n;
 	const char *orig = s;
-	char *convend;
 	bencode_item_t *ret;
+	int neg = 0;
 
 	if (*s != 'i')
 		return NULL;
 	s++;
 
-	if (s >= end)
-		return NULL;
-
-	if (*s == '0') {
-		i = 0;
+	if (s < end && *s == '-') {
+		neg = 1;
 		s++;
-		goto done;
 	}
 
-	i = strtoll(s, &convend, 10);
-	if (convend == s)
-		return NULL;
-	s += (convend - s);
-
-done:
-	if (s >= end)
+	s = __bencode_decode_number(buf, s, end, &n);
+	if (!s)
 		return NULL;
 	if (*s != 'e')
 		return NULL;
 	s++;
 
+	if (neg) {
+		if (n == 0 || n > (unsigned long long) LLONG_MAX + 1)
+			return NULL;
+		i = (long long int) (0 - n);
+	}
+	else {
+		if (n > LLONG_MAX)
+			return NULL;
+		i = n;
+	}
+
 	ret = __bencode_item_alloc(buf, 0);
 	if (!ret)
 		return NULL;
@@ -558,31 +592,21 @@ done:
 }
 
 static bencode_item_t *__bencode_decode_string(bencode_buffer_t *buf, const char *s, const char *end) {
-	unsigned long int sl;
-	char *convend;
+	unsigned long long sl;
 	const char *orig = s;
 	bencode_item_t *ret;
 
-	if (*s == '0') {
-		sl = 0;
-		s++;
-		goto colon;
-	}
-
-	sl = strtoul(s, &convend, 10);
-	if (convend == s)
-		return NULL;
-	s += (convend - s);
-
-colon:
-	if (s >= end)
+	s = __bencode_decode_number(buf, s, end, &sl);
+	if (!s)
 		return NULL;
 	if (*s != ':')
 		return NULL;
 	s++;
 
-	if (s + sl > end)
+	if (sl > end - s) {
+		buf->incomplete = 1;
 		return NULL;
+	}
 
 	ret = __bencode_item_alloc(buf, 0);
 	if (!ret)
@@ -599,8 +623,10 @@ colon:
 }
 
 static bencode_item_t *__bencode_decode(bencode_buffer_t *buf, const char *s, const char *end) {
-	if (s >= end)
+	if (s >= end) {
+		buf->incomplete = 1;
 		return NULL;
+	}
 
 	switch (*s) {
 		case 'd':
@@ -632,6 +658,22 @@ bencode_item_t *bencode_decode(bencode_buffer_t *buf, const char *s, size_t len)
 	return __bencode_decode(buf, s, s + len);
 }
 
+bencode_item_t *bencode_decode_prefix(bencode_buffer_t *buf, const char *s, size_t len, ssize_t *used) {
+	bencode_item_t *ret;
+
+	assert(s != NULL);
+	assert(used != NULL);
+
+	buf->incomplete = 0;
+	ret = __bencode_decode(buf, s, s + len);
+	if (!ret || ret->type == BENCODE_END_MARKER) {
+		*used = (buf->incomplete && !buf->error) ? -1 : -2;
+		return NULL;
+	}
+	*used = ret->str_len;
+	return ret;
+}
+
 
 static int __bencode_dictionary_key_match(bencode_item_t *key, const char *keystr, size_t keylen) {
 	assert(key->type == BENCODE_STRING);
@@ -657,6 +699,14 @@ bencode_item_t *bencode_dictionary_get_len(bencode_item_t *dict, const char *key
 	/* try hash lookup first if possible */
 	if (dict->value == 1) {
 		hash = (void *) dict->__buf;
+
+		/* well-known keys are found in the index directly, or not at all */
+		if (hash->index) {
+			int idx = hash->index_lookup(keystr, keylen);
+			if (idx >= 0 && idx < hash->index_len)
+				return hash->index[idx];
+		}
+
 		i = bucket = __bencode_hash_str_len((const unsigned char *) keystr, keylen);
 		while (1) {
 			key = hash->buckets[i];
@@ -682,6 +732,34 @@ bencode_item_t *bencode_dictionary_get_len(bencode_item_t *dict, const char *key
 	return NULL;
 }
 
+int bencode_dictionary_index(bencode_item_t *dict, bencode_key_lookup_t lookup, unsigned int num) {
+	struct __bencode_hash *hash;
+	bencode_item_t *key;
+	int idx;
+
+	if (!dict || dict->type != BENCODE_DICTIONARY || dict->value != 1)
+		return -1;
+
+	hash = (void *) dict->__buf;
+	hash->index = bencode_buffer_alloc(dict->buffer, sizeof(*hash->index) * num);
+	if (!hash->index)
+		return -1;
+	memset(hash->index, 0, sizeof(*hash->index) * num);
+
+	for (key = dict->child; key; key = key->sibling->sibling) {
+		idx = lookup(key->iov[1].iov_base, key->iov[1].iov_len);
+		if (idx < 0 || idx >= num)
+			continue;
+		if (hash->index[idx])
+			continue; /* duplicate key: first one wins, same as regular lookup */
+		hash->index[idx] = key->sibling;
+	}
+
+	hash->index_lookup = lookup;
+	hash->index_len = num;
+	return 0;
+}
+
 void bencode_buffer_destroy_add(bencode_buffer_t *buf, free_func_t func, void *p) {
 	struct __bencode_free_list *li;
 
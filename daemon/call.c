@@ -2299,6 +2299,99 @@ static void __update_init_subscribers(struct call_monologue *ml, GQueue *streams
 }
 
 
+static uint64_t __ps_state_fingerprint(uint64_t h, struct packet_stream *ps) {
+	h = fnv1a_64_val(h, ps->selected_sfd);
+	h = fnv1a_64_val(h, ps->rtcp_sibling);
+	h = fnv1a_64_val(h, ps->ps_flags);
+	unsigned int eh = ps->endpoint.address.family ? endpoint_hash(&ps->endpoint) : 0;
+	h = fnv1a_64_val(h, eh);
+	eh = ps->advertised_endpoint.address.family ? endpoint_hash(&ps->advertised_endpoint) : 0;
+	h = fnv1a_64_val(h, eh);
+	h = fnv1a_64_val(h, ps->sfds.length);
+	return h;
+}
+
+static uint64_t __sdes_state_fingerprint(uint64_t h, GQueue *q) {
+	for (GList *l = q->head; l; l = l->next) {
+		struct crypto_params_sdes *cps = l->data;
+		h = fnv1a_64_val(h, cps->tag);
+		h = fnv1a_64_val(h, cps->params.crypto_suite);
+		h = fnv1a_64(h, cps->params.master_key, sizeof(cps->params.master_key));
+		h = fnv1a_64(h, cps->params.master_salt, sizeof(cps->params.master_salt));
+	}
+	return h;
+}
+
+static uint64_t __media_state_fingerprint(uint64_t h, struct call_media *media) {
+	h = fnv1a_64_val(h, media->index);
+	h = fnv1a_64_val(h, media->type_id);
+	h = fnv1a_64_val(h, media->protocol);
+	h = fnv1a_64_val(h, media->desired_family);
+	h = fnv1a_64_val(h, media->logical_intf);
+	h = fnv1a_64_val(h, media->media_flags);
+	h = fnv1a_64_val(h, media->ptime);
+	h = fnv1a_64_val(h, media->fp_hash_func);
+	h = fnv1a_64(h, media->format_str.s, media->format_str.len);
+	h = fnv1a_64(h, media->media_id.s, media->media_id.len);
+
+	h = fnv1a_64_val(h, media->ice_agent);
+	if (media->ice_agent) {
+		struct ice_agent *ag = media->ice_agent;
+		h = fnv1a_64_val(h, ag->agent_flags);
+		for (int i = 0; i < 2; i++) {
+			h = fnv1a_64(h, ag->ufrag[i].s, ag->ufrag[i].len);
+			h = fnv1a_64(h, ag->pwd[i].s, ag->pwd[i].len);
+		}
+	}
+
+	h = __sdes_state_fingerprint(h, &media->sdes_in);
+	h = __sdes_state_fingerprint(h, &media->sdes_out);
+
+	for (GList *l = media->codecs.codec_prefs.head; l; l = l->next) {
+		struct rtp_payload_type *pt = l->data;
+		h = fnv1a_64_val(h, pt->payload_type);
+		h = fnv1a_64_val(h, pt->clock_rate);
+		h = fnv1a_64_val(h, pt->channels);
+		h = fnv1a_64_val(h, pt->ptime);
+		h = fnv1a_64_val(h, pt->bitrate);
+		h = fnv1a_64(h, pt->encoding_with_params.s, pt->encoding_with_params.len);
+		h = fnv1a_64(h, pt->format_parameters.s, pt->format_parameters.len);
+	}
+	unsigned int num_handlers = media->codec_handlers ? g_hash_table_size(media->codec_handlers) : 0;
+	h = fnv1a_64_val(h, num_handlers);
+
+	for (GList *l = media->streams.head; l; l = l->next)
+		h = __ps_state_fingerprint(h, l->data);
+	h = fnv1a_64_val(h, media->endpoint_maps.length);
+
+	return h;
+}
+
+/* Fingerprint of all state that an offer/answer exchange reads or modifies. Used to determine
+ * whether repeating an identical offer/answer would be a no-op.
+ * Must be called with call->master_lock held in W */
+uint64_t dialogue_state_fingerprint(struct call_monologue *dialogue[2]) {
+	uint64_t h = FNV1A_64_INIT;
+	struct call *call = dialogue[0]->call;
+
+	h = fnv1a_64_val(h, call->tos);
+
+	for (int i = 0; i < 2; i++) {
+		struct call_monologue *ml = dialogue[i];
+		if (!ml)
+			continue;
+		h = fnv1a_64_val(h, ml);
+		h = fnv1a_64_val(h, ml->sdp_version);
+		h = fnv1a_64_val(h, ml->deleted);
+		h = fnv1a_64_val(h, ml->medias.length);
+		for (GList *l = ml->medias.head; l; l = l->next)
+			h = __media_state_fingerprint(h, l->data);
+	}
+
+	return h;
+}
+
+
 /* called with call->master_lock held in W */
 int monologue_offer_answer(struct call_monologue *dialogue[2], GQueue *streams,
 		struct sdp_ng_flags *flags)
@@ -3030,6 +3123,7 @@ static void __call_free(void *p) {
 		free_ssrc_hash(&m->ssrc_hash);
 		if (m->last_out_sdp)
 			g_string_free(m->last_out_sdp, TRUE);
+		sdp_out_cache_free(m);
 		str_free_dup(&m->last_in_sdp);
 		sdp_free(&m->last_in_sdp_parsed);
 		sdp_streams_free(&m->last_in_sdp_streams);
@@ -3051,6 +3145,9 @@ static void __call_free(void *p) {
 	g_hash_table_destroy(c->tags);
 	g_hash_table_destroy(c->viabranches);
 	g_hash_table_destroy(c->labels);
+	if (c->redis_fields)
+		g_hash_table_unref(c->redis_fields);
+	mutex_destroy(&c->redis_lock);
 
 	while (c->streams.head) {
 		ps = g_queue_pop_head(&c->streams);
@@ -3077,6 +3174,7 @@ static struct call *call_create(const str *callid) {
 	mutex_init(&c->buffer_lock);
 	call_buffer_init(&c->buffer);
 	rwlock_init(&c->master_lock);
+	mutex_init(&c->redis_lock);
 	c->tags = g_hash_table_new(str_hash, str_equal);
 	c->viabranches = g_hash_table_new(str_hash, str_equal);
 	c->labels = g_hash_table_new(str_hash, str_equal);
@@ -1336,6 +1336,31 @@ static void save_last_sdp(struct call_monologue *ml, str *sdp, GQueue *parsed, G
 }
 
 
+static uint64_t ng_input_fingerprint(uint64_t h, bencode_item_t *item, int skip_sdp) {
+	h = fnv1a_64_val(h, item->type);
+	switch (item->type) {
+		case BENCODE_STRING:
+			return fnv1a_64(h, item->iov[1].iov_base, item->iov[1].iov_len);
+		case BENCODE_INTEGER:
+			return fnv1a_64_val(h, item->value);
+		case BENCODE_LIST:
+			for (bencode_item_t *it = item->child; it; it = it->sibling)
+				h = ng_input_fingerprint(h, it, 0);
+			return h;
+		case BENCODE_DICTIONARY:
+			for (bencode_item_t *key = item->child; key && key->sibling; key = key->sibling->sibling) {
+				// the SDP body itself is hashed separately
+				if (skip_sdp && !bencode_strcmp(key, "sdp"))
+					continue;
+				h = ng_input_fingerprint(h, key, 0);
+				h = ng_input_fingerprint(h, key->sibling, 0);
+			}
+			return h;
+		default:
+			return h;
+	}
+}
+
 static const char *call_offer_answer_ng(struct ng_buffer *ngbuf, bencode_item_t *input,
 		bencode_item_t *output, enum call_opmode opmode, const char* addr,
 		const endpoint_t *sin)
@@ -1458,11 +1483,27 @@ static const char *call_offer_answer_ng(struct ng_buffer *ngbuf, bencode_item_t
 
 	int do_dequeue = 1;
 
-	ret = monologue_offer_answer(dialogue, &streams, &flags);
-	if (!ret) {
+	// repeated identical offer/answer with no change in between?
+	int reuse_sdp = rtpe_config.reuse_sdp && !flags.fragment && !call->deleted;
+	uint64_t input_fp = FNV1A_64_INIT, state_fp = 0;
+	if (reuse_sdp) {
+		input_fp = fnv1a_64_val(input_fp, opmode);
+		input_fp = ng_input_fingerprint(input_fp, input, 1);
+		input_fp = sdp_input_fingerprint(&sdp, &parsed, input_fp);
+		state_fp = dialogue_state_fingerprint(dialogue);
+	}
+
+	if (reuse_sdp && !sdp_replace_cached(chopper, &parsed, dialogue[1], input_fp, state_fp)) {
+		call->last_signal = MAX(call->last_signal, rtpe_now.tv_sec);
+		ret = 0;
+	}
+	else if (!(ret = monologue_offer_answer(dialogue, &streams, &flags))) {
 		// SDP fragments for trickle ICE are consumed with no replacement returned
 		if (!flags.fragment)
 			ret = sdp_replace(chopper, &parsed, dialogue[1], &flags);
+		if (reuse_sdp && !ret)
+			sdp_out_cache_update(dialogue[1], chopper, &parsed, &flags, input_fp, state_fp,
+					dialogue_state_fingerprint(dialogue));
 	}
 	else if (ret == ERROR_NO_ICE_AGENT && flags.fragment) {
 		queue_sdp_fragment(ngbuf, &streams, &flags);
@@ -1470,6 +1511,9 @@ static const char *call_offer_answer_ng(struct ng_buffer *ngbuf, bencode_item_t
 		do_dequeue = 0;
 	}
 
+	if (reuse_sdp && ret)
+		sdp_out_cache_free(dialogue[1]);
+
 	if (!ret)
 		save_last_sdp(dialogue[0], &sdp, &parsed, &streams);
 
@@ -36,6 +36,12 @@ struct mqtt_timer {
 
 static codec_handler_func handler_func_passthrough;
 static struct timerthread codec_timers_thread;
+#ifdef WITH_TRANSCODING
+static struct codec_worker *codec_workers;
+static struct dtx_wheel **dtx_wheels;
+static unsigned int dtx_num_wheels;
+static int dtx_wheel_rr;
+#endif
 
 static void rtp_payload_type_copy(struct rtp_payload_type *dst, const struct rtp_payload_type *src);
 static void codec_store_add_raw_order(struct codec_store *cs, struct rtp_payload_type *pt);
@@ -83,6 +89,7 @@ static GList *__codec_store_delete_link(GList *link, struct codec_store *cs) {
 #include <spandsp/dtmf.h>
 #include "resample.h"
 #include "dtmf_rx_fillin.h"
+#include "dsp.h"
 
 
 
@@ -90,7 +97,11 @@ struct codec_ssrc_handler;
 struct transcode_packet;
 
 struct dtx_buffer {
-	struct codec_timer ct;
+	struct obj obj;
+	struct timeval next;
+	struct dtx_wheel *wheel;
+	GList link; // in wheel->slots, data = self
+	long long wheel_tick; // 0 if not scheduled, protected by wheel->lock
 	mutex_t lock;
 	struct codec_ssrc_handler *csh;
 	int ptime; // ms per packet
@@ -117,6 +128,27 @@ struct silence_event {
 	uint64_t end;
 };
 
+struct codec_worker {
+	mutex_t lock;
+	cond_t cond;
+	GQueue packets; // struct dtx_packet
+};
+
+// DTX buffers are scheduled in timing wheels of 1 ms slots. Each wheel is a codec timer
+// itself, run by the codec timer threads at its earliest occupied slot, which then runs
+// all the buffers found in the slots due.
+#define DTX_TICK 1000 // us
+#define DTX_WHEEL_SLOTS 256 // must be power of 2
+
+struct dtx_wheel {
+	struct codec_timer ct;
+	mutex_t lock;
+	long long next_tick; // next slot to be run
+	long long wake_tick; // when the wheel is scheduled to run, 0 if not
+	unsigned int entries;
+	GQueue slots[DTX_WHEEL_SLOTS]; // intrusive lists of struct dtx_buffer
+};
+
 struct codec_ssrc_handler {
 	struct ssrc_entry h; // must be first
 	struct codec_handler *handler;
@@ -133,10 +165,12 @@ struct codec_ssrc_handler {
 	unsigned long first_send_ts;
 	long output_skew;
 	GString *sample_buffer;
+	GString *direct_buffer; // repacketizer, already in output encoding
 	struct dtx_buffer *dtx_buffer;
 
 	// DTMF DSP stuff
-	dtmf_rx_state_t *dtmf_dsp;
+	struct dtmf_det *dtmf_det; // native detector, or:
+	dtmf_rx_state_t *dtmf_dsp; // spandsp fallback
 	resample_t dtmf_resampler;
 	format_t dtmf_format;
 	uint64_t dtmf_ts, last_dtmf_event_ts;
@@ -154,6 +188,7 @@ struct codec_ssrc_handler {
 	uint64_t skip_pts;
 
 	unsigned int rtp_mark:1;
+	unsigned int stopped:1; // handler shut down or replaced, protected by the call's master lock
 };
 struct transcode_packet {
 	seq_packet_t p; // must be first
@@ -185,6 +220,7 @@ struct rtcp_timer {
 static codec_handler_func handler_func_passthrough_ssrc;
 static codec_handler_func handler_func_transcode;
 static codec_handler_func handler_func_playback;
+static codec_handler_func handler_func_playback_cached;
 static codec_handler_func handler_func_inject_dtmf;
 static codec_handler_func handler_func_dtmf;
 static codec_handler_func handler_func_t38;
@@ -199,6 +235,8 @@ static void __transcode_packet_free(struct transcode_packet *);
 
 static int packet_decode(struct codec_ssrc_handler *, struct codec_ssrc_handler *,
 		struct transcode_packet *, struct media_packet *);
+static int packet_direct(struct codec_ssrc_handler *, struct codec_ssrc_handler *,
+		struct transcode_packet *, struct media_packet *);
 static int packet_encoded_rtp(encoder_t *enc, void *u1, void *u2);
 static int packet_decoded_fifo(decoder_t *decoder, AVFrame *frame, void *u1, void *u2);
 static int packet_decoded_direct(decoder_t *decoder, AVFrame *frame, void *u1, void *u2);
@@ -212,6 +250,9 @@ static int __buffer_dtx(struct dtx_buffer *dtxb, struct codec_ssrc_handler *ch,
 			struct transcode_packet *packet,
 			struct media_packet *mp));
 static void __dtx_shutdown(struct dtx_buffer *dtxb);
+static void dtx_schedule(struct dtx_buffer *dtxb);
+static int __codec_worker_push(struct codec_ssrc_handler *ch, struct codec_ssrc_handler *input_ch,
+		struct transcode_packet *packet, struct media_packet *mp);
 static struct codec_handler *__input_handler(struct codec_handler *h, struct media_packet *mp);
 
 
@@ -239,6 +280,7 @@ static void __handler_shutdown(struct codec_handler *handler) {
 	handler->dtmf_payload_type = -1;
 	handler->cn_payload_type = -1;
 	handler->pcm_dtmf_detect = 0;
+	handler->direct = 0;
 	handler->passthrough = 0;
 
 	codec_handler_free(&handler->dtmf_injector);
@@ -318,6 +360,47 @@ static void __make_passthrough_ssrc(struct codec_handler *handler) {
 	handler->passthrough = 1;
 }
 
+INLINE int __is_g711(const struct rtp_payload_type *pt) {
+	return pt->codec_def->avcodec_id == AV_CODEC_ID_PCM_ALAW
+		|| pt->codec_def->avcodec_id == AV_CODEC_ID_PCM_MULAW;
+}
+// codecs whose payload can be cut and joined at frame boundaries without decoding.
+// returns the frame size in bytes and the number of samples (PTS) per frame
+static int __repacketize_frame(const struct rtp_payload_type *pt, unsigned int *pts) {
+	const codec_def_t *def = pt->codec_def;
+	if (pt->channels != 1)
+		return 0;
+	if (__is_g711(pt) || def->avcodec_id == AV_CODEC_ID_ADPCM_G722) {
+		*pts = def->clockrate_mult;
+		return 1;
+	}
+	if (def->bits_per_sample == 1 && !strncmp(def->rtpname, "G729", 4)) {
+		*pts = 80;
+		return 10;
+	}
+	return 0;
+}
+// can we translate or repacketize directly, without going through decoder and encoder?
+static int __direct_transcode(struct codec_handler *handler, struct rtp_payload_type *dest,
+		int pcm_dtmf_detect, int cn_payload_type)
+{
+	unsigned int pts;
+	if (!__repacketize_frame(&handler->source_pt, &pts) || !__repacketize_frame(dest, &pts))
+		return 0;
+	if (handler->source_pt.codec_def != dest->codec_def
+			&& (!__is_g711(&handler->source_pt) || !__is_g711(dest)))
+		return 0;
+	if (handler->source_pt.clock_rate != dest->clock_rate)
+		return 0;
+	// these need to see PCM
+	if (pcm_dtmf_detect || cn_payload_type != -1)
+		return 0;
+	// DTX fills gaps from the decoder
+	if (rtpe_config.dtx_delay)
+		return 0;
+	return 1;
+}
+
 static void __make_transcoder(struct codec_handler *handler, struct rtp_payload_type *dest,
 		GHashTable *output_transcoders, int dtmf_payload_type, int pcm_dtmf_detect,
 		int cn_payload_type)
@@ -355,18 +438,20 @@ reset:
 	handler->dtmf_payload_type = dtmf_payload_type;
 	handler->cn_payload_type = cn_payload_type;
 	handler->pcm_dtmf_detect = pcm_dtmf_detect ? 1 : 0;
+	handler->direct = __direct_transcode(handler, dest, pcm_dtmf_detect, cn_payload_type);
 
 	// DTMF transcoder/scaler?
 	if (handler->source_pt.codec_def && handler->source_pt.codec_def->dtmf)
 		handler->func = handler_func_dtmf;
 
 	ilogs(codec, LOG_DEBUG, "Created transcode context for " STR_FORMAT " (%i) -> " STR_FORMAT
-		" (%i) with DTMF output %i and CN output %i",
+		" (%i) with DTMF output %i and CN output %i%s",
 			STR_FMT(&handler->source_pt.encoding_with_params),
 			handler->source_pt.payload_type,
 			STR_FMT(&dest->encoding_with_params),
 			dest->payload_type,
-			dtmf_payload_type, cn_payload_type);
+			dtmf_payload_type, cn_payload_type,
+			handler->direct ? " (direct)" : "");
 
 	handler->ssrc_hash = create_ssrc_hash_full(__ssrc_handler_transcode_new, handler);
 
@@ -427,6 +512,35 @@ struct codec_handler *codec_handler_make_playback(const struct rtp_payload_type
 	return handler;
 }
 
+// playback of payloads that are already encoded for dst_pt: no decoder or encoder, only
+// the output stage to stamp and schedule the RTP packets
+struct codec_handler *codec_handler_make_playback_cached(const struct rtp_payload_type *dst_pt,
+		unsigned long last_ts, struct call_media *media)
+{
+	struct codec_handler *handler = __handler_new(dst_pt, media, NULL);
+	rtp_payload_type_copy(&handler->dest_pt, dst_pt);
+	handler->func = handler_func_playback_cached;
+
+	struct codec_ssrc_handler *ch = obj_alloc0("codec_ssrc_handler", sizeof(*ch), __free_ssrc_handler);
+	ch->handler = handler;
+	ch->ptime = dst_pt->ptime;
+	ch->encoder_format = (format_t) {
+		.clockrate = dst_pt->clock_rate * dst_pt->codec_def->clockrate_mult,
+		.channels = dst_pt->channels,
+		.format = -1,
+	};
+	ch->first_ts = last_ts;
+	while (ch->first_ts == 0)
+		ch->first_ts = ssl_random();
+	ch->rtp_mark = 1;
+	handler->ssrc_handler = ch;
+
+	ilogs(codec, LOG_DEBUG, "Created cached media playback context for " STR_FORMAT,
+			STR_FMT(&dst_pt->encoding_with_params));
+
+	return handler;
+}
+
 static void ensure_codec_def_type(struct rtp_payload_type *pt, enum media_type type) {
 	if (pt->codec_def)
 		return;
@@ -1472,7 +1586,10 @@ static int __handler_func_sequencer(struct media_packet *mp, struct transcode_pa
 		// we might be working with a different packet now
 		mp->rtp = &packet->rtp;
 
-		func_ret = packet->func(ch, input_ch, packet, mp);
+		if (codec_workers)
+			func_ret = __codec_worker_push(ch, input_ch, packet, mp);
+		else
+			func_ret = packet->func(ch, input_ch, packet, mp);
 		if (func_ret < 0)
 			ilogs(transcoding, LOG_WARN | LOG_FLAG_LIMIT, "Decoder error while processing RTP packet");
 next:
@@ -2053,12 +2170,12 @@ static int __buffer_dtx(struct dtx_buffer *dtxb, struct codec_ssrc_handler *deco
 			ts, dtxb->packets.length);
 
 	// schedule timer if not running yet
-	if (!dtxb->ct.next.tv_sec) {
+	if (!dtxb->next.tv_sec) {
 		if (!dtxb->ssrc)
 			dtxb->ssrc = mp->ssrc_in->parent->h.ssrc;
-		dtxb->ct.next = mp->tv;
-		timeval_add_usec(&dtxb->ct.next, rtpe_config.dtx_delay * 1000);
-		timerthread_obj_schedule_abs(&dtxb->ct.tt_obj, &dtxb->ct.next);
+		dtxb->next = mp->tv;
+		timeval_add_usec(&dtxb->next, rtpe_config.dtx_delay * 1000);
+		dtx_schedule(dtxb);
 	}
 
 	// packet now consumed
@@ -2080,10 +2197,54 @@ static void dtx_packet_free(struct dtx_packet *dtxp) {
 	g_slice_free1(sizeof(*dtxp), dtxp);
 }
 static void dtx_buffer_stop(struct dtx_buffer **dtxbp) {
-	codec_timer_stop((struct codec_timer **) dtxbp);
+	if (!*dtxbp)
+		return;
+	obj_put(*dtxbp);
+	*dtxbp = NULL;
+}
+// w is locked. returns whether the wheel must be scheduled to run at `tick`
+static int dtx_wheel_wake_nl(struct dtx_wheel *w, long long tick) {
+	if (w->wake_tick && w->wake_tick <= tick)
+		return 0;
+	w->wake_tick = tick;
+	return 1;
+}
+// no lock held
+static void dtx_wheel_wake(struct dtx_wheel *w, long long tick) {
+	struct timeval tv;
+	timeval_from_us(&tv, tick * DTX_TICK);
+	timerthread_obj_schedule_abs(&w->ct.tt_obj, &tv);
+}
+// dtxb is locked
+static void dtx_schedule(struct dtx_buffer *dtxb) {
+	struct dtx_wheel *w = dtxb->wheel;
+	long long tick = (timeval_us(&dtxb->next) + DTX_TICK - 1) / DTX_TICK;
+	int wake = 0;
+
+	mutex_lock(&w->lock);
+
+	if (tick < w->next_tick)
+		tick = w->next_tick;
+	if (dtxb->wheel_tick) {
+		if (dtxb->wheel_tick <= tick)
+			goto out; // already scheduled sooner
+		g_queue_unlink(&w->slots[dtxb->wheel_tick & (DTX_WHEEL_SLOTS - 1)], &dtxb->link);
+	}
+	else {
+		obj_hold(dtxb); // held by the wheel
+		w->entries++;
+	}
+	dtxb->wheel_tick = tick;
+	g_queue_push_tail_link(&w->slots[tick & (DTX_WHEEL_SLOTS - 1)], &dtxb->link);
+	wake = dtx_wheel_wake_nl(w, tick);
+
+out:
+	mutex_unlock(&w->lock);
+
+	if (wake)
+		dtx_wheel_wake(w, tick);
 }
-static void __dtx_send_later(struct codec_timer *ct) {
-	struct dtx_buffer *dtxb = (void *) ct;
+static void __dtx_send_later(struct dtx_buffer *dtxb) {
 	struct media_packet mp_copy = {0,};
 	int ret = 0, discard = 0;
 	unsigned long ts;
@@ -2153,12 +2314,12 @@ static void __dtx_send_later(struct codec_timer *ct) {
 
 	if (!call || !ch || !ps || !ps->ssrc_in
 			|| dtxb->ssrc != ps->ssrc_in->parent->h.ssrc
-			|| dtxb->ct.next.tv_sec == 0) {
+			|| dtxb->next.tv_sec == 0) {
 		// shut down or SSRC change
 		ilogs(dtx, LOG_DEBUG, "DTX buffer for %lx has been shut down", (unsigned long) dtxb->ssrc);
 		if (ch)
 			dtx_buffer_stop(&ch->dtx_buffer);
-		dtxb->ct.next.tv_sec = 0;
+		dtxb->next.tv_sec = 0;
 		dtxb->head_ts = 0;
 		mutex_unlock(&dtxb->lock);
 		goto out; // shut down
@@ -2171,7 +2332,7 @@ static void __dtx_send_later(struct codec_timer *ct) {
 				"(%li ms < %i ms), "
 				"pushing DTX timer forward my %i ms",
 				tv_diff / 1000, rtpe_config.dtx_delay, rtpe_config.dtx_shift);
-		timeval_add_usec(&dtxb->ct.next, rtpe_config.dtx_shift * 1000);
+		timeval_add_usec(&dtxb->next, rtpe_config.dtx_shift * 1000);
 	}
 	else if (dtxp && ts_diff < dtxb->tspp) {
 		// TS underflow
@@ -2184,7 +2345,7 @@ static void __dtx_send_later(struct codec_timer *ct) {
 					"(TS %lu, diff %li), "
 					"pushing DTX timer forward by %i ms and discarding packet",
 					ts, ts_diff, rtpe_config.dtx_shift);
-			timeval_add_usec(&dtxb->ct.next, rtpe_config.dtx_shift * 1000);
+			timeval_add_usec(&dtxb->next, rtpe_config.dtx_shift * 1000);
 			discard = 1;
 		}
 	}
@@ -2198,7 +2359,7 @@ static void __dtx_send_later(struct codec_timer *ct) {
 			ilogs(dtx, LOG_DEBUG, "DTX timer queue overflowing (%i packets in queue, "
 					"%lli ms delay), speeding up DTX timer by %i ms",
 					dtxb->packets.length, ts_diff_us / 1000, rtpe_config.dtx_shift);
-			timeval_add_usec(&dtxb->ct.next, rtpe_config.dtx_shift * -1000);
+			timeval_add_usec(&dtxb->next, rtpe_config.dtx_shift * -1000);
 		}
 	}
 
@@ -2257,8 +2418,8 @@ static void __dtx_send_later(struct codec_timer *ct) {
 	}
 
 	// schedule next run
-	timeval_add_usec(&dtxb->ct.next, dtxb->ptime * 1000);
-	timerthread_obj_schedule_abs(&dtxb->ct.tt_obj, &dtxb->ct.next);
+	timeval_add_usec(&dtxb->next, dtxb->ptime * 1000);
+	dtx_schedule(dtxb);
 
 	mutex_unlock(&dtxb->lock);
 
@@ -2315,13 +2476,13 @@ static void __dtx_setup(struct codec_ssrc_handler *ch) {
 	if (!decoder_has_dtx(ch->decoder) || ch->dtx_buffer)
 		return;
 
-	if (!rtpe_config.dtx_delay)
+	if (!rtpe_config.dtx_delay || !dtx_num_wheels)
 		return;
 
 	struct dtx_buffer *dtx =
 		ch->dtx_buffer = obj_alloc0("dtx_buffer", sizeof(*dtx), __dtx_free);
-	dtx->ct.tt_obj.tt = &codec_timers_thread;
-	dtx->ct.func = __dtx_send_later;
+	dtx->wheel = dtx_wheels[(unsigned int) g_atomic_int_add(&dtx_wheel_rr, 1) % dtx_num_wheels];
+	dtx->link.data = dtx;
 	dtx->csh = obj_get(&ch->h);
 	dtx->call = obj_get(ch->handler->media->call);
 	mutex_init(&dtx->lock);
@@ -2335,8 +2496,195 @@ static void __dtx_setup(struct codec_ssrc_handler *ch) {
 	dtx->clockrate = ch->handler->source_pt.clock_rate;
 	dtx->tspp = dtx->ptime * dtx->clockrate / 1000;
 }
+// hands a sequenced packet over to a transcoding thread. all packets from one
+// source go to the same thread, so they're processed in order
+static int __codec_worker_push(struct codec_ssrc_handler *ch, struct codec_ssrc_handler *input_ch,
+		struct transcode_packet *packet, struct media_packet *mp)
+{
+	if (!mp->sfd || !mp->call || !mp->ssrc_in || !mp->ssrc_out)
+		return packet->func(ch, input_ch, packet, mp);
+
+	struct dtx_packet *dtxp = g_slice_alloc0(sizeof(*dtxp));
+	dtxp->packet = packet;
+	dtxp->func = packet->func;
+	dtxp->decoder_handler = obj_get(&ch->h);
+	dtxp->input_handler = obj_get(&input_ch->h);
+	media_packet_copy(&dtxp->mp, mp); // holds the sfd and thus the call
+
+	struct codec_worker *w = &codec_workers[mp->ssrc_in->parent->h.ssrc
+		% rtpe_config.transcode_num_threads];
+
+	mutex_lock(&w->lock);
+	g_queue_push_tail(&w->packets, dtxp);
+	cond_signal(&w->cond);
+	mutex_unlock(&w->lock);
+
+	return 1; // consumed
+}
+static void __codec_worker_run(struct dtx_packet *dtxp) {
+	struct media_packet *mp = &dtxp->mp;
+	struct call *call = mp->call;
+	struct codec_ssrc_handler *ch = dtxp->decoder_handler;
+	struct packet_stream *ps = mp->stream;
+	int ret;
+
+	log_info_stream_fd(mp->sfd);
+
+	rwlock_lock_r(&call->master_lock);
+
+	if (ch->stopped || (dtxp->input_handler && dtxp->input_handler->stopped)
+			|| !ps || !ps->ssrc_in
+			|| ps->ssrc_in->parent->h.ssrc != mp->ssrc_in->parent->h.ssrc)
+	{
+		// shut down or SSRC change
+		ilogs(transcoding, LOG_DEBUG, "Codec handler for %lx has been shut down, discarding packet",
+				(unsigned long) mp->ssrc_in->parent->h.ssrc);
+		rwlock_unlock_r(&call->master_lock);
+		goto out;
+	}
+
+	__ssrc_lock_both(mp);
+
+	ret = dtxp->func(dtxp->decoder_handler, dtxp->input_handler, dtxp->packet, mp);
+	if (ret == 1)
+		dtxp->packet = NULL; // consumed
+	else if (ret < 0)
+		ilogs(transcoding, LOG_WARN | LOG_FLAG_LIMIT, "Decoder error while processing RTP packet");
+
+	__ssrc_unlock_both(mp);
+
+	// send whatever was produced, even if the packet was consumed or decoding failed later on
+	if (mp->packets_out.length) {
+		struct sink_handler *sh = &mp->sink;
+		struct packet_stream *sink = sh->sink;
+
+		if (!sink)
+			media_socket_dequeue(mp, NULL); // just free
+		else {
+			if (sh->handler && media_packet_encrypt(sh->handler->out->rtp_crypt, sink, mp))
+				ilogs(transcoding, LOG_ERR | LOG_FLAG_LIMIT, "Error encrypting transcoded RTP media");
+
+			mutex_lock(&sink->out_lock);
+			if (media_socket_dequeue(mp, sink))
+				ilogs(transcoding, LOG_ERR | LOG_FLAG_LIMIT,
+						"Error sending transcoded media to RTP sink");
+			mutex_unlock(&sink->out_lock);
+		}
+	}
+
+	rwlock_unlock_r(&call->master_lock);
+
+out:
+	dtx_packet_free(dtxp);
+	log_info_clear();
+}
+void codec_worker_loop(void *p) {
+	struct codec_worker *w = &codec_workers[GPOINTER_TO_UINT(p)];
+	struct dtx_packet *dtxp;
+
+	struct thread_waker waker = { .lock = &w->lock, .cond = &w->cond };
+	thread_waker_add(&waker);
+
+	mutex_lock(&w->lock);
+	while (!rtpe_shutdown) {
+		dtxp = g_queue_pop_head(&w->packets);
+		if (!dtxp) {
+			cond_wait(&w->cond, &w->lock);
+			continue;
+		}
+		mutex_unlock(&w->lock);
+
+		gettimeofday(&rtpe_now, NULL);
+		__codec_worker_run(dtxp);
+
+		mutex_lock(&w->lock);
+	}
+	mutex_unlock(&w->lock);
+
+	thread_waker_del(&waker);
+}
+
+// w is locked. returns the first occupied slot, or 0 if the wheel is empty. the entries
+// found there may be due only on a later turn of the wheel
+static long long dtx_wheel_next_nl(struct dtx_wheel *w) {
+	if (!w->entries)
+		return 0;
+	for (unsigned int i = 0; i < DTX_WHEEL_SLOTS; i++) {
+		if (w->slots[(w->next_tick + i) & (DTX_WHEEL_SLOTS - 1)].length)
+			return w->next_tick + i;
+	}
+	return 0;
+}
+static void __dtx_wheel_run(struct codec_timer *ct) {
+	struct dtx_wheel *w = (void *) ct;
+	long long now_tick = timeval_us(&rtpe_now) / DTX_TICK;
+
+	mutex_lock(&w->lock);
+	w->wake_tick = 0;
+
+	// visit each slot at most once, even if we've fallen behind by more than a full turn
+	long long end = MIN(now_tick, w->next_tick + DTX_WHEEL_SLOTS - 1);
+	for (; w->next_tick <= end; w->next_tick++) {
+		GQueue *slot = &w->slots[w->next_tick & (DTX_WHEEL_SLOTS - 1)];
+		GList *l = slot->head;
+		while (l) {
+			struct dtx_buffer *dtxb = l->data;
+			// entries for a later turn of the wheel stay where they are
+			if (dtxb->wheel_tick > now_tick) {
+				l = l->next;
+				continue;
+			}
+			g_queue_unlink(slot, l);
+			dtxb->wheel_tick = 0;
+			w->entries--;
+			mutex_unlock(&w->lock);
+
+			gettimeofday(&rtpe_now, NULL);
+			__dtx_send_later(dtxb);
+			obj_put(dtxb);
+
+			mutex_lock(&w->lock);
+			// the slot may have changed in the meantime
+			l = slot->head;
+		}
+	}
+	if (w->next_tick <= now_tick)
+		w->next_tick = now_tick + 1;
+
+	// sleep until the next occupied slot. an empty wheel is woken up by dtx_schedule()
+	long long next = dtx_wheel_next_nl(w);
+	int wake = next && dtx_wheel_wake_nl(w, next);
+	mutex_unlock(&w->lock);
+
+	if (wake)
+		dtx_wheel_wake(w, next);
+}
+static void __dtx_wheel_free(void *p) {
+	struct dtx_wheel *w = p;
+	mutex_destroy(&w->lock);
+}
+void codec_dtx_start(void) {
+	if (!rtpe_config.dtx_delay)
+		return;
+
+	// independent of the number of codec timer threads, only to spread out lock contention
+	gettimeofday(&rtpe_now, NULL);
+	dtx_num_wheels = MAX(1, rtpe_config.num_threads);
+	dtx_wheels = g_new0(struct dtx_wheel *, dtx_num_wheels);
+	for (unsigned int i = 0; i < dtx_num_wheels; i++) {
+		struct dtx_wheel *w = dtx_wheels[i] = obj_alloc0("dtx_wheel", sizeof(*w), __dtx_wheel_free);
+		w->ct.tt_obj.tt = &codec_timers_thread;
+		w->ct.func = __dtx_wheel_run;
+		mutex_init(&w->lock);
+		w->next_tick = timeval_us(&rtpe_now) / DTX_TICK;
+	}
+}
+
 static void __ssrc_handler_stop(void *p) {
 	struct codec_ssrc_handler *ch = p;
+	ch->stopped = 1;
+	if (ch->direct_buffer)
+		g_string_truncate(ch->direct_buffer, 0);
 	if (ch->dtx_buffer) {
 		mutex_lock(&ch->dtx_buffer->lock);
 		__dtx_shutdown(ch->dtx_buffer);
@@ -2360,39 +2708,40 @@ static void silence_event_free(void *p) {
 	g_slice_free1(sizeof(struct silence_event), p);
 }
 
-#define __silence_detect_type(type) \
-static void __silence_detect_ ## type(struct codec_ssrc_handler *ch, AVFrame *frame, type thres) { \
+#define __silence_detect_type(type, thres_type, scan) \
+static void __silence_detect_ ## type(struct codec_ssrc_handler *ch, AVFrame *frame, thres_type thres) { \
 	type *s = (void *) frame->data[0]; \
+	unsigned int num = frame->nb_samples; \
 	struct silence_event *last = g_queue_peek_tail(&ch->silence_events); \
  \
 	if (last && last->end) /* last event finished? */ \
 		last = NULL; \
  \
-	for (unsigned int i = 0; i < frame->nb_samples; i++) { \
-		if (s[i] <= thres && s[1] >= -thres) { \
-			/* silence */ \
-			if (!last) { \
-				/* new event */ \
-				last = g_slice_alloc0(sizeof(*last)); \
-				last->start = frame->pts + i; \
-				g_queue_push_tail(&ch->silence_events, last); \
-			} \
+	/* jump from one silence/non-silence transition to the next */ \
+	unsigned int i = 0; \
+	while (i < num) { \
+		bool silent = (last != NULL); \
+		i += scan(s + i, num - i, thres, silent); \
+		if (i >= num) \
+			break; \
+		if (!silent) { \
+			/* new event */ \
+			last = g_slice_alloc0(sizeof(*last)); \
+			last->start = frame->pts + i; \
+			g_queue_push_tail(&ch->silence_events, last); \
 		} \
 		else { \
-			/* not silence */ \
-			if (last && !last->end) { \
-				/* close off event */ \
-				last->end = frame->pts + i; \
-				last = NULL; \
-			} \
+			/* close off event */ \
+			last->end = frame->pts + i; \
+			last = NULL; \
 		} \
 	} \
 }
 
-__silence_detect_type(double)
-__silence_detect_type(float)
-__silence_detect_type(int32_t)
-__silence_detect_type(int16_t)
+__silence_detect_type(double, double, dsp.scan_dbl)
+__silence_detect_type(float, float, dsp.scan_flt)
+__silence_detect_type(int32_t, int32_t, dsp.scan_s32)
+__silence_detect_type(int16_t, int, dsp_scan_s16)
 
 static void __silence_detect(struct codec_ssrc_handler *ch, AVFrame *frame) {
 	if (!rtpe_config.silence_detect_int)
@@ -2483,12 +2832,21 @@ static struct ssrc_entry *__ssrc_handler_transcode_new(void *p) {
 
 	if (h->pcm_dtmf_detect) {
 		ilogs(codec, LOG_DEBUG, "Inserting DTMF DSP for output payload type %i", h->dtmf_payload_type);
-		ch->dtmf_format = (format_t) { .clockrate = 8000, .channels = 1, .format = AV_SAMPLE_FMT_S16 };
-		ch->dtmf_dsp = dtmf_rx_init(NULL, NULL, NULL);
-		if (!ch->dtmf_dsp)
-			ilogs(codec, LOG_ERR, "Failed to allocate DTMF RX context");
-		else
-			dtmf_rx_set_realtime_callback(ch->dtmf_dsp, __dtmf_dsp_callback, ch);
+		// the native detector runs at the encoder's sample rate, so that no resampling
+		// is needed. spandsp needs 8 kHz
+		if (!rtpe_config.dtmf_spandsp)
+			ch->dtmf_det = dtmf_det_new(ch->encoder_format.clockrate, __dtmf_dsp_callback, ch);
+		if (ch->dtmf_det)
+			ch->dtmf_format = (format_t) { .clockrate = ch->encoder_format.clockrate, .channels = 1,
+				.format = AV_SAMPLE_FMT_S16 };
+		else {
+			ch->dtmf_format = (format_t) { .clockrate = 8000, .channels = 1, .format = AV_SAMPLE_FMT_S16 };
+			ch->dtmf_dsp = dtmf_rx_init(NULL, NULL, NULL);
+			if (!ch->dtmf_dsp)
+				ilogs(codec, LOG_ERR, "Failed to allocate DTMF RX context");
+			else
+				dtmf_rx_set_realtime_callback(ch->dtmf_dsp, __dtmf_dsp_callback, ch);
+		}
 	}
 
 	ch->decoder = decoder_new_fmtp(h->source_pt.codec_def, h->source_pt.clock_rate, h->source_pt.channels,
@@ -2545,8 +2903,11 @@ static void __free_ssrc_handler(void *chp) {
 	}
 	if (ch->sample_buffer)
 		g_string_free(ch->sample_buffer, TRUE);
+	if (ch->direct_buffer)
+		g_string_free(ch->direct_buffer, TRUE);
 	if (ch->dtmf_dsp)
 		dtmf_rx_free(ch->dtmf_dsp);
+	dtmf_det_free(ch->dtmf_det);
 	resample_shutdown(&ch->dtmf_resampler);
 	g_queue_clear_full(&ch->dtmf_events, dtmf_event_free);
 	g_queue_clear_full(&ch->silence_events, silence_event_free);
@@ -2637,14 +2998,16 @@ static int packet_encoded_rtp(encoder_t *enc, void *u1, void *u2) {
 }
 
 static void __dtmf_detect(struct codec_ssrc_handler *ch, AVFrame *frame) {
-	if (!ch->dtmf_dsp)
+	if (!ch->dtmf_dsp && !ch->dtmf_det)
 		return;
 	if (ch->handler->dtmf_payload_type == -1 || !ch->handler->pcm_dtmf_detect) {
 		ch->dtmf_event.code = 0;
 		return;
 	}
 
-	AVFrame *dsp_frame = resample_frame(&ch->dtmf_resampler, frame, &ch->dtmf_format);
+	// the decoded frame is already in the encoder's format. if that's also what the DSP
+	// wants, we get the same frame back without any conversion or copy
+	AVFrame *dsp_frame = resample_frame_reuse(&ch->dtmf_resampler, frame, &ch->dtmf_format);
 	if (!dsp_frame) {
 		ilogs(transcoding, LOG_ERR | LOG_FLAG_LIMIT, "Failed to resample audio for DTMF DSP");
 		return;
@@ -2656,8 +3019,12 @@ static void __dtmf_detect(struct codec_ssrc_handler *ch, AVFrame *frame) {
 			frame->nb_samples,
 			dsp_frame->nb_samples);
 
-	if (dsp_frame->pts > ch->dtmf_ts)
-		dtmf_rx_fillin(ch->dtmf_dsp, dsp_frame->pts - ch->dtmf_ts);
+	if (dsp_frame->pts > ch->dtmf_ts) {
+		if (ch->dtmf_det)
+			dtmf_det_fillin(ch->dtmf_det, dsp_frame->pts - ch->dtmf_ts);
+		else
+			dtmf_rx_fillin(ch->dtmf_dsp, dsp_frame->pts - ch->dtmf_ts);
+	}
 	else if (dsp_frame->pts < ch->dtmf_ts)
 		ilogs(transcoding, LOG_ERR | LOG_FLAG_LIMIT, "DTMF TS seems to run backwards (%lu < %lu)",
 				(unsigned long) dsp_frame->pts,
@@ -2665,17 +3032,20 @@ static void __dtmf_detect(struct codec_ssrc_handler *ch, AVFrame *frame) {
 
 	int num_samples = dsp_frame->nb_samples;
 	int16_t *samples = (void *) dsp_frame->extended_data[0];
-	while (num_samples > 0) {
-		int ret = dtmf_rx(ch->dtmf_dsp, samples, num_samples);
-		if (ret < 0 || ret >= num_samples) {
-			ilogs(transcoding, LOG_ERR | LOG_FLAG_LIMIT, "DTMF DSP returned error %i", ret);
-			break;
+	if (ch->dtmf_det)
+		dtmf_det_process(ch->dtmf_det, samples, num_samples);
+	else {
+		while (num_samples > 0) {
+			int ret = dtmf_rx(ch->dtmf_dsp, samples, num_samples);
+			if (ret < 0 || ret >= num_samples) {
+				ilogs(transcoding, LOG_ERR | LOG_FLAG_LIMIT, "DTMF DSP returned error %i", ret);
+				break;
+			}
+			samples += num_samples - ret;
+			num_samples = ret;
 		}
-		samples += num_samples - ret;
-		num_samples = ret;
 	}
 	ch->dtmf_ts = dsp_frame->pts + dsp_frame->nb_samples;
-	av_frame_free(&dsp_frame);
 }
 
 static int packet_decoded_common(decoder_t *decoder, AVFrame *frame, void *u1, void *u2,
@@ -2755,8 +3125,135 @@ static int __rtp_decode(struct codec_ssrc_handler *ch, struct codec_ssrc_handler
 	mp->ssrc_out->parent->seq_diff--;
 	return ret;
 }
-static int packet_decode(struct codec_ssrc_handler *ch, struct codec_ssrc_handler *input_ch,
+static void __direct_output(struct codec_ssrc_handler *ch, struct media_packet *mp,
+		const unsigned char *src, unsigned int len, unsigned int pts, const unsigned char *table)
+{
+	encoder_t *enc = ch->encoder;
+
+	char *buf = malloc(sizeof(struct rtp_header) + len + RTP_BUFFER_TAIL_ROOM);
+	unsigned char *payload = (unsigned char *) buf + sizeof(struct rtp_header);
+	if (table) {
+		for (unsigned int i = 0; i < len; i++)
+			payload[i] = table[src[i]];
+	}
+	else
+		memcpy(payload, src, len);
+
+	__output_rtp(mp, ch, ch->handler, buf, len,
+			ch->first_ts + enc->next_pts / enc->def->clockrate_mult,
+			ch->rtp_mark ? 1 : 0, -1, 0, -1, 0);
+	mp->ssrc_out->parent->seq_diff++;
+	ch->rtp_mark = 0;
+
+	// keep the encoder's timeline in step, as DTMF and audio generated
+	// through the encoder must line up with what we send here
+	enc->next_pts += pts;
+	enc->fifo_pts += pts;
+}
+// translates one packet straight into the output encoding if needed, and repacketizes
+// it to the output ptime. payloads are only ever cut at frame boundaries.
+static int __direct_packet(struct codec_ssrc_handler *ch, struct codec_ssrc_handler *input_ch,
 		struct transcode_packet *packet, struct media_packet *mp)
+{
+	struct codec_ssrc_handler *new_ch = __output_ssrc_handler(ch, mp);
+	if (new_ch != ch) {
+		if (!new_ch->first_ts)
+			new_ch->first_ts = ch->first_ts;
+		ch = new_ch;
+	}
+
+	struct codec_handler *h = ch->handler;
+	str in = *packet->payload;
+	unsigned int frame_pts = 0;
+	unsigned int frame_len = __repacketize_frame(&h->dest_pt, &frame_pts);
+	if (G_UNLIKELY(!frame_len || !ch->encoder)) {
+		ilogs(transcoding, LOG_INFO | LOG_FLAG_LIMIT,
+				"Discarding %zu bytes due to lack of output encoder or packetizer",
+				in.len);
+		goto out;
+	}
+	// G.729 may end in a shorter comfort noise frame
+	unsigned int tail = in.len % frame_len;
+	unsigned int in_pts = (in.len / frame_len + (tail ? 1 : 0)) * frame_pts;
+
+	if (h->stats_entry) {
+		int idx = rtpe_now.tv_sec & 1;
+		atomic64_add(&h->stats_entry->pcm_samples[idx], in_pts);
+		atomic64_add(&h->stats_entry->pcm_samples[2], in_pts);
+	}
+
+	if (ch->skip_pts) {
+		if (in_pts < ch->skip_pts)
+			ch->skip_pts -= in_pts;
+		else
+			ch->skip_pts = 0;
+		ilogs(transcoding, LOG_DEBUG, "Discarding %u samples", in_pts);
+		goto out;
+	}
+
+	const unsigned char *table = NULL;
+	if (packet->handler->source_pt.codec_def != h->dest_pt.codec_def)
+		table = (packet->handler->source_pt.codec_def->avcodec_id == AV_CODEC_ID_PCM_ALAW)
+			? g711_alaw2ulaw : g711_ulaw2alaw;
+
+	int ptime = ch->ptime > 0 ? ch->ptime : h->dest_pt.codec_def->default_ptime;
+	unsigned int frames = ptime * h->dest_pt.clock_rate / 1000
+		* h->dest_pt.codec_def->clockrate_mult / frame_pts;
+	unsigned int bpp = (frames ? : 1) * frame_len;
+	if (!ch->direct_buffer)
+		ch->direct_buffer = g_string_new("");
+	GString *buf = ch->direct_buffer;
+
+	// whatever is left over from before another SSRC took over doesn't belong with this
+	// packet. the other SSRC's own remainder is dropped if and when it comes back
+	unsigned int ssrc = mp->ssrc_in->parent->h.ssrc;
+	if (g_atomic_int_get(&h->direct_ssrc) != ssrc) {
+		g_atomic_int_set(&h->direct_ssrc, ssrc);
+		if (buf->len)
+			ilogs(transcoding, LOG_DEBUG, "Discarding %zu buffered bytes after SSRC change",
+					buf->len);
+		g_string_truncate(buf, 0);
+	}
+
+	// whole packets go out straight from the input payload
+	while (!buf->len && in.len - tail >= bpp) {
+		__direct_output(ch, mp, (unsigned char *) in.s, bpp, bpp / frame_len * frame_pts, table);
+		str_shift(&in, bpp);
+	}
+
+	// otherwise collect what's left until we have enough for a packet
+	if (in.len) {
+		size_t pos = buf->len;
+		g_string_set_size(buf, pos + in.len);
+		unsigned char *dst = (unsigned char *) buf->str + pos;
+		if (table) {
+			for (size_t i = 0; i < in.len; i++)
+				dst[i] = table[(unsigned char) in.s[i]];
+		}
+		else
+			memcpy(dst, in.s, in.len);
+	}
+	while (buf->len - tail >= bpp) {
+		__direct_output(ch, mp, (unsigned char *) buf->str, bpp, bpp / frame_len * frame_pts, NULL);
+		g_string_erase(buf, 0, bpp);
+	}
+	// a trailing noise frame ends the talk spurt: send out everything we have
+	if (tail) {
+		__direct_output(ch, mp, (unsigned char *) buf->str, buf->len,
+				(buf->len / frame_len + 1) * frame_pts, NULL);
+		g_string_truncate(buf, 0);
+	}
+
+out:
+	obj_put(&new_ch->h);
+	mp->ssrc_out->parent->seq_diff--;
+	return 0;
+}
+
+static int __packet_decode(struct codec_ssrc_handler *ch, struct codec_ssrc_handler *input_ch,
+		struct transcode_packet *packet, struct media_packet *mp,
+		int (*decode_func)(struct codec_ssrc_handler *, struct codec_ssrc_handler *,
+			struct transcode_packet *, struct media_packet *))
 {
 	int ret = 0;
 
@@ -2778,17 +3275,27 @@ static int packet_decode(struct codec_ssrc_handler *ch, struct codec_ssrc_handle
 		}
 	}
 
-	if (__buffer_dtx(input_ch->dtx_buffer, ch, input_ch, packet, mp, __rtp_decode))
+	if (__buffer_dtx(input_ch->dtx_buffer, ch, input_ch, packet, mp, decode_func))
 		ret = 1; // consumed
 	else {
 		ilogs(transcoding, LOG_DEBUG, "Decoding RTP packet now");
-		ret = __rtp_decode(ch, input_ch, packet, mp);
+		ret = decode_func(ch, input_ch, packet, mp);
 		ret = ret ? -1 : 0;
 	}
 
 out:
 	return ret;
 }
+static int packet_decode(struct codec_ssrc_handler *ch, struct codec_ssrc_handler *input_ch,
+		struct transcode_packet *packet, struct media_packet *mp)
+{
+	return __packet_decode(ch, input_ch, packet, mp, __rtp_decode);
+}
+static int packet_direct(struct codec_ssrc_handler *ch, struct codec_ssrc_handler *input_ch,
+		struct transcode_packet *packet, struct media_packet *mp)
+{
+	return __packet_decode(ch, input_ch, packet, mp, __direct_packet);
+}
 
 #endif
 
@@ -2860,7 +3367,7 @@ static int handler_func_transcode(struct codec_handler *h, struct media_packet *
 	}
 
 	struct transcode_packet *packet = g_slice_alloc0(sizeof(*packet));
-	packet->func = packet_decode;
+	packet->func = h->direct ? packet_direct : packet_decode;
 	packet->rtp = *mp->rtp;
 	packet->handler = h;
 
@@ -2881,6 +3388,18 @@ static int handler_func_playback(struct codec_handler *h, struct media_packet *m
 	return 0;
 }
 
+// mp->payload is already encoded and mp->rtp->timestamp is relative to the start
+static int handler_func_playback_cached(struct codec_handler *h, struct media_packet *mp) {
+	struct codec_ssrc_handler *ch = h->ssrc_handler;
+	char *buf = malloc(sizeof(struct rtp_header) + mp->payload.len + RTP_BUFFER_TAIL_ROOM);
+	memcpy(buf + sizeof(struct rtp_header), mp->payload.s, mp->payload.len);
+	__output_rtp(mp, ch, h, buf, mp->payload.len, ch->first_ts + mp->rtp->timestamp,
+			ch->rtp_mark ? 1 : 0, -1, 0, -1, 0);
+	mp->ssrc_out->parent->seq_diff++;
+	ch->rtp_mark = 0;
+	return 0;
+}
+
 static int handler_func_inject_dtmf(struct codec_handler *h, struct media_packet *mp) {
 	h->input_handler = __input_handler(h, mp);
 	h->output_handler = h->input_handler;
@@ -3739,9 +4258,45 @@ static void codec_timers_run(void *p) {
 
 void codecs_init(void) {
 	timerthread_init(&codec_timers_thread, codec_timers_run);
+#ifdef WITH_TRANSCODING
+	if (rtpe_config.transcode_num_threads > 0) {
+		codec_workers = g_new0(struct codec_worker, rtpe_config.transcode_num_threads);
+		for (int i = 0; i < rtpe_config.transcode_num_threads; i++) {
+			mutex_init(&codec_workers[i].lock);
+			cond_init(&codec_workers[i].cond);
+		}
+	}
+#endif
 }
 void codecs_cleanup(void) {
 	timerthread_free(&codec_timers_thread);
+#ifdef WITH_TRANSCODING
+	if (codec_workers) {
+		for (int i = 0; i < rtpe_config.transcode_num_threads; i++) {
+			g_queue_clear_full(&codec_workers[i].packets, (GDestroyNotify) dtx_packet_free);
+			mutex_destroy(&codec_workers[i].lock);
+			cond_destroy(&codec_workers[i].cond);
+		}
+		g_free(codec_workers);
+		codec_workers = NULL;
+	}
+	for (unsigned int i = 0; i < dtx_num_wheels; i++) {
+		struct dtx_wheel *w = dtx_wheels[i];
+		for (unsigned int j = 0; j < DTX_WHEEL_SLOTS; j++) {
+			GList *l;
+			while ((l = g_queue_pop_head_link(&w->slots[j]))) {
+				struct dtx_buffer *dtxb = l->data;
+				dtxb->wheel_tick = 0;
+				obj_put(dtxb);
+			}
+		}
+		w->entries = 0;
+		obj_put(w);
+	}
+	g_free(dtx_wheels);
+	dtx_wheels = NULL;
+	dtx_num_wheels = 0;
+#endif
 }
 void codec_timers_loop(void *p) {
 	timerthread_run(&codec_timers_thread);
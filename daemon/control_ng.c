@@ -4,6 +4,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <assert.h>
+#include <limits.h>
 
 #include "obj.h"
 #include "poller.h"
@@ -145,28 +146,9 @@ static void __ng_buffer_free(void *p) {
 		obj_put_o(ngbuf->ref);
 }
 
-int control_ng_process(str *buf, const endpoint_t *sin, char *addr,
-		void (*cb)(str *, str *, const endpoint_t *, void *), void *p1, struct obj *ref)
-{
-	struct ng_buffer *ngbuf;
-	bencode_item_t *dict, *resp;
-	str cmd = STR_NULL, cookie, data, reply, *to_send, callid;
-	const char *errstr, *resultstr;
-	GString *log_str;
-	struct timeval cmd_start, cmd_stop, cmd_process_time;
-	struct control_ng_stats* cur = get_control_ng_stats(&sin->address);
-	int funcret = -1;
-	enum ng_command command = -1;
-
-	str_chr_str(&data, buf, ' ');
-	if (!data.s || data.s == buf->s) {
-		ilogs(control, LOG_WARNING, "Received invalid data on NG port (no cookie) from %s: " STR_FORMAT_M,
-				addr, STR_FMT_M(buf));
-		return funcret;
-	}
-
-	// init decode buffer object
-	ngbuf = obj_alloc0("ng_buffer", sizeof(*ngbuf), __ng_buffer_free);
+// returns locked
+static struct ng_buffer *ng_buffer_new(struct obj *ref) {
+	struct ng_buffer *ngbuf = obj_alloc0("ng_buffer", sizeof(*ngbuf), __ng_buffer_free);
 	mutex_init(&ngbuf->lock);
 	mutex_lock(&ngbuf->lock);
 	if (ref)
@@ -175,30 +157,121 @@ int control_ng_process(str *buf, const endpoint_t *sin, char *addr,
 	int ret = bencode_buffer_init(&ngbuf->buffer);
 	assert(ret == 0);
 	(void) ret;
+
+	return ngbuf;
+}
+
+// perfect hash of the most commonly used top-level keys of NG requests, for
+// bencode_dictionary_index(). other keys are still found through the regular lookup
+#define NG_KEYS_NUM 56
+static int ng_key_lookup(const char *key, size_t len) {
+	str s = STR_CONST_INIT_LEN((char *) key, len);
+	switch (__csh_lookup(&s)) {
+		case CSH_LOOKUP("command"):		return 0;
+		case CSH_LOOKUP("call-id"):		return 1;
+		case CSH_LOOKUP("from-tag"):		return 2;
+		case CSH_LOOKUP("to-tag"):		return 3;
+		case CSH_LOOKUP("via-branch"):		return 4;
+		case CSH_LOOKUP("label"):		return 5;
+		case CSH_LOOKUP("address"):		return 6;
+		case CSH_LOOKUP("sdp"):			return 7;
+		case CSH_LOOKUP("flags"):		return 8;
+		case CSH_LOOKUP("replace"):		return 9;
+		case CSH_LOOKUP("supports"):		return 10;
+		case CSH_LOOKUP("direction"):		return 11;
+		case CSH_LOOKUP("received from"):	return 12;
+		case CSH_LOOKUP("received-from"):	return 13;
+		case CSH_LOOKUP("drop-traffic"):	return 14;
+		case CSH_LOOKUP("ICE"):			return 15;
+		case CSH_LOOKUP("ICE-lite"):		return 16;
+		case CSH_LOOKUP("DTLS"):		return 17;
+		case CSH_LOOKUP("DTLS-reverse"):	return 18;
+		case CSH_LOOKUP("DTLS-fingerprint"):	return 19;
+		case CSH_LOOKUP("passthrough"):		return 20;
+		case CSH_LOOKUP("rtcp-mux"):		return 21;
+		case CSH_LOOKUP("SDES"):		return 22;
+		case CSH_LOOKUP("OSRTP"):		return 23;
+		case CSH_LOOKUP("T38"):			return 24;
+		case CSH_LOOKUP("T.38"):		return 25;
+		case CSH_LOOKUP("transport-protocol"):	return 26;
+		case CSH_LOOKUP("transport protocol"):	return 27;
+		case CSH_LOOKUP("media-address"):	return 28;
+		case CSH_LOOKUP("media address"):	return 29;
+		case CSH_LOOKUP("address-family"):	return 30;
+		case CSH_LOOKUP("address family"):	return 31;
+		case CSH_LOOKUP("TOS"):			return 32;
+		case CSH_LOOKUP("record-call"):		return 33;
+		case CSH_LOOKUP("record call"):		return 34;
+		case CSH_LOOKUP("metadata"):		return 35;
+		case CSH_LOOKUP("ptime"):		return 36;
+		case CSH_LOOKUP("ptime-reverse"):	return 37;
+		case CSH_LOOKUP("ptime reverse"):	return 38;
+		case CSH_LOOKUP("xmlrpc-callback"):	return 39;
+		case CSH_LOOKUP("codec"):		return 40;
+		case CSH_LOOKUP("generate-RTCP"):	return 41;
+		case CSH_LOOKUP("generate RTCP"):	return 42;
+		case CSH_LOOKUP("media-echo"):		return 43;
+		case CSH_LOOKUP("media echo"):		return 44;
+		case CSH_LOOKUP("delete-delay"):	return 45;
+		case CSH_LOOKUP("delete delay"):	return 46;
+		case CSH_LOOKUP("file"):		return 47;
+		case CSH_LOOKUP("blob"):		return 48;
+		case CSH_LOOKUP("db-id"):		return 49;
+		case CSH_LOOKUP("repeat-times"):	return 50;
+		case CSH_LOOKUP("code"):		return 51;
+		case CSH_LOOKUP("volume"):		return 52;
+		case CSH_LOOKUP("duration"):		return 53;
+		case CSH_LOOKUP("pause"):		return 54;
+		case CSH_LOOKUP("limit"):		return 55;
+		default:
+			return -1;
+	}
+}
+
+// consumes the (locked) ngbuf. `dict` may be given if the payload has already been decoded
+static int __control_ng_process(struct ng_buffer *ngbuf, str *cookie, str *data, bencode_item_t *dict,
+		const endpoint_t *sin, char *addr, ng_reply_func_t cb, void *p1)
+{
+	bencode_item_t *resp;
+	str cmd = STR_NULL, callid;
+	struct cookie_cache_entry *cached = NULL;
+	const char *errstr, *resultstr;
+	GString *log_str;
+	struct timeval cmd_start, cmd_stop, cmd_process_time;
+	struct control_ng_stats* cur = get_control_ng_stats(&sin->address);
+	int funcret = -1;
+	enum ng_command command = -1;
+	struct iovec *iov, cached_iov[NG_REPLY_IOV_HEAD + 1];
+	int iovcnt = 0;
+	size_t reply_len;
+
 	resp = bencode_dictionary(&ngbuf->buffer);
 	assert(resp != NULL);
 
-	cookie = *buf;
-	cookie.len -= data.len;
-	*data.s++ = '\0';
-	data.len--;
-
 	errstr = "Invalid data (no payload)";
-	if (data.len <= 0)
+	if (data->len <= 0)
 		goto err_send;
 
-	to_send = cookie_cache_lookup(&ng_cookie_cache, &cookie);
-	if (to_send) {
+	cached = cookie_cache_lookup(&ng_cookie_cache, cookie);
+	if (cached) {
+		iov = cached_iov;
+		iov[NG_REPLY_IOV_HEAD].iov_base = cached->reply.s;
+		iov[NG_REPLY_IOV_HEAD].iov_len = cached->reply.len;
+		iovcnt = 1;
+		reply_len = cached->reply.len;
 		ilogs(control, LOG_INFO, "Detected command from %s as a duplicate", addr);
 		resp = NULL;
 		goto send_only;
 	}
 
-	dict = bencode_decode_expect_str(&ngbuf->buffer, &data, BENCODE_DICTIONARY);
+	if (!dict)
+		dict = bencode_decode_expect_str(&ngbuf->buffer, data, BENCODE_DICTIONARY);
 	errstr = "Could not decode dictionary";
 	if (!dict)
 		goto err_send;
 
+	bencode_dictionary_index(dict, ng_key_lookup, NG_KEYS_NUM);
+
 	bencode_dictionary_get_str(dict, "command", &cmd);
 	errstr = "Dictionary contains no key \"command\"";
 	if (!cmd.s)
@@ -344,7 +417,7 @@ err_send:
 
 	if (errstr < magic_load_limit_strings[0] || errstr > magic_load_limit_strings[__LOAD_LIMIT_MAX-1]) {
 		ilogs(control, LOG_WARNING, "Protocol error in packet from %s: %s [" STR_FORMAT_M "]",
-				addr, errstr, STR_FMT_M(&data));
+				addr, errstr, STR_FMT_M(data));
 		bencode_dictionary_add_string(resp, "result", "error");
 		bencode_dictionary_add_string(resp, "error-reason", errstr);
 		g_atomic_int_inc(&cur->errors);
@@ -356,35 +429,42 @@ err_send:
 	}
 
 send_resp:
-	bencode_collapse_str(resp, &reply);
-	to_send = &reply;
+	// the reply is sent straight from the encoded document tree, without flattening it first
+	iov = bencode_iovec(resp, &iovcnt, NG_REPLY_IOV_HEAD, 0);
+	if (!iov) {
+		ilogs(control, LOG_ERR, "Failed to encode reply to %s", addr);
+		// release retransmissions waiting for this reply, they will be processed anew
+		cookie_cache_remove(&ng_cookie_cache, cookie);
+		goto out;
+	}
+	reply_len = resp->str_len;
 
 	if (cmd.s) {
 		ilogs(control, LOG_INFO, "Replying to '"STR_FORMAT"' from %s (elapsed time %llu.%06llu sec)", STR_FMT(&cmd), addr, (unsigned long long)cmd_process_time.tv_sec, (unsigned long long)cmd_process_time.tv_usec);
 
 		if (get_log_level(control) >= LOG_DEBUG) {
-			dict = bencode_decode_expect_str(&ngbuf->buffer, to_send, BENCODE_DICTIONARY);
-			if (dict) {
-				log_str = g_string_sized_new(256);
-				g_string_append_printf(log_str, "Response dump for '"STR_FORMAT"' to %s: %s",
-						STR_FMT(&cmd), addr,
-						rtpe_config.common.log_mark_prefix);
-				pretty_print(dict, log_str);
-				g_string_append(log_str, rtpe_config.common.log_mark_suffix);
-				ilogs(control, LOG_DEBUG, "%.*s", (int) log_str->len, log_str->str);
-				g_string_free(log_str, TRUE);
-			}
+			log_str = g_string_sized_new(256);
+			g_string_append_printf(log_str, "Response dump for '"STR_FORMAT"' to %s: %s",
+					STR_FMT(&cmd), addr,
+					rtpe_config.common.log_mark_prefix);
+			pretty_print(resp, log_str);
+			g_string_append(log_str, rtpe_config.common.log_mark_suffix);
+			ilogs(control, LOG_DEBUG, "%.*s", (int) log_str->len, log_str->str);
+			g_string_free(log_str, TRUE);
 		}
 	}
 
 send_only:
 	funcret = 0;
-	cb(&cookie, to_send, sin, p1);
 
+	// cache before sending: the send callback may rewrite the body iovecs
 	if (resp)
-		cookie_cache_insert(&ng_cookie_cache, &cookie, &reply);
-	else
-		free(to_send);
+		cookie_cache_insert_iov(&ng_cookie_cache, cookie, iov + NG_REPLY_IOV_HEAD, iovcnt, reply_len);
+
+	cb(cookie, iov, iovcnt + NG_REPLY_IOV_HEAD, reply_len, sin, p1);
+
+	if (!resp)
+		cookie_cache_entry_put(cached);
 
 	goto out;
 
@@ -394,21 +474,55 @@ out:
 	return funcret;
 }
 
-static void control_ng_send(str *cookie, str *body, const endpoint_t *sin, void *p1) {
-	socket_t *ul = p1;
-	struct iovec iov[3];
-	unsigned int iovlen;
+int control_ng_process(str *buf, const endpoint_t *sin, char *addr, ng_reply_func_t cb, void *p1,
+		struct obj *ref)
+{
+	str cookie, data;
+
+	str_chr_str(&data, buf, ' ');
+	if (!data.s || data.s == buf->s) {
+		ilogs(control, LOG_WARNING, "Received invalid data on NG port (no cookie) from %s: " STR_FORMAT_M,
+				addr, STR_FMT_M(buf));
+		return -1;
+	}
+
+	// init decode buffer object
+	struct ng_buffer *ngbuf = ng_buffer_new(ref);
+
+	cookie = *buf;
+	cookie.len -= data.len;
+	*data.s++ = '\0';
+	data.len--;
+
+	return __control_ng_process(ngbuf, &cookie, &data, NULL, sin, addr, cb, p1);
+}
 
-	iovlen = 3;
+static void control_ng_send(str *cookie, struct iovec *iov, unsigned int iovcnt, size_t body_len,
+		const endpoint_t *sin, void *p1)
+{
+	socket_t *ul = p1;
 
 	iov[0].iov_base = cookie->s;
 	iov[0].iov_len = cookie->len;
 	iov[1].iov_base = " ";
 	iov[1].iov_len = 1;
-	iov[2].iov_base = body->s;
-	iov[2].iov_len = body->len;
 
-	socket_sendiov(ul, iov, iovlen, sin);
+	if (iovcnt <= IOV_MAX) {
+		socket_sendiov(ul, iov, iovcnt, sin);
+		return;
+	}
+
+	// too many pieces for a single sendmsg(): flatten the body
+	char *body = malloc(body_len);
+	char *p = body;
+	for (unsigned int i = NG_REPLY_IOV_HEAD; i < iovcnt; i++) {
+		memcpy(p, iov[i].iov_base, iov[i].iov_len);
+		p += iov[i].iov_len;
+	}
+	iov[2].iov_base = body;
+	iov[2].iov_len = body_len;
+	socket_sendiov(ul, iov, 3, sin);
+	free(body);
 }
 
 static void control_ng_incoming(struct obj *obj, struct udp_buffer *udp_buf)
@@ -433,54 +547,66 @@ static void control_closed(struct streambuf_stream *s) {
 	ilog(LOG_DEBUG, "TCP connections map size: %d", g_hash_table_size(tcp_connections_hash));
 }
 
-static str *chunk_message(struct streambuf *b) {
-	char *p = NULL;
-	int len, to_del, bsize;
-	str *ret = NULL;
+// Decodes the next complete message from the stream buffer. The returned (locked) ngbuf takes
+// over the buffer contents, so that the decoded message doesn't need to be copied out.
+static struct ng_buffer *chunk_message(struct streambuf *b, struct obj *ref, str *cookie, str *data,
+		bencode_item_t **dict)
+{
+	char *p, *raw;
+	size_t len, total;
+	ssize_t used;
+	struct ng_buffer *ngbuf = NULL;
 
 	mutex_lock(&b->lock);
 
-	for (;;) {
-		if (b->eof)
-			break;
-
-		p = memchr(b->buf->str, ' ', b->buf->len);
-		if (!p)
-			break;
+	if (b->eof)
+		goto out;
 
-		len = p - b->buf->str;
-		if (len == b->buf->len)
-			break;
-
-		++p; /* bencode dictionary here */
-		bsize = bencode_valid(p, b->buf->str + b->buf->len - p);
-		if (bsize < 0)
-			break; /* not enough data to parse bencoded dictionary */
+	p = memchr(b->buf->str, ' ', b->buf->len);
+	if (!p)
+		goto out;
+
+	len = p - b->buf->str;
+	if (len + 1 >= b->buf->len)
+		goto out;
+
+	++p; /* bencode dictionary here */
+	ngbuf = ng_buffer_new(ref);
+	*dict = bencode_decode_prefix(&ngbuf->buffer, p, b->buf->str + b->buf->len - p, &used);
+	if (used < 0) {
+		/* not enough data to parse bencoded dictionary, or garbage */
+		ng_buffer_release(ngbuf);
+		ngbuf = NULL;
+		goto out;
+	}
+	if ((*dict)->type != BENCODE_DICTIONARY)
+		*dict = NULL;
 
-		p += bsize;
-		len = p - b->buf->str;
-		to_del = len;
+	// steal the buffer and leave only what's left over
+	total = b->buf->len;
+	raw = g_string_free(b->buf, FALSE);
+	b->buf = g_string_new_len(raw + len + 1 + used, total - len - 1 - used);
+	bencode_buffer_destroy_add(&ngbuf->buffer, g_free, raw);
 
-		ret = str_alloc(len);
-		memcpy(ret->s, b->buf->str, len);
-		ret->len = len;
-		g_string_erase(b->buf, 0, to_del);
-
-		break;
-	}
+	raw[len] = '\0';
+	str_init_len(cookie, raw, len);
+	str_init_len(data, raw + len + 1, used);
 
+out:
 	mutex_unlock(&b->lock);
-	return ret;
+	return ngbuf;
 }
 
 static void control_stream_readable(struct streambuf_stream *s) {
-	str *data;
+	struct ng_buffer *ngbuf;
+	str cookie, data;
+	bencode_item_t *dict;
 
 	ilog(LOG_DEBUG, "Got %ld bytes from %s", s->inbuf->buf->len, s->addr);
-	while ((data = chunk_message(s->inbuf))) {
+	while ((ngbuf = chunk_message(s->inbuf, s->parent, &cookie, &data, &dict))) {
 		ilog(LOG_DEBUG, "Got control ng message from %s", s->addr);
-		control_ng_process(data, &s->sock.remote, s->addr, control_ng_send, &s->sock, s->parent);
-		free(data);
+		__control_ng_process(ngbuf, &cookie, &data, dict, &s->sock.remote, s->addr, control_ng_send,
+				&s->sock);
 	}
 
 	if (streambuf_bufsize(s->inbuf) > 1024) {
@@ -592,8 +718,12 @@ static void notify_tcp_client(gpointer key, gpointer value, gpointer user_data)
 	char cookie_buf[17];
 	str cookie = STR_CONST_INIT(cookie_buf);
 
+	struct iovec iov[NG_REPLY_IOV_HEAD + 1];
+
 	rand_hex_str(cookie_buf, cookie.len / 2);
-	control_ng_send(&cookie, to_send, &s->sock.remote, &s->sock);
+	iov[NG_REPLY_IOV_HEAD].iov_base = to_send->s;
+	iov[NG_REPLY_IOV_HEAD].iov_len = to_send->len;
+	control_ng_send(&cookie, iov, G_N_ELEMENTS(iov), to_send->len, &s->sock.remote, &s->sock);
 }
 
 void notify_ng_tcp_clients(str *data) {
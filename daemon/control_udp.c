@@ -28,7 +28,8 @@ static void control_udp_incoming(struct obj *obj, struct udp_buffer *udp_buf) {
 	char **out;
 	struct iovec iov[10];
 	unsigned int iovlen;
-	str cookie, *reply;
+	str cookie, *reply = NULL;
+	struct cookie_cache_entry *cached;
 
 	ret = pcre_exec(u->parse_re, u->parse_ree, udp_buf->str.s, udp_buf->str.len, 0, 0, ovec, G_N_ELEMENTS(ovec));
 	if (ret <= 0) {
@@ -71,11 +72,11 @@ static void control_udp_incoming(struct obj *obj, struct udp_buffer *udp_buf) {
 	pcre_get_substring_list(udp_buf->str.s, ovec, ret, (const char ***) &out);
 
 	str_init(&cookie, (void *) out[RE_UDP_COOKIE]);
-	reply = cookie_cache_lookup(&u->cookie_cache, &cookie);
-	if (reply) {
+	cached = cookie_cache_lookup(&u->cookie_cache, &cookie);
+	if (cached) {
 		ilogs(control, LOG_INFO, "Detected command from udp:%s as a duplicate", udp_buf->addr);
-		socket_sendto(udp_buf->listener, reply->s, reply->len, &udp_buf->sin);
-		free(reply);
+		socket_sendto(udp_buf->listener, cached->reply.s, cached->reply.len, &udp_buf->sin);
+		cookie_cache_entry_put(cached);
 		goto out;
 	}
 
@@ -2,92 +2,168 @@
 
 #include <time.h>
 #include <glib.h>
+#include <assert.h>
 
 #include "compat.h"
 #include "aux.h"
 #include "poller.h"
 #include "str.h"
 
-INLINE void cookie_cache_state_init(struct cookie_cache_state *s) {
-	s->in_use = g_hash_table_new(str_hash, str_equal);
-	s->cookies = g_hash_table_new_full(str_hash, str_equal, free, free);
+/* The cache is split into independently locked shards selected by the cookie
+ * hash, so that unrelated commands never contend on the same lock. Entries
+ * are stamped with the generation (30 second slot) they were completed in and
+ * are considered valid for the current and the previous generation, which
+ * matches the lifetime of the old double-table swap. Stale entries are pruned
+ * lazily once per generation per shard. */
+
+INLINE time_t cookie_cache_generation(void) {
+	return rtpe_now.tv_sec / COOKIE_CACHE_GEN_SECS;
+}
+
+INLINE struct cookie_cache_shard *cookie_cache_shard(struct cookie_cache *c, const str *s) {
+	unsigned int h = str_hash(s);
+	return &c->shards[(h ^ (h >> 16)) % COOKIE_CACHE_SHARDS];
 }
-INLINE void cookie_cache_state_cleanup(struct cookie_cache_state *s) {
-	g_hash_table_destroy(s->cookies);
-	g_hash_table_destroy(s->in_use);
+
+static void __cookie_cache_entry_free(void *p) {
+	struct cookie_cache_entry *e = p;
+	free(e->cookie.s);
+	free(e->reply.s);
+	pthread_cond_destroy(&e->cond);
+}
+
+static struct cookie_cache_entry *__cookie_cache_entry_new(const str *s) {
+	struct cookie_cache_entry *e = obj_alloc0("cookie_cache_entry", sizeof(*e), __cookie_cache_entry_free);
+	e->cookie.s = malloc(s->len);
+	memcpy(e->cookie.s, s->s, s->len);
+	e->cookie.len = s->len;
+	cond_init(&e->cond);
+	return e;
+}
+
+static void __cookie_cache_entry_unref(void *p) {
+	struct cookie_cache_entry *e = p;
+	e->removed = 1;
+	cond_broadcast(&e->cond);
+	obj_put(e);
+}
+
+static gboolean __cookie_cache_expired(void *k, void *v, void *d) {
+	struct cookie_cache_entry *e = v;
+	time_t *gen = d;
+	if (!e->done)
+		return FALSE;
+	return (*gen - e->generation > 1) ? TRUE : FALSE;
 }
 
 void cookie_cache_init(struct cookie_cache *c) {
-	cookie_cache_state_init(&c->current);
-	cookie_cache_state_init(&c->old);
-	c->swap_time = rtpe_now.tv_sec;
-	mutex_init(&c->lock);
-	cond_init(&c->cond);
+	for (unsigned int i = 0; i < COOKIE_CACHE_SHARDS; i++) {
+		struct cookie_cache_shard *sh = &c->shards[i];
+		mutex_init(&sh->lock);
+		sh->entries = g_hash_table_new_full(str_hash, str_equal, NULL, __cookie_cache_entry_unref);
+		sh->generation = cookie_cache_generation();
+	}
 }
 
 /* lock must be held */
-static void __cookie_cache_check_swap(struct cookie_cache *c) {
-	if (rtpe_now.tv_sec - c->swap_time >= 30) {
-		g_hash_table_remove_all(c->old.cookies);
-		swap_ptrs(&c->old.cookies, &c->current.cookies);
-		c->swap_time = rtpe_now.tv_sec;
-	}
+static void __cookie_cache_check_expire(struct cookie_cache_shard *sh) {
+	time_t gen = cookie_cache_generation();
+	if (gen == sh->generation)
+		return;
+	sh->generation = gen;
+	g_hash_table_foreach_remove(sh->entries, __cookie_cache_expired, &gen);
 }
 
-str *cookie_cache_lookup(struct cookie_cache *c, const str *s) {
-	str *ret;
+// returns a reference which must be released with cookie_cache_entry_put()
+struct cookie_cache_entry *cookie_cache_lookup(struct cookie_cache *c, const str *s) {
+	struct cookie_cache_shard *sh = cookie_cache_shard(c, s);
+	struct cookie_cache_entry *e;
 
-	mutex_lock(&c->lock);
+	mutex_lock(&sh->lock);
 
-	__cookie_cache_check_swap(c);
+	__cookie_cache_check_expire(sh);
 
 restart:
-	ret = g_hash_table_lookup(c->current.cookies, s);
-	if (!ret)
-		ret = g_hash_table_lookup(c->old.cookies, s);
-	if (ret) {
-		ret = str_dup(ret);
-		mutex_unlock(&c->lock);
-		return ret;
+	e = g_hash_table_lookup(sh->entries, s);
+	if (!e) {
+		// caller is required to call cookie_cache_insert or cookie_cache_remove
+		e = __cookie_cache_entry_new(s);
+		g_hash_table_replace(sh->entries, &e->cookie, e);
+		mutex_unlock(&sh->lock);
+		return NULL;
 	}
 
-	// is it being worked on right now by another thread?
-	void *p = g_hash_table_lookup(c->current.in_use, s);
-	if (!p)
-		p = g_hash_table_lookup(c->old.in_use, s);
-	if (p) {
-		cond_wait(&c->cond, &c->lock);
+	if (e->done && sh->generation - e->generation <= 1) {
+		obj_hold(e);
+		mutex_unlock(&sh->lock);
+		return e;
+	}
+	if (e->done) {
+		g_hash_table_remove(sh->entries, s);
 		goto restart;
 	}
 
-	// caller is required to call cookie_cache_insert or cookie_cache_remove
-	// before `s` runs out of scope
-	g_hash_table_replace(c->current.in_use, (void *) s, (void *) 0x1);
-	mutex_unlock(&c->lock);
-	return NULL;
+	// being worked on right now by another thread: wait for this cookie only
+	obj_hold(e);
+	while (!e->done && !e->removed)
+		cond_wait(&e->cond, &sh->lock);
+	if (e->done) {
+		mutex_unlock(&sh->lock);
+		return e;
+	}
+	obj_put(e);
+	goto restart;
+}
+
+void cookie_cache_insert_iov(struct cookie_cache *c, const str *s, const struct iovec *iov, unsigned int iovcnt,
+		size_t len)
+{
+	struct cookie_cache_shard *sh = cookie_cache_shard(c, s);
+	struct cookie_cache_entry *e;
+
+	// flatten outside of the lock
+	char *reply = malloc(len);
+	char *p = reply;
+	for (unsigned int i = 0; i < iovcnt; i++) {
+		memcpy(p, iov[i].iov_base, iov[i].iov_len);
+		p += iov[i].iov_len;
+	}
+	assert(p - reply == len);
+
+	mutex_lock(&sh->lock);
+	e = g_hash_table_lookup(sh->entries, s);
+	if (!e || e->done) {
+		e = __cookie_cache_entry_new(s);
+		g_hash_table_replace(sh->entries, &e->cookie, e);
+	}
+	e->reply.s = reply;
+	e->reply.len = len;
+	e->generation = cookie_cache_generation();
+	e->done = 1;
+	cond_broadcast(&e->cond);
+	mutex_unlock(&sh->lock);
 }
 
 void cookie_cache_insert(struct cookie_cache *c, const str *s, const str *r) {
-	mutex_lock(&c->lock);
-	g_hash_table_remove(c->current.in_use, s);
-	g_hash_table_remove(c->old.in_use, s);
-	g_hash_table_replace(c->current.cookies, str_dup(s), str_dup(r));
-	g_hash_table_remove(c->old.cookies, s);
-	cond_broadcast(&c->cond);
-	mutex_unlock(&c->lock);
+	struct iovec iov = {
+		.iov_base = r->s,
+		.iov_len = r->len,
+	};
+	cookie_cache_insert_iov(c, s, &iov, 1, r->len);
 }
 
 void cookie_cache_remove(struct cookie_cache *c, const str *s) {
-	mutex_lock(&c->lock);
-	g_hash_table_remove(c->current.in_use, s);
-	g_hash_table_remove(c->old.in_use, s);
-	g_hash_table_remove(c->current.cookies, s);
-	g_hash_table_remove(c->old.cookies, s);
-	cond_broadcast(&c->cond);
-	mutex_unlock(&c->lock);
+	struct cookie_cache_shard *sh = cookie_cache_shard(c, s);
+
+	mutex_lock(&sh->lock);
+	g_hash_table_remove(sh->entries, s);
+	mutex_unlock(&sh->lock);
 }
 
 void cookie_cache_cleanup(struct cookie_cache *c) {
-	cookie_cache_state_cleanup(&c->current);
-	cookie_cache_state_cleanup(&c->old);
+	for (unsigned int i = 0; i < COOKIE_CACHE_SHARDS; i++) {
+		struct cookie_cache_shard *sh = &c->shards[i];
+		g_hash_table_destroy(sh->entries);
+		mutex_destroy(&sh->lock);
+	}
 }
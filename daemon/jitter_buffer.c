@@ -18,10 +18,15 @@
 
 static struct timerthread jitter_buffer_thread;
 
+static void jb_ring_run(void *p);
+
 
 void jitter_buffer_init(void) {
 	//ilog(LOG_DEBUG, "jitter_buffer_init");
-	timerthread_init(&jitter_buffer_thread, timerthread_queue_run);
+	if (rtpe_config.jb_adaptive)
+		timerthread_init(&jitter_buffer_thread, jb_ring_run);
+	else
+		timerthread_init(&jitter_buffer_thread, timerthread_queue_run);
 }
 
 void jitter_buffer_init_free(void) {
@@ -220,6 +225,273 @@ static int handle_clock_drift(struct media_packet *mp) {
 	return 0;
 }
 
+// Ring buffer jitter buffer (--jb-adaptive). Packets are copied into a slot indexed by their
+// sequence number, and are played out at their media time plus a delay that follows the
+// measured interarrival jitter. Whatever is due is sent out by the thread that received the
+// packet; the timer thread only runs when the head of the ring becomes due later on.
+
+#define JB_RING_MIN_SLOTS 16
+#define JB_JITTER_MULT 3 // playout delay as multiple of the measured jitter
+#define JB_DELAY_STEP 250 // max delay decrease per packet, in us
+#define JB_DEFAULT_INTERVAL 20000 // in us, until measured
+
+// jb is locked
+static void jb_ring_drain(struct jitter_buffer *jb) {
+	jb->ring_started = false;
+	if (jb->ring_count)
+		jb->draining = true;
+}
+
+// jb is locked. returns 0 if the packet was consumed, 1 if it should be passed through
+static int jb_ring_store(struct jitter_buffer *jb, struct media_packet *mp, const str *s,
+		const struct rtp_header *rtp, unsigned int clock_rate)
+{
+	uint16_t seq = ntohs(rtp->seq_num);
+	uint32_t ts = ntohl(rtp->timestamp);
+	const struct timeval *tv = mp->tv.tv_sec ? &mp->tv : &rtpe_now;
+	long long now = timeval_us(tv);
+
+	if (jb->ring_started && (jb->ssrc != ntohl(rtp->ssrc) || jb->ring_clock_rate != clock_rate)) {
+		ilog(LOG_DEBUG, "Jitter buffer restart due to SSRC or clock rate change");
+		jb_ring_drain(jb);
+	}
+
+	if (!jb->ring_started) {
+		// wait for the previous stream to be sent out completely
+		if (jb->ring_count)
+			return 1;
+		jb->ring_started = true;
+		jb->draining = false;
+		jb->ssrc = ntohl(rtp->ssrc);
+		jb->ring_clock_rate = clock_rate;
+		jb->next_seq = seq;
+		jb->last_seq = seq;
+		jb->base_ts = jb->last_ts = ts;
+		jb->ref_transit = jb->prev_transit = now;
+		jb->jitter = 0;
+		jb->delay = 0;
+		jb->interval = 0;
+	}
+
+	int seq_off = (int16_t) (seq - jb->next_seq);
+	long long ts_us = (long long) (int32_t) (ts - jb->base_ts) * 1000000LL / clock_rate;
+	long long transit = now - ts_us;
+
+	if (seq_off > (int) jb->slots_mask || seq_off < -(int) jb->slots_mask
+			|| transit - jb->ref_transit > 1000000)
+	{
+		ilog(LOG_DEBUG, "Jitter buffer restart due to seq (%u -> %u) or timestamp jump",
+				jb->next_seq, seq);
+		jb_ring_drain(jb);
+		return 1;
+	}
+	if (seq_off < 0)
+		return 1; // too late, send it on right away
+
+	struct jb_slot *slot = &jb->slots[seq & jb->slots_mask];
+	if (slot->used)
+		return 1; // duplicate
+
+	if (slot->size < s->len) {
+		char *buf = realloc(slot->buf, s->len);
+		if (!buf)
+			return 1;
+		slot->buf = buf;
+		slot->size = s->len;
+	}
+	memcpy(slot->buf, s->s, s->len);
+	slot->len = s->len;
+	slot->used = true;
+	slot->seq = seq;
+	slot->ts_us = ts_us;
+	slot->sfd = obj_get(mp->sfd);
+	slot->fsin = mp->fsin;
+	slot->tv = *tv;
+	jb->ring_count++;
+
+	// jitter estimate as per RFC 3550, and a low watermark for the transit time that slowly
+	// follows clock drift
+	long long d = transit - jb->prev_transit;
+	jb->prev_transit = transit;
+	jb->jitter += ((d < 0 ? -d : d) - jb->jitter) / 16;
+	if (transit < jb->ref_transit)
+		jb->ref_transit = transit;
+	else
+		jb->ref_transit += (transit - jb->ref_transit) >> 8;
+
+	if (seq == (uint16_t) (jb->last_seq + 1) && ts != jb->last_ts)
+		jb->interval = (long long) (uint32_t) (ts - jb->last_ts) * 1000000LL / clock_rate;
+	if ((int16_t) (seq - jb->last_seq) > 0) {
+		jb->last_seq = seq;
+		jb->last_ts = ts;
+	}
+
+	// grow the delay right away, but shrink it gradually, or at once at the start of a talkspurt
+	long long max_delay = (long long) rtpe_config.jb_length * (jb->interval ? : JB_DEFAULT_INTERVAL);
+	long long target = MIN(jb->jitter * JB_JITTER_MULT, max_delay);
+	if (target >= jb->delay || (rtp->m_pt & 0x80))
+		jb->delay = target;
+	else
+		jb->delay -= MIN(jb->delay - target, JB_DELAY_STEP);
+
+	return 0;
+}
+
+// jb is locked. returns the next slot to be played out if it's due, otherwise
+// sets *next_due to when it will be
+static struct jb_slot *jb_ring_next(struct jitter_buffer *jb, long long now, long long *next_due) {
+	if (!jb->ring_count)
+		return NULL;
+
+	// the head of the ring, or the first packet after a gap
+	struct jb_slot *slot = NULL;
+	for (unsigned int i = 0; i <= jb->slots_mask; i++) {
+		slot = &jb->slots[(jb->next_seq + i) & jb->slots_mask];
+		if (slot->used)
+			break;
+	}
+
+	if (jb->draining)
+		return slot;
+	long long due = slot->ts_us + jb->ref_transit + jb->delay;
+	if (due <= now + 1000) // not worth waiting for less than 1 ms
+		return slot;
+	*next_due = due;
+	return NULL;
+}
+
+static void jb_ring_release(struct jitter_buffer *jb) {
+	char buf[RTP_BUFFER_SIZE];
+
+	mutex_lock(&jb->lock);
+
+	// keep packets in order: only one thread sends at a time, and it picks up whatever
+	// becomes due in the meantime
+	if (jb->releasing)
+		goto out;
+	jb->releasing = true;
+
+	while (1) {
+		long long next_due = 0;
+		struct jb_slot *slot = jb_ring_next(jb, timeval_us(&rtpe_now), &next_due);
+		if (!slot) {
+			if (next_due && (!jb->armed.tv_sec || next_due < timeval_us(&jb->armed))) {
+				timeval_from_us(&jb->armed, next_due);
+				timerthread_obj_schedule_abs(&jb->ttq.tt_obj, &jb->armed);
+			}
+			break;
+		}
+
+		str s;
+		str_init_len(&s, buf + RTP_BUFFER_HEAD_ROOM, slot->len);
+		memcpy(s.s, slot->buf, slot->len);
+		struct stream_fd *sfd = slot->sfd;
+		endpoint_t fsin = slot->fsin;
+		struct timeval tv = slot->tv;
+
+		slot->sfd = NULL;
+		slot->used = false;
+		jb->next_seq = slot->seq + 1;
+		if (!--jb->ring_count)
+			jb->draining = false;
+
+		mutex_unlock(&jb->lock);
+
+		play_buffered_raw(sfd, &fsin, &tv, &s);
+		obj_put(sfd);
+
+		mutex_lock(&jb->lock);
+	}
+
+	jb->releasing = false;
+out:
+	mutex_unlock(&jb->lock);
+}
+
+static int buffer_packet_ring(struct media_packet *mp, const str *s) {
+	int ret = 1; // must call stream_packet
+	struct call *call = mp->call;
+
+	rwlock_lock_r(&call->master_lock);
+
+	struct jitter_buffer *jb = mp->stream->jb;
+	if (!jb || !PS_ISSET(mp->sfd->stream, RTP))
+		goto end;
+	if (PS_ISSET(mp->sfd->stream, RTCP) && rtcp_demux_is_rtcp(s))
+		goto end;
+
+	struct rtp_header *rtp;
+	if (rtp_payload(&rtp, NULL, s))
+		goto end;
+
+	mutex_lock(&jb->lock);
+	// updates jb->clock_rate and jb->payload_type
+	int clock_rate = get_clock_rate(mp, rtp->m_pt & 0x7f);
+	if (!clock_rate) {
+		mutex_unlock(&jb->lock);
+		goto end;
+	}
+	ret = jb_ring_store(jb, mp, s, rtp, clock_rate);
+	mutex_unlock(&jb->lock);
+
+	obj_hold(&jb->ttq.tt_obj);
+	rwlock_unlock_r(&call->master_lock);
+
+	jb_ring_release(jb);
+	obj_put(&jb->ttq.tt_obj);
+
+	return ret;
+
+end:
+	rwlock_unlock_r(&call->master_lock);
+	return ret;
+}
+
+static void jb_ring_run(void *p) {
+	struct jitter_buffer *jb = p;
+
+	mutex_lock(&jb->lock);
+	ZERO(jb->armed);
+	mutex_unlock(&jb->lock);
+
+	jb_ring_release(jb);
+}
+
+static void __jb_ring_free(void *p) {
+	struct jitter_buffer *jb = p;
+
+	ilog(LOG_DEBUG, "freeing jitter_buffer");
+
+	for (unsigned int i = 0; i <= jb->slots_mask; i++) {
+		if (jb->slots[i].sfd)
+			obj_put(jb->slots[i].sfd);
+		free(jb->slots[i].buf);
+	}
+	free(jb->slots);
+	mutex_destroy(&jb->lock);
+	if (jb->call)
+		obj_put(jb->call);
+}
+
+static struct jitter_buffer *jitter_buffer_ring_new(struct call *c) {
+	ilog(LOG_DEBUG, "creating jitter_buffer");
+
+	struct jitter_buffer *jb = obj_alloc0("jitter_buffer", sizeof(*jb), __jb_ring_free);
+	jb->ttq.tt_obj.tt = &jitter_buffer_thread;
+
+	// room for packets arriving early by up to the max depth
+	unsigned int num = JB_RING_MIN_SLOTS;
+	while (num < rtpe_config.jb_length * 2)
+		num <<= 1;
+	jb->slots = calloc(num, sizeof(*jb->slots));
+	jb->slots_mask = num - 1;
+
+	mutex_init(&jb->lock);
+	jb->call = obj_get(c);
+	return jb;
+}
+
+
 int buffer_packet(struct media_packet *mp, const str *s) {
 	struct jb_packet *p = NULL;
 	int ret = 1; // must call stream_packet
@@ -229,6 +501,9 @@ int buffer_packet(struct media_packet *mp, const str *s) {
 	mp->call = mp->sfd->call;
 	struct call *call = mp->call;
 
+	if (rtpe_config.jb_adaptive)
+		return buffer_packet_ring(mp, s);
+
 	rwlock_lock_r(&call->master_lock);
 
 	struct jitter_buffer *jb = mp->stream->jb;
@@ -415,6 +690,9 @@ void jitter_buffer_loop(void *p) {
 }
 
 struct jitter_buffer *jitter_buffer_new(struct call *c) {
+	if (rtpe_config.jb_adaptive)
+		return jitter_buffer_ring_new(c);
+
 	ilog(LOG_DEBUG, "creating jitter_buffer");
 
 	struct jitter_buffer *jb = timerthread_queue_new("jitter_buffer", sizeof(*jb),
@@ -92,6 +92,7 @@ struct rtpengine_config rtpe_config = {
 	.mqtt_port = 1883,
 	.mqtt_keepalive = 30,
 	.mqtt_publish_interval = 5000,
+	.mysql_cache_ttl = 300,
 	.common = {
 		.log_levels = {
 			[log_level_index_internals] = -1,
@@ -435,6 +436,7 @@ static void options(int *argc, char ***argv) {
 	AUTO_CLEANUP_GBUF(mqtt_publish_scope);
 #endif
 	AUTO_CLEANUP_GBUF(mos);
+	AUTO_CLEANUP_GBUF(redis_format);
 
 	rwlock_lock_w(&rtpe_config.config_lock);
 
@@ -463,6 +465,8 @@ static void options(int *argc, char ***argv) {
 		{ "redis",	'r', 0, G_OPTION_ARG_STRING,	&redisps,	"Connect to Redis database",	"[PW@]IP:PORT/INT"	},
 		{ "redis-write",'w', 0, G_OPTION_ARG_STRING,    &redisps_write, "Connect to Redis write database",      "[PW@]IP:PORT/INT"       },
 		{ "redis-num-threads", 0, 0, G_OPTION_ARG_INT, &rtpe_config.redis_num_threads, "Number of Redis restore threads",      "INT"       },
+		{ "redis-notify-batch", 0, 0, G_OPTION_ARG_INT, &rtpe_config.redis_notify_batch, "Collect redis keyspace notifications for this many ms and process them in batches", "MS" },
+		{ "redis-restore-batch", 0, 0, G_OPTION_ARG_INT, &rtpe_config.redis_restore_batch, "Restore calls from Redis using SCAN and MGET with this many keys per batch", "INT" },
 		{ "redis-expires", 0, 0, G_OPTION_ARG_INT, &rtpe_config.redis_expires_secs, "Expire time in seconds for redis keys",      "INT"       },
 		{ "no-redis-required", 'q', 0, G_OPTION_ARG_NONE, &rtpe_config.no_redis_required, "Start no matter of redis connection state", NULL },
 		{ "redis-allowed-errors", 0, 0, G_OPTION_ARG_INT, &rtpe_config.redis_allowed_errors, "Number of allowed errors before redis is temporarily disabled", "INT" },
@@ -471,6 +475,9 @@ static void options(int *argc, char ***argv) {
 		{ "redis-connect-timeout", 0, 0, G_OPTION_ARG_INT, &rtpe_config.redis_connect_timeout, "Sets a timeout in milliseconds for redis connections", "INT" },
 		{ "redis-delete-async", 'y', 0, G_OPTION_ARG_INT, &rtpe_config.redis_delete_async, "Enable asynchronous redis delete", NULL },
 		{ "redis-delete-async-interval", 'y', 0, G_OPTION_ARG_INT, &rtpe_config.redis_delete_async_interval, "Set asynchronous redis delete interval (seconds)", NULL },
+		{ "redis-update-async", 0, 0, G_OPTION_ARG_NONE, &rtpe_config.redis_update_async, "Write call state to redis from a separate thread", NULL },
+		{ "redis-delta-updates", 0, 0, G_OPTION_ARG_NONE, &rtpe_config.redis_delta_updates, "Store calls in redis as hashes and only write changed parts", NULL },
+		{ "redis-format", 0, 0, G_OPTION_ARG_STRING, &redis_format, "Encoding of call state written to redis", "json|binary" },
 		{ "active-switchover", 0,0,G_OPTION_ARG_NONE,	&rtpe_config.active_switchover, "Use call activity as indicator of active/standby state", NULL },
 		{ "b2b-url",	'b', 0, G_OPTION_ARG_STRING,	&rtpe_config.b2b_url,	"XMLRPC URL of B2B UA"	,	"STRING"	},
 		{ "log-facility-cdr",0,  0, G_OPTION_ARG_STRING, &log_facility_cdr_s, "Syslog facility to use for logging CDRs", "daemon|local0|...|local7"},
@@ -480,11 +487,17 @@ static void options(int *argc, char ***argv) {
 		{ "dtmf-log-dest", 0,0,	G_OPTION_ARG_STRING,	&dtmf_udp_ep,	"Destination address for DTMF logging via UDP",	"IP46|HOSTNAME:PORT"	},
 		{ "dtmf-log-ng-tcp", 0,0,	G_OPTION_ARG_NONE,	&rtpe_config.dtmf_via_ng,	"DTMF logging via TCP NG protocol",	NULL },
 		{ "dtmf-no-suppress", 0,0,G_OPTION_ARG_NONE,	&rtpe_config.dtmf_no_suppress,	"Disable audio suppression during DTMF events",	NULL },
+		{ "dtmf-spandsp", 0,0,	G_OPTION_ARG_NONE,	&rtpe_config.dtmf_spandsp,	"Use spandsp for in-band DTMF detection",	NULL },
 #endif
 		{ "log-format",	0, 0,	G_OPTION_ARG_STRING,	&log_format,	"Log prefix format",		"default|parsable"},
 		{ "xmlrpc-format",'x', 0, G_OPTION_ARG_INT,	&rtpe_config.fmt,	"XMLRPC timeout request format to use. 0: SEMS DI, 1: call-id only, 2: Kamailio",	"INT"	},
 		{ "num-threads",  0, 0, G_OPTION_ARG_INT,	&rtpe_config.num_threads,	"Number of worker threads to create",	"INT"	},
 		{ "media-num-threads",  0, 0, G_OPTION_ARG_INT,	&rtpe_config.media_num_threads,	"Number of worker threads for media playback",	"INT"	},
+#ifdef WITH_TRANSCODING
+		{ "transcode-num-threads", 0, 0, G_OPTION_ARG_INT, &rtpe_config.transcode_num_threads, "Number of dedicated transcoding threads", "INT" },
+		{ "t38-num-threads", 0, 0, G_OPTION_ARG_INT, &rtpe_config.t38_num_threads, "Number of dedicated T.38 gateway threads", "INT" },
+		{ "codec-pool", 0, 0, G_OPTION_ARG_INT, &rtpe_config.codec_pool, "Number of opened codec contexts to keep ready per codec configuration", "INT" },
+#endif
 		{ "delete-delay",  'd', 0, G_OPTION_ARG_INT,    &rtpe_config.delete_delay,  "Delay for deleting a session from memory.",    "INT"   },
 		{ "sip-source",  0,  0, G_OPTION_ARG_NONE,	&sip_source,	"Use SIP source address by default",	NULL	},
 		{ "dtls-passive", 0, 0, G_OPTION_ARG_NONE,	&dtls_passive_def,"Always prefer DTLS passive role",	NULL	},
@@ -512,9 +525,13 @@ static void options(int *argc, char ***argv) {
 		{ "mysql-user",	0,   0,	G_OPTION_ARG_STRING,	&rtpe_config.mysql_user,"MySQL connection credentials",		"USERNAME"	},
 		{ "mysql-pass",	0,   0,	G_OPTION_ARG_STRING,	&rtpe_config.mysql_pass,"MySQL connection credentials",		"PASSWORD"	},
 		{ "mysql-query",0,   0,	G_OPTION_ARG_STRING,	&rtpe_config.mysql_query,"MySQL select query",			"STRING"	},
+		{ "mysql-cache-size",0,0,G_OPTION_ARG_INT,	&rtpe_config.mysql_cache_size,"Memory for media fetched from MySQL in MB","INT"	},
+		{ "mysql-cache-ttl",0,	0,G_OPTION_ARG_INT,	&rtpe_config.mysql_cache_ttl,"Seconds to keep media fetched from MySQL cached","INT"	},
+		{ "player-cache-size",0,0,G_OPTION_ARG_INT,	&rtpe_config.player_cache_size,"Memory for pre-encoded media playback in MB","INT"	},
 		{ "endpoint-learning",0,0,G_OPTION_ARG_STRING,	&endpoint_learning,	"RTP endpoint learning algorithm",	"delayed|immediate|off|heuristic"	},
 		{ "jitter-buffer",0, 0,	G_OPTION_ARG_INT,	&rtpe_config.jb_length,	"Size of jitter buffer",		"INT" },
 		{ "jb-clock-drift",0,0,	G_OPTION_ARG_NONE,	&rtpe_config.jb_clock_drift,"Compensate for source clock drift",NULL },
+		{ "jb-adaptive",0,0,	G_OPTION_ARG_NONE,	&rtpe_config.jb_adaptive,"Use ring buffer jitter buffer with adaptive depth",NULL },
 		{ "debug-srtp",0,0,	G_OPTION_ARG_NONE,	&debug_srtp,		"Log raw encryption details for SRTP",	NULL },
 		{ "dtls-rsa-key-size",0, 0,	G_OPTION_ARG_INT,&rtpe_config.dtls_rsa_key_size,"Size of RSA key for DTLS",	"INT"		},
 		{ "dtls-mtu",0, 0,	G_OPTION_ARG_INT,&rtpe_config.dtls_mtu,"DTLS MTU",	"INT"		},
@@ -527,6 +544,9 @@ static void options(int *argc, char ***argv) {
 		{ "http-threads", 0,0,	G_OPTION_ARG_INT,	&rtpe_config.http_threads,"Number of worker threads for HTTP and WS","INT"},
 		{ "software-id", 0,0,	G_OPTION_ARG_STRING,	&rtpe_config.software_id,"Identification string of this software presented to external systems","STRING"},
 		{ "poller-per-thread", 0,0,	G_OPTION_ARG_NONE,	&rtpe_config.poller_per_thread,	"Use poller per thread",	NULL },
+		{ "reuse-sdp", 0,0,	G_OPTION_ARG_NONE,	&rtpe_config.reuse_sdp,	"Reuse rewritten SDP for repeated identical offers/answers",	NULL },
+		{ "socket-pool-high", 0,0, G_OPTION_ARG_INT,	&rtpe_config.socket_pool_high,	"Number of pre-bound RTP/RTCP port pairs to keep per interface","INT"},
+		{ "socket-pool-low", 0,0, G_OPTION_ARG_INT,	&rtpe_config.socket_pool_low,	"Refill the pre-bound port pool when it drops below this many pairs","INT"},
 #ifdef WITH_TRANSCODING
 		{ "dtx-delay",	0,0,	G_OPTION_ARG_INT,	&rtpe_config.dtx_delay,	"Delay in milliseconds to trigger DTX handling","INT"},
 		{ "max-dtx",	0,0,	G_OPTION_ARG_INT,	&rtpe_config.max_dtx,	"Maximum duration of DTX handling",	"INT"},
@@ -735,6 +755,13 @@ static void options(int *argc, char ***argv) {
 	rtpe_config.cpu_limit = max_cpu * 100;
 	rtpe_config.load_limit = max_load * 100;
 
+	if (rtpe_config.player_cache_size < 0)
+		die("Invalid --player-cache-size");
+	if (rtpe_config.mysql_cache_size < 0)
+		die("Invalid --mysql-cache-size");
+	if (rtpe_config.mysql_cache_ttl < 0)
+		die("Invalid --mysql-cache-ttl");
+
 	if (rtpe_config.mysql_query) {
 		// require exactly one %llu placeholder and allow no other % placeholders
 		if (!strstr(rtpe_config.mysql_query, "%llu"))
@@ -790,6 +817,24 @@ static void options(int *argc, char ***argv) {
 	if (rtpe_config.jb_length < 0)
 		die("Invalid negative jitter buffer size");
 
+	if (rtpe_config.redis_restore_batch < 0)
+		die("Invalid --redis-restore-batch (%i)", rtpe_config.redis_restore_batch);
+	if (rtpe_config.redis_notify_batch < 0)
+		die("Invalid --redis-notify-batch (%i)", rtpe_config.redis_notify_batch);
+	if (rtpe_config.transcode_num_threads < 0)
+		die("Invalid --transcode-num-threads (%i)", rtpe_config.transcode_num_threads);
+	if (rtpe_config.t38_num_threads < 0)
+		die("Invalid --t38-num-threads (%i)", rtpe_config.t38_num_threads);
+	if (rtpe_config.codec_pool < 0)
+		die("Invalid --codec-pool (%i)", rtpe_config.codec_pool);
+
+	if (rtpe_config.socket_pool_high < 0)
+		die("Invalid --socket-pool-high (%i)", rtpe_config.socket_pool_high);
+	if (rtpe_config.socket_pool_low < 0 || rtpe_config.socket_pool_low > rtpe_config.socket_pool_high)
+		die("Invalid --socket-pool-low (%i)", rtpe_config.socket_pool_low);
+	if (rtpe_config.socket_pool_high && !rtpe_config.socket_pool_low)
+		rtpe_config.socket_pool_low = (rtpe_config.socket_pool_high + 1) / 2;
+
 	if (silence_detect > 0) {
 		rtpe_config.silence_detect_double = silence_detect / 100.0;
 		rtpe_config.silence_detect_int = (int) ((silence_detect / 100.0) * UINT32_MAX);
@@ -830,6 +875,15 @@ static void options(int *argc, char ***argv) {
 		else
 			die("Invalid --mos option ('%s')", mos);
 	}
+	if (redis_format) {
+		if (!strcasecmp(redis_format, "json"))
+			rtpe_config.redis_format = REDIS_FORMAT_JSON;
+		else if (!strcasecmp(redis_format, "binary"))
+			rtpe_config.redis_format = REDIS_FORMAT_BINARY;
+		else
+			die("Invalid --redis-format option ('%s')", redis_format);
+	}
+
 
 	rwlock_unlock_w(&rtpe_config.config_lock);
 }
@@ -1013,6 +1067,7 @@ static void init_everything(void) {
 		abort();
 	statistics_init();
 	codeclib_init(0);
+	codeclib_pool_init(rtpe_config.codec_pool);
 	media_player_init();
 	dtmf_init();
 	jitter_buffer_init();
@@ -1196,6 +1251,12 @@ int main(int argc, char **argv) {
 
 	if (!is_addr_unspecified(&rtpe_config.redis_ep.address) && rtpe_redis_notify)
 		thread_create_detach(redis_notify_loop, NULL, "redis notify");
+	if (!is_addr_unspecified(&rtpe_config.redis_ep.address) && rtpe_redis_notify
+			&& rtpe_config.redis_notify_batch)
+		thread_create_detach(redis_notify_batch_loop, NULL, "redis notify batch");
+
+	if (rtpe_redis_write && rtpe_config.redis_update_async)
+		thread_create_detach(redis_write_loop, NULL, "redis write");
 
 	if (!is_addr_unspecified(&rtpe_config.graphite_ep.address))
 		thread_create_detach(graphite_loop, NULL, "graphite");
@@ -1207,6 +1268,10 @@ int main(int argc, char **argv) {
 
 	thread_create_detach(ice_thread_run, NULL, "ICE");
 
+	if (rtpe_config.socket_pool_high > 0)
+		thread_create_detach_prio(socket_pool_loop, NULL, rtpe_config.idle_scheduling,
+				rtpe_config.idle_priority, "socket pool");
+
 	websocket_start();
 
 	service_notify("READY=1\n");
@@ -1233,9 +1298,22 @@ int main(int argc, char **argv) {
 		if (rtpe_config.jb_length > 0)
 			thread_create_detach_prio(jitter_buffer_loop, NULL, rtpe_config.scheduling,
 					rtpe_config.priority, "jitter buffer");
+	}
+	// always at least one, as the codec timers also run RTCP generation and DTX
+	for (idx = 0; idx < MAX(1, rtpe_config.media_num_threads); ++idx)
 		thread_create_detach_prio(codec_timers_loop, NULL, rtpe_config.scheduling,
 				rtpe_config.priority, "codec timer");
-	}
+#ifdef WITH_TRANSCODING
+	codec_dtx_start();
+	for (idx = 0; idx < rtpe_config.transcode_num_threads; ++idx)
+		thread_create_detach_prio(codec_worker_loop, GUINT_TO_POINTER(idx), rtpe_config.scheduling,
+				rtpe_config.priority, "transcoding");
+	for (idx = 0; idx < rtpe_config.t38_num_threads; ++idx)
+		thread_create_detach_prio(t38_worker_loop, GUINT_TO_POINTER(idx), rtpe_config.scheduling,
+				rtpe_config.priority, "T.38");
+	if (rtpe_config.mysql_host && rtpe_config.mysql_query)
+		thread_create_detach(media_player_db_loop, NULL, "media DB");
+#endif
 
 
 	while (!rtpe_shutdown) {
@@ -1270,6 +1348,7 @@ int main(int argc, char **argv) {
 
 	unfill_initial_rtpe_cfg(&initial_rtpe_config);
 
+	t38_free();
 	call_free();
 
 	jitter_buffer_init_free();
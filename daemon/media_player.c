@@ -1,5 +1,6 @@
 #include "media_player.h"
 #include <glib.h>
+#include <sys/stat.h>
 #ifdef WITH_TRANSCODING
 #include <mysql.h>
 #include <mysql/errmsg.h>
@@ -24,10 +25,68 @@
 
 
 #ifdef WITH_TRANSCODING
+struct media_player_cache_packet {
+	size_t offset; // into entry->data
+	unsigned int len;
+	unsigned long ts; // relative to the first packet
+	long long us_dur;
+};
+
+struct media_player_cache_entry {
+	struct obj obj;
+	char *key;
+	bool complete;
+	GString *data; // all payloads back to back
+	GArray *packets;
+	unsigned long first_ts; // while recording
+	unsigned int clock_rate;
+	unsigned long duration_ts; // total, in RTP clock
+	unsigned long duration; // in milliseconds
+	size_t size;
+	GList *lru_link;
+};
+
+struct media_player_db_entry {
+	struct obj obj;
+	long long id;
+	str *blob;
+	time_t fetched;
+	GList *lru_link;
+};
+
+struct media_player_db_request {
+	struct media_player *mp;
+	unsigned int serial; // mp->db_serial at the time of the request
+	long long repeat;
+};
+
+struct media_player_db_job {
+	long long id;
+	GQueue requests;
+};
+
+
 static struct timerthread media_player_thread;
 static __thread MYSQL *mysql_conn;
+static str *__media_player_db_fetch(long long id);
+str *(*media_player_db_fetch)(long long id) = __media_player_db_fetch;
+
+static mutex_t media_player_cache_lock;
+static GHashTable *media_player_cache; // key -> entry, complete or being recorded
+static GQueue media_player_cache_lru = G_QUEUE_INIT; // complete entries, most recently used first
+static size_t media_player_cache_size;
+
+static mutex_t media_player_db_lock;
+static cond_t media_player_db_cond;
+static GQueue media_player_db_queue = G_QUEUE_INIT; // jobs waiting for the DB thread
+static GHashTable *media_player_db_jobs; // ID -> job, pending or being fetched
+static GHashTable *media_player_db_cache; // ID -> entry
+static GQueue media_player_db_lru = G_QUEUE_INIT; // most recently used first
+static size_t media_player_db_size;
 
 static void media_player_read_packet(struct media_player *mp);
+static void media_player_read_cached(struct media_player *mp);
+static void media_player_cache_abort(struct media_player *mp);
 #endif
 
 static struct timerthread send_timer_thread;
@@ -77,6 +136,14 @@ static void media_player_shutdown(struct media_player *mp) {
 		free(mp->blob);
 	mp->blob = NULL;
 	mp->read_pos = STR_NULL;
+
+	media_player_cache_abort(mp);
+	if (mp->cache_entry)
+		obj_put(mp->cache_entry);
+	mp->cache_entry = NULL;
+
+	// invalidates pending database requests
+	mp->db_serial++;
 }
 #endif
 
@@ -263,30 +330,36 @@ void send_timer_push(struct send_timer *st, struct codec_packet *cp) {
 
 
 
-int media_player_setup(struct media_player *mp, const struct rtp_payload_type *src_pt) {
-	// find suitable output payload type
-	struct rtp_payload_type *dst_pt;
+// find suitable output payload type
+static struct rtp_payload_type *media_player_output_pt(struct media_player *mp) {
 	for (GList *l = mp->media->codecs.codec_prefs.head; l; l = l->next) {
-		dst_pt = l->data;
+		struct rtp_payload_type *dst_pt = l->data;
 		ensure_codec_def(dst_pt, mp->media);
-		if (dst_pt->codec_def && !dst_pt->codec_def->supplemental)
-			goto found;
+		if (dst_pt->codec_def && !dst_pt->codec_def->supplemental) {
+			ilog(LOG_DEBUG, "Output codec for media playback is " STR_FORMAT,
+					STR_FMT(&dst_pt->encoding_with_params));
+			return dst_pt;
+		}
 	}
-	dst_pt = NULL;
-found:
-	if (!dst_pt) {
-		ilog(LOG_ERR, "No supported output codec found in SDP");
+	ilog(LOG_ERR, "No supported output codec found in SDP");
+	return NULL;
+}
+
+// if we played anything before, scale our sync TS according to the time
+// that has passed
+static void media_player_sync_ts(struct media_player *mp, const struct rtp_payload_type *dst_pt) {
+	if (!mp->sync_ts_tv.tv_sec)
+		return;
+	long long ts_diff_us = timeval_diff(&rtpe_now, &mp->sync_ts_tv);
+	mp->sync_ts += ts_diff_us * dst_pt->clock_rate / 1000000 / dst_pt->codec_def->clockrate_mult;
+}
+
+int media_player_setup(struct media_player *mp, const struct rtp_payload_type *src_pt) {
+	struct rtp_payload_type *dst_pt = media_player_output_pt(mp);
+	if (!dst_pt)
 		return -1;
-	}
-	ilog(LOG_DEBUG, "Output codec for media playback is " STR_FORMAT,
-			STR_FMT(&dst_pt->encoding_with_params));
 
-	// if we played anything before, scale our sync TS according to the time
-	// that has passed
-	if (mp->sync_ts_tv.tv_sec) {
-		long long ts_diff_us = timeval_diff(&rtpe_now, &mp->sync_ts_tv);
-		mp->sync_ts += ts_diff_us * dst_pt->clock_rate / 1000000 / dst_pt->codec_def->clockrate_mult;
-	}
+	media_player_sync_ts(mp, dst_pt);
 
 	// if we already have a handler, see if anything needs changing
 	if (mp->handler) {
@@ -338,6 +411,185 @@ static int __ensure_codec_handler(struct media_player *mp, AVStream *avs) {
 }
 
 
+static void __media_player_cache_entry_free(void *p) {
+	struct media_player_cache_entry *entry = p;
+	g_free(entry->key);
+	g_string_free(entry->data, TRUE);
+	g_array_free(entry->packets, TRUE);
+}
+
+static char *media_player_cache_key(const char *source, const struct rtp_payload_type *dst_pt) {
+	return g_strdup_printf("%s|" STR_FORMAT "|%u|%i|%i|" STR_FORMAT "|" STR_FORMAT, source,
+			STR_FMT(&dst_pt->encoding_with_params), dst_pt->clock_rate, dst_pt->ptime,
+			dst_pt->bitrate, STR_FMT(&dst_pt->format_parameters), STR_FMT(&dst_pt->codec_opts));
+}
+
+// Starts playback from the cache if the media has already been encoded for the output codec.
+// Otherwise, unless somebody else is already doing it, sets us up to record what we encode.
+// Returns 0 if playback was started from the cache.
+// call->master_lock held in W
+static int media_player_play_cached(struct media_player *mp, const char *source, long long repeat) {
+	if (!rtpe_config.player_cache_size || !source)
+		return -1;
+
+	struct rtp_payload_type *dst_pt = media_player_output_pt(mp);
+	if (!dst_pt)
+		return -1;
+	char *key = media_player_cache_key(source, dst_pt);
+
+	mutex_lock(&media_player_cache_lock);
+
+	struct media_player_cache_entry *entry = g_hash_table_lookup(media_player_cache, key);
+	if (!entry) {
+		entry = obj_alloc0("media_player_cache_entry", sizeof(*entry), __media_player_cache_entry_free);
+		entry->key = key;
+		key = NULL;
+		entry->data = g_string_new("");
+		entry->packets = g_array_new(FALSE, FALSE, sizeof(struct media_player_cache_packet));
+		entry->clock_rate = dst_pt->clock_rate;
+		g_hash_table_insert(media_player_cache, entry->key, entry); // takes the reference
+		mp->cache_build = obj_get(entry);
+		entry = NULL;
+	}
+	else if (!entry->complete)
+		entry = NULL; // being recorded by another player
+	else {
+		g_queue_unlink(&media_player_cache_lru, entry->lru_link);
+		g_queue_push_head_link(&media_player_cache_lru, entry->lru_link);
+		obj_hold(entry);
+	}
+
+	mutex_unlock(&media_player_cache_lock);
+	g_free(key);
+
+	if (!entry)
+		return -1;
+
+	ilog(LOG_DEBUG, "Playing %u pre-encoded packets from media cache", entry->packets->len);
+
+	media_player_sync_ts(mp, dst_pt);
+	codec_handler_free(&mp->handler);
+	mp->handler = codec_handler_make_playback_cached(dst_pt, mp->sync_ts, mp->media);
+	mp->cache_entry = entry;
+	mp->cache_pos = 0;
+	mp->cache_ts = 0;
+	mp->duration = entry->duration;
+	mp->repeat = repeat;
+	mp->run_func = media_player_read_cached;
+
+	mp->next_run = rtpe_now;
+	timeval_add_usec(&mp->next_run, -50000);
+	media_player_read_cached(mp);
+
+	return 0;
+}
+
+// appropriate lock must be held
+static void media_player_cache_add(struct media_player *mp, struct media_packet *packet) {
+	struct media_player_cache_entry *entry = mp->cache_build;
+
+	for (GList *l = packet->packets_out.head; l; l = l->next) {
+		struct codec_packet *p = l->data;
+		if (!p->rtp || p->s.len < sizeof(struct rtp_header))
+			continue;
+		if ((p->rtp->m_pt & 0x7f) != mp->handler->dest_pt.payload_type) {
+			// DTMF or CN, can't be replayed as is
+			ilog(LOG_DEBUG, "Not caching media playback with mixed payload types");
+			media_player_cache_abort(mp);
+			return;
+		}
+
+		unsigned long ts = ntohl(p->rtp->timestamp);
+		if (!entry->packets->len)
+			entry->first_ts = ts;
+
+		struct media_player_cache_packet cp = {
+			.offset = entry->data->len,
+			.len = p->s.len - sizeof(struct rtp_header),
+			.ts = (uint32_t) (ts - entry->first_ts),
+		};
+		g_string_append_len(entry->data, p->s.s + sizeof(struct rtp_header), cp.len);
+		g_array_append_val(entry->packets, cp);
+	}
+
+	// would be evicted straight away once finished, so don't keep buffering it
+	if (entry->data->len > (size_t) rtpe_config.player_cache_size * 1024 * 1024) {
+		ilog(LOG_DEBUG, "Not caching media playback larger than the media cache");
+		media_player_cache_abort(mp);
+	}
+}
+
+// recording reached the end of the media: make the entry available to others
+// appropriate lock must be held
+static void media_player_cache_finish(struct media_player *mp) {
+	struct media_player_cache_entry *entry = mp->cache_build;
+	if (!entry)
+		return;
+	if (!entry->packets->len) {
+		media_player_cache_abort(mp);
+		return;
+	}
+	mp->cache_build = NULL;
+
+	// packet durations from the timestamp differences. the last one repeats the one before
+	unsigned int num = entry->packets->len;
+	for (unsigned int i = 0; i < num; i++) {
+		struct media_player_cache_packet *cp = &g_array_index(entry->packets,
+				struct media_player_cache_packet, i);
+		unsigned long dur_ts;
+		if (i + 1 < num)
+			dur_ts = cp[1].ts - cp->ts;
+		else if (num > 1)
+			dur_ts = cp->ts - cp[-1].ts;
+		else
+			dur_ts = entry->clock_rate / 50; // 20 ms
+		cp->us_dur = dur_ts * 1000000LL / entry->clock_rate;
+		entry->duration_ts = cp->ts + dur_ts;
+	}
+	entry->duration = entry->duration_ts * 1000LL / entry->clock_rate;
+	entry->size = sizeof(*entry) + strlen(entry->key) + entry->data->len
+		+ num * sizeof(struct media_player_cache_packet);
+
+	size_t limit = (size_t) rtpe_config.player_cache_size * 1024 * 1024;
+
+	mutex_lock(&media_player_cache_lock);
+
+	entry->complete = true;
+	g_queue_push_head(&media_player_cache_lru, entry);
+	entry->lru_link = media_player_cache_lru.head;
+	media_player_cache_size += entry->size;
+
+	while (media_player_cache_size > limit) {
+		struct media_player_cache_entry *old = g_queue_pop_tail(&media_player_cache_lru);
+		ilog(LOG_DEBUG, "Evicting %zu bytes of pre-encoded media from cache", old->size);
+		media_player_cache_size -= old->size;
+		g_hash_table_remove(media_player_cache, old->key);
+		obj_put(old);
+	}
+
+	mutex_unlock(&media_player_cache_lock);
+
+	ilog(LOG_DEBUG, "Stored %u pre-encoded packets (%zu bytes) in media cache", num, entry->size);
+
+	obj_put(entry);
+}
+
+// appropriate lock must be held
+static void media_player_cache_abort(struct media_player *mp) {
+	struct media_player_cache_entry *entry = mp->cache_build;
+	if (!entry)
+		return;
+	mp->cache_build = NULL;
+
+	mutex_lock(&media_player_cache_lock);
+	g_hash_table_remove(media_player_cache, entry->key);
+	mutex_unlock(&media_player_cache_lock);
+
+	obj_put(entry); // the table's reference
+	obj_put(entry);
+}
+
+
 // appropriate lock must be held
 void media_player_add_packet(struct media_player *mp, char *buf, size_t len,
 		long long us_dur, unsigned long long pts)
@@ -361,6 +613,9 @@ void media_player_add_packet(struct media_player *mp, char *buf, size_t len,
 
 	mp->handler->func(mp->handler, &packet);
 
+	if (mp->cache_build)
+		media_player_cache_add(mp, &packet);
+
 	// as this is timing sensitive and we may have spent some time decoding,
 	// update our global "now" timestamp
 	gettimeofday(&rtpe_now, NULL);
@@ -395,6 +650,7 @@ static void media_player_read_packet(struct media_player *mp) {
 	int ret = av_read_frame(mp->fmtctx, mp->pkt);
 	if (ret < 0) {
 		if (ret == AVERROR_EOF) {
+			media_player_cache_finish(mp);
 			if (mp->repeat > 1){
 				ilog(LOG_DEBUG, "EOF reading from media stream but will repeat %li time",mp->repeat);
 				mp->repeat = mp->repeat - 1;
@@ -458,6 +714,32 @@ out:
 }
 
 
+// appropriate lock must be held
+static void media_player_read_cached(struct media_player *mp) {
+	struct media_player_cache_entry *entry = mp->cache_entry;
+	if (!entry)
+		return;
+
+	if (mp->cache_pos >= entry->packets->len) {
+		if (mp->repeat <= 1) {
+			ilog(LOG_DEBUG, "EOF reading from media cache");
+			return;
+		}
+		ilog(LOG_DEBUG, "EOF reading from media cache but will repeat %li time", mp->repeat);
+		mp->repeat--;
+		mp->cache_pos = 0;
+		mp->cache_ts += entry->duration_ts;
+	}
+
+	struct media_player_cache_packet *cp = &g_array_index(entry->packets,
+			struct media_player_cache_packet, mp->cache_pos);
+	mp->cache_pos++;
+
+	media_player_add_packet(mp, entry->data->str + cp->offset, cp->len, cp->us_dur,
+			mp->cache_ts + cp->ts);
+}
+
+
 // call->master_lock held in W
 void media_player_set_media(struct media_player *mp, struct call_media *media) {
 	mp->media = media;
@@ -501,6 +783,7 @@ static void media_player_play_start(struct media_player *mp, long long repeat) {
 	// needed to have usable duration for some formats. ignore errors.
 	avformat_find_stream_info(mp->fmtctx, NULL);
 
+	mp->run_func = media_player_read_packet;
 	mp->next_run = rtpe_now;
 	// give ourselves a bit of a head start with decoding
 	timeval_add_usec(&mp->next_run, -50000);
@@ -520,9 +803,19 @@ int media_player_play_file(struct media_player *mp, const str *file, long long r
 	char file_s[PATH_MAX];
 	snprintf(file_s, sizeof(file_s), STR_FORMAT, STR_FMT(file));
 
+	// changes to the file result in a different cache entry
+	AUTO_CLEANUP_GBUF(source);
+	struct stat sb;
+	if (!stat(file_s, &sb))
+		source = g_strdup_printf("file:%s:%lli:%lli", file_s, (long long) sb.st_mtime,
+				(long long) sb.st_size);
+	if (!media_player_play_cached(mp, source, repeat))
+		return 0;
+
 	int ret = avformat_open_input(&mp->fmtctx, file_s, NULL, NULL);
 	if (ret < 0) {
 		ilog(LOG_ERR, "Failed to open media file for playback: %s", av_error(ret));
+		media_player_cache_abort(mp);
 		return -1;
 	}
 
@@ -592,6 +885,15 @@ int media_player_play_blob(struct media_player *mp, const str *blob, long long r
 	if (media_player_play_init(mp))
 		return -1;
 
+	if (rtpe_config.player_cache_size) {
+		AUTO_CLEANUP_GBUF(sum);
+		sum = g_compute_checksum_for_data(G_CHECKSUM_SHA256, (const guchar *) blob->s, blob->len);
+		AUTO_CLEANUP_GBUF(source);
+		source = g_strdup_printf("blob:%s", sum);
+		if (!media_player_play_cached(mp, source, repeat))
+			return 0;
+	}
+
 	mp->blob = str_dup(blob);
 	err = "out of memory";
 	if (!mp->blob)
@@ -627,6 +929,7 @@ int media_player_play_blob(struct media_player *mp, const str *blob, long long r
 	return 0;
 
 err:
+	media_player_cache_abort(mp);
 	ilog(LOG_ERR, "Failed to start media playback from memory: %s", err);
 	if (av_ret)
 		ilog(LOG_ERR, "Error returned from libav: %s", av_error(av_ret));
@@ -658,15 +961,11 @@ err:
 }
 
 
-// call->master_lock held in W
-int media_player_play_db(struct media_player *mp, long long id, long long repeat) {
+// returns a newly allocated blob or NULL, to be called from the DB thread only
+static str *__media_player_db_fetch(long long id) {
 	const char *err;
 	AUTO_CLEANUP_GBUF(query);
 
-	err = "missing configuration";
-	if (!rtpe_config.mysql_host || !rtpe_config.mysql_query)
-		goto err;
-
 	query = g_strdup_printf(rtpe_config.mysql_query, (unsigned long long) id);
 	size_t len = strlen(query);
 
@@ -706,18 +1005,230 @@ success:;
 
 	str blob;
 	str_init_len(&blob, row[0], lengths[0]);
-	int ret = media_player_play_blob(mp, &blob, repeat);
+	str *ret = str_dup(&blob);
 
 	mysql_free_result(res);
 
 	return ret;
 
 err:
-	if (query)
-		ilog(LOG_ERR, "Failed to start media playback from database (used query '%s'): %s", query, err);
-	else
-		ilog(LOG_ERR, "Failed to start media playback from database: %s", err);
-	return -1;
+	ilog(LOG_ERR, "Failed to fetch media from database (used query '%s'): %s", query, err);
+	return NULL;
+}
+
+
+static void __media_player_db_entry_free(void *p) {
+	struct media_player_db_entry *entry = p;
+	free(entry->blob);
+}
+
+// media_player_db_lock must be held
+static void media_player_db_cache_remove(struct media_player_db_entry *entry) {
+	g_hash_table_remove(media_player_db_cache, &entry->id);
+	g_queue_delete_link(&media_player_db_lru, entry->lru_link);
+	media_player_db_size -= entry->blob->len;
+	obj_put(entry);
+}
+
+// returns a new reference or NULL
+static struct media_player_db_entry *media_player_db_cache_get(long long id) {
+	if (!rtpe_config.mysql_cache_size)
+		return NULL;
+
+	mutex_lock(&media_player_db_lock);
+
+	struct media_player_db_entry *entry = g_hash_table_lookup(media_player_db_cache, &id);
+	if (!entry)
+		goto out;
+	if (rtpe_config.mysql_cache_ttl && rtpe_now.tv_sec - entry->fetched >= rtpe_config.mysql_cache_ttl) {
+		ilog(LOG_DEBUG, "Cached database media ID %lli has expired", id);
+		media_player_db_cache_remove(entry);
+		entry = NULL;
+		goto out;
+	}
+
+	g_queue_unlink(&media_player_db_lru, entry->lru_link);
+	g_queue_push_head_link(&media_player_db_lru, entry->lru_link);
+	obj_hold(entry);
+
+out:
+	mutex_unlock(&media_player_db_lock);
+	return entry;
+}
+
+// takes over the blob, returns a new reference
+static struct media_player_db_entry *media_player_db_cache_put(long long id, str *blob) {
+	struct media_player_db_entry *entry = obj_alloc0("media_player_db_entry", sizeof(*entry),
+			__media_player_db_entry_free);
+	entry->id = id;
+	entry->blob = blob;
+	entry->fetched = rtpe_now.tv_sec;
+
+	size_t limit = (size_t) rtpe_config.mysql_cache_size * 1024 * 1024;
+	if (blob->len > limit)
+		return entry;
+
+	mutex_lock(&media_player_db_lock);
+
+	struct media_player_db_entry *old = g_hash_table_lookup(media_player_db_cache, &id);
+	if (old)
+		media_player_db_cache_remove(old);
+
+	while (media_player_db_size + blob->len > limit) {
+		struct media_player_db_entry *lru = g_queue_peek_tail(&media_player_db_lru);
+		ilog(LOG_DEBUG, "Evicting database media ID %lli from cache", lru->id);
+		media_player_db_cache_remove(lru);
+	}
+
+	g_hash_table_insert(media_player_db_cache, &entry->id, obj_get(entry));
+	g_queue_push_head(&media_player_db_lru, entry);
+	entry->lru_link = media_player_db_lru.head;
+	media_player_db_size += blob->len;
+
+	mutex_unlock(&media_player_db_lock);
+
+	return entry;
+}
+
+
+// call->master_lock held in W
+int media_player_play_db(struct media_player *mp, long long id, long long repeat) {
+	if (!rtpe_config.mysql_host || !rtpe_config.mysql_query) {
+		ilog(LOG_ERR, "Failed to start media playback from database: missing configuration");
+		return -1;
+	}
+
+	struct media_player_db_entry *entry = media_player_db_cache_get(id);
+	if (entry) {
+		ilog(LOG_DEBUG, "Playing database media ID %lli from cache", id);
+		int ret = media_player_play_blob(mp, entry->blob, repeat);
+		obj_put(entry);
+		return ret;
+	}
+
+	// stop whatever is playing now. this also invalidates any previous pending requests
+	media_player_shutdown(mp);
+	mp->duration = 0;
+
+	struct media_player_db_request *req = g_slice_alloc0(sizeof(*req));
+	req->mp = media_player_get(mp);
+	req->serial = mp->db_serial;
+	req->repeat = repeat;
+
+	mutex_lock(&media_player_db_lock);
+
+	// coalesce with a fetch already pending or in progress for the same ID
+	struct media_player_db_job *job = g_hash_table_lookup(media_player_db_jobs, &id);
+	if (!job) {
+		job = g_slice_alloc0(sizeof(*job));
+		job->id = id;
+		g_hash_table_insert(media_player_db_jobs, &job->id, job);
+		g_queue_push_tail(&media_player_db_queue, job);
+		cond_signal(&media_player_db_cond);
+	}
+	g_queue_push_tail(&job->requests, req);
+
+	mutex_unlock(&media_player_db_lock);
+
+	ilog(LOG_DEBUG, "Queued database fetch for media ID %lli", id);
+
+	return 0;
+}
+
+
+static void media_player_db_request_free(struct media_player_db_request *req) {
+	media_player_put(&req->mp);
+	g_slice_free1(sizeof(*req), req);
+}
+
+static void media_player_db_job_finish(struct media_player_db_job *job, struct media_player_db_entry *entry) {
+	struct media_player_db_request *req;
+
+	while ((req = g_queue_pop_head(&job->requests))) {
+		struct media_player *mp = req->mp;
+		struct call *call = mp->call;
+
+		log_info_call(call);
+		rwlock_lock_w(&call->master_lock);
+
+		// skip players that have since been stopped or given something else to play
+		if (mp->db_serial != req->serial)
+			ilog(LOG_DEBUG, "Discarding database media ID %lli for stopped player", job->id);
+		else if (!entry)
+			ilog(LOG_ERR, "Failed to start media playback from database ID %lli", job->id);
+		else
+			media_player_play_blob(mp, entry->blob, req->repeat);
+
+		rwlock_unlock_w(&call->master_lock);
+		log_info_clear();
+
+		media_player_db_request_free(req);
+	}
+
+	g_slice_free1(sizeof(*job), job);
+}
+
+// runs all queued database fetches in the calling thread, returns how many there were
+unsigned int media_player_db_run(void) {
+	struct media_player_db_job *job;
+	unsigned int num = 0;
+
+	mutex_lock(&media_player_db_lock);
+	while (!rtpe_shutdown && (job = g_queue_pop_head(&media_player_db_queue))) {
+		mutex_unlock(&media_player_db_lock);
+
+		str *blob = media_player_db_fetch(job->id);
+		gettimeofday(&rtpe_now, NULL);
+		struct media_player_db_entry *entry = NULL;
+		if (blob)
+			entry = media_player_db_cache_put(job->id, blob);
+
+		// requests arriving from here on either hit the cache or start a new fetch
+		mutex_lock(&media_player_db_lock);
+		g_hash_table_remove(media_player_db_jobs, &job->id);
+		mutex_unlock(&media_player_db_lock);
+
+		media_player_db_job_finish(job, entry);
+		if (entry)
+			obj_put(entry);
+		num++;
+
+		mutex_lock(&media_player_db_lock);
+	}
+	mutex_unlock(&media_player_db_lock);
+
+	return num;
+}
+
+void media_player_db_loop(void *p) {
+	struct thread_waker waker = { .lock = &media_player_db_lock, .cond = &media_player_db_cond };
+	thread_waker_add(&waker);
+
+	mutex_lock(&media_player_db_lock);
+	while (!rtpe_shutdown) {
+		if (!media_player_db_queue.length) {
+			cond_wait(&media_player_db_cond, &media_player_db_lock);
+			continue;
+		}
+		mutex_unlock(&media_player_db_lock);
+		media_player_db_run();
+		mutex_lock(&media_player_db_lock);
+	}
+
+	// drop whatever is left while the calls still exist
+	struct media_player_db_job *job;
+	while ((job = g_queue_pop_head(&media_player_db_queue))) {
+		g_hash_table_remove(media_player_db_jobs, &job->id);
+		g_queue_clear_full(&job->requests, (GDestroyNotify) media_player_db_request_free);
+		g_slice_free1(sizeof(*job), job);
+	}
+	mutex_unlock(&media_player_db_lock);
+
+	if (mysql_conn)
+		mysql_close(mysql_conn);
+	mysql_conn = NULL;
+
+	thread_waker_del(&waker);
 }
 
 
@@ -745,6 +1256,12 @@ static void media_player_run(void *ptr) {
 void media_player_init(void) {
 #ifdef WITH_TRANSCODING
 	timerthread_init(&media_player_thread, media_player_run);
+	mutex_init(&media_player_cache_lock);
+	media_player_cache = g_hash_table_new(g_str_hash, g_str_equal);
+	mutex_init(&media_player_db_lock);
+	cond_init(&media_player_db_cond);
+	media_player_db_jobs = g_hash_table_new(g_int64_hash, g_int64_equal);
+	media_player_db_cache = g_hash_table_new(g_int64_hash, g_int64_equal);
 #endif
 	timerthread_init(&send_timer_thread, timerthread_queue_run);
 }
@@ -752,6 +1269,20 @@ void media_player_init(void) {
 void media_player_free(void) {
 #ifdef WITH_TRANSCODING
 	timerthread_free(&media_player_thread);
+
+	// drop the references held by the table
+	struct media_player_cache_entry *entry;
+	while ((entry = g_queue_pop_head(&media_player_cache_lru)))
+		obj_put(entry);
+	g_hash_table_destroy(media_player_cache);
+	mutex_destroy(&media_player_cache_lock);
+
+	struct media_player_db_entry *db_entry;
+	while ((db_entry = g_queue_pop_head(&media_player_db_lru)))
+		obj_put(db_entry);
+	g_hash_table_destroy(media_player_db_cache);
+	g_hash_table_destroy(media_player_db_jobs);
+	mutex_destroy(&media_player_db_lock);
 #endif
 	timerthread_free(&send_timer_thread);
 }
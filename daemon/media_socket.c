@@ -384,6 +384,10 @@ static GHashTable *__intf_spec_addr_type_hash; // addr + type -> struct intf_spe
 static GHashTable *__local_intf_addr_type_hash; // addr + type -> GList of struct local_intf
 static GQueue __preferred_lists_for_family[__SF_LAST];
 
+static mutex_t socket_pool_lock = MUTEX_STATIC_INIT;
+static cond_t socket_pool_cond = COND_STATIC_INIT;
+static int socket_pool_refill;
+
 GQueue all_local_interfaces = G_QUEUE_INIT;
 
 
@@ -395,7 +399,12 @@ static int has_free_ports_loc(struct local_intf *loc, unsigned int num_ports) {
 		return 0;
 	}
 
-	if (num_ports > g_atomic_int_get(&loc->spec->port_pool.free_ports)) {
+	unsigned int avail = g_atomic_int_get(&loc->spec->port_pool.free_ports);
+	// prebound sockets are only handed out as RTP/RTCP pairs
+	if (num_ports == 2)
+		avail += g_atomic_int_get(&loc->spec->port_pool.prebound_ports);
+
+	if (num_ports > avail) {
 		ilog(LOG_ERR, "Didn't find %d ports available for " STR_FORMAT "/%s",
 			num_ports, STR_FMT(&loc->logical->name),
 			sockaddr_print_buf(&loc->spec->local_address.addr));
@@ -671,6 +680,7 @@ static void __interface_append(struct intf_config *ifa, sockfamily_t *fam) {
 		spec->port_pool.max = ifa->port_max;
 		spec->port_pool.free_ports = spec->port_pool.max - spec->port_pool.min + 1;
 		mutex_init(&spec->port_pool.free_list_lock);
+		mutex_init(&spec->port_pool.prebound_lock);
 		g_hash_table_insert(__intf_spec_addr_type_hash, &spec->local_address, spec);
 	}
 
@@ -821,9 +831,8 @@ static void free_port(socket_t *r, struct intf_spec *spec) {
 
 
 
-/* puts list of socket_t into "out" */
-int __get_consecutive_ports(GQueue *out, unsigned int num_ports, unsigned int wanted_start_port,
-		struct intf_spec *spec, const str *label)
+static int __open_consecutive_ports(GQueue *out, unsigned int num_ports, unsigned int wanted_start_port,
+		struct intf_spec *spec, const str *label, int log_flags)
 {
 	int i, cycle = 0;
 	socket_t *sk;
@@ -908,11 +917,121 @@ release_restart:
 	return 0;
 
 fail:
-	ilog(LOG_ERR, "Failed to get %u consecutive ports on interface %s for media relay (last error: %s)",
+	ilog(LOG_ERR | log_flags, "Failed to get %u consecutive ports on interface %s for media relay (last error: %s)",
 			num_ports, sockaddr_print_buf(&spec->local_address.addr), strerror(errno));
 	return -1;
 }
 
+static void __socket_pool_wake(void) {
+	mutex_lock(&socket_pool_lock);
+	socket_pool_refill = 1;
+	cond_signal(&socket_pool_cond);
+	mutex_unlock(&socket_pool_lock);
+}
+
+/* takes a pre-bound RTP/RTCP pair from the pool, if there is one */
+static int __get_prebound_ports(GQueue *out, struct intf_spec *spec) {
+	struct port_pool *pp = &spec->port_pool;
+	socket_t *rtp, *rtcp;
+	unsigned int pairs;
+
+	mutex_lock(&pp->prebound_lock);
+	rtp = g_queue_pop_head(&pp->prebound);
+	rtcp = g_queue_pop_head(&pp->prebound);
+	pairs = pp->prebound.length / 2;
+	mutex_unlock(&pp->prebound_lock);
+
+	if (pairs < rtpe_config.socket_pool_low
+			&& g_get_monotonic_time() >= atomic64_get(&pp->prebound_retry))
+		__socket_pool_wake();
+
+	if (!rtp)
+		return -1;
+
+	g_atomic_int_add(&pp->prebound_ports, -2);
+	g_queue_push_tail(out, rtp);
+	g_queue_push_tail(out, rtcp);
+
+	__C_DBG("Using pre-bound ports %u/%u on interface %s", rtp->local.port, rtcp->local.port,
+			sockaddr_print_buf(&spec->local_address.addr));
+	return 0;
+}
+
+/* puts list of socket_t into "out" */
+int __get_consecutive_ports(GQueue *out, unsigned int num_ports, unsigned int wanted_start_port,
+		struct intf_spec *spec, const str *label)
+{
+	if (num_ports == 2 && !wanted_start_port && rtpe_config.socket_pool_high > 0) {
+		if (!__get_prebound_ports(out, spec))
+			return 0;
+	}
+	return __open_consecutive_ports(out, num_ports, wanted_start_port, spec, label, 0);
+}
+
+#define SOCKET_POOL_BACKOFF_MIN 1000000LL // us
+#define SOCKET_POOL_BACKOFF_MAX 60000000LL
+
+/* tops up the pool of one interface to the high watermark */
+static void __socket_pool_fill(struct intf_spec *spec) {
+	struct port_pool *pp = &spec->port_pool;
+	GQueue q = G_QUEUE_INIT;
+
+	gint64 now = g_get_monotonic_time();
+	if (now < atomic64_get(&pp->prebound_retry))
+		return;
+
+	char buf[80];
+	snprintf(buf, sizeof(buf), "rtpengine socket pool %s", sockaddr_print_buf(&spec->local_address.addr));
+	str label;
+	str_init(&label, buf);
+
+	while (!rtpe_shutdown) {
+		mutex_lock(&pp->prebound_lock);
+		unsigned int pairs = pp->prebound.length / 2;
+		mutex_unlock(&pp->prebound_lock);
+
+		if (pairs >= rtpe_config.socket_pool_high)
+			break;
+		if (__open_consecutive_ports(&q, 2, 0, spec, &label, LOG_FLAG_LIMIT)) {
+			// don't retry on every pop while the interface is out of ports
+			pp->prebound_backoff = MIN(MAX(pp->prebound_backoff * 2, SOCKET_POOL_BACKOFF_MIN),
+					SOCKET_POOL_BACKOFF_MAX);
+			atomic64_set(&pp->prebound_retry, now + pp->prebound_backoff);
+			return;
+		}
+		pp->prebound_backoff = 0;
+
+		mutex_lock(&pp->prebound_lock);
+		g_queue_push_tail(&pp->prebound, g_queue_pop_head(&q));
+		g_queue_push_tail(&pp->prebound, g_queue_pop_head(&q));
+		mutex_unlock(&pp->prebound_lock);
+		g_atomic_int_add(&pp->prebound_ports, 2);
+	}
+}
+
+void socket_pool_loop(void *p) {
+	struct thread_waker waker = { .lock = &socket_pool_lock, .cond = &socket_pool_cond };
+	thread_waker_add(&waker);
+
+	mutex_lock(&socket_pool_lock);
+	while (!rtpe_shutdown) {
+		socket_pool_refill = 0;
+		mutex_unlock(&socket_pool_lock);
+
+		GList *ll = g_hash_table_get_values(__intf_spec_addr_type_hash);
+		for (GList *l = ll; l; l = l->next)
+			__socket_pool_fill(l->data);
+		g_list_free(ll);
+
+		mutex_lock(&socket_pool_lock);
+		while (!socket_pool_refill && !rtpe_shutdown)
+			cond_wait(&socket_pool_cond, &socket_pool_lock);
+	}
+	mutex_unlock(&socket_pool_lock);
+
+	thread_waker_del(&waker);
+}
+
 /* puts a list of "struct intf_list" into "out", containing socket_t list */
 int get_consecutive_ports(GQueue *out, unsigned int num_ports, struct call_media *media)
 {
@@ -2513,6 +2632,17 @@ void play_buffered(struct jb_packet *cp) {
 	jb_packet_free(&cp);
 }
 
+// s must have RTP_BUFFER_HEAD_ROOM and RTP_BUFFER_TAIL_ROOM available around it
+void play_buffered_raw(struct stream_fd *sfd, const endpoint_t *fsin, const struct timeval *tv, const str *s) {
+	struct packet_handler_ctx phc;
+	ZERO(phc);
+	phc.mp.sfd = sfd;
+	phc.mp.fsin = *fsin;
+	phc.mp.tv = *tv;
+	phc.s = *s;
+	stream_packet(&phc);
+}
+
 void interfaces_free(void) {
 	struct local_intf *ifc;
 	GList *ll;
@@ -2546,6 +2676,9 @@ void interfaces_free(void) {
 		struct intf_spec *spec = l->data;
 		struct port_pool *pp = &spec->port_pool;
 		g_queue_clear(&pp->free_list);
+		socket_t *sk;
+		while ((sk = g_queue_pop_head(&pp->prebound)))
+			free_port(sk, spec);
 		g_slice_free1(sizeof(*spec), spec);
 	}
 	g_list_free(ll);
@@ -76,9 +76,10 @@ static int redisCommandNR(redisContext *r, const char *fmt, ...)
 #define REDIS_FMT(x) (int) (x)->len, (x)->str
 
 static int redis_check_conn(struct redis *r);
-static void json_restore_call(struct redis *r, const str *id, int foreign);
+static int json_restore_call(struct redis *r, const str *id, int foreign);
 static int redis_connect(struct redis *r, int wait);
 static int json_build_ssrc(struct call_monologue *ml, JsonReader *root_reader);
+static void redis_bin_init(void);
 
 static void redis_pipe(struct redis *r, const char *fmt, ...) {
 	va_list ap;
@@ -92,6 +93,14 @@ static void redis_pipe(struct redis *r, const char *fmt, ...) {
 	va_end(ap);
 	r->pipeline++;
 }
+static void redis_pipe_argv(struct redis *r, int argc, const char **argv, const size_t *argvlen) {
+	if (!r->ctx) {
+		ilog(LOG_ERROR, "Unable to pipe redis command. No redis context");
+		return;
+	}
+	redisAppendCommandArgv(r->ctx, argc, argv, argvlen);
+	r->pipeline++;
+}
 static redisReply *redis_get(struct redis *r, int type, const char *fmt, ...) {
 	va_list ap;
 	redisReply *ret;
@@ -171,6 +180,39 @@ static void redis_consume(struct redis *r) {
 	}
 }
 
+/* called with r->lock held. consumes the next `num` pipelined replies and returns 0 if the
+ * last one was successful. for a MULTI/EXEC transaction that's the reply to EXEC, which is
+ * nil if the transaction was aborted and holds the outcome of each command otherwise */
+static int redis_consume_num(struct redis *r, unsigned int num) {
+	redisReply *rp;
+	int ret = -1;
+
+	if (!r->ctx) {
+		ilog(LOG_ERROR, "Unable to consume pipelined replies. No redis context");
+		r->pipeline = 0;
+		return -1;
+	}
+	while (num && r->pipeline) {
+		num--;
+		r->pipeline--;
+		if (redisGetReply(r->ctx, (void **) &rp) != REDIS_OK)
+			continue;
+		if (!num) {
+			ret = 0;
+			if (rp->type == REDIS_REPLY_ERROR || rp->type == REDIS_REPLY_NIL)
+				ret = -1;
+			else if (rp->type == REDIS_REPLY_ARRAY) {
+				for (size_t i = 0; i < rp->elements; i++) {
+					if (rp->element[i]->type == REDIS_REPLY_ERROR)
+						ret = -1;
+				}
+			}
+		}
+		freeReplyObject(rp);
+	}
+	return ret;
+}
+
 int redis_set_timeout(struct redis* r, int timeout) {
 	struct timeval tv_cmd;
 
@@ -310,6 +352,43 @@ err:
 }
 
 
+struct redis_notify_entry {
+	char *key; // "<db>:<call-id>"
+	str callid; // points into key
+	int db;
+	enum redis_write_op op;
+	redisReply *reply; // GET or HGETALL result, owned by the batch
+};
+
+static void redis_notify_entry_free(struct redis_notify_entry *e) {
+	g_free(e->key);
+	g_slice_free1(sizeof(*e), e);
+}
+
+// merges with a pending notification for the same call. the latest one wins
+static void redis_notify_queue(struct redis *r, int db, const str *callid, enum redis_write_op op) {
+	AUTO_CLEANUP_GBUF(key);
+	key = g_strdup_printf("%i:" STR_FORMAT, db, STR_FMT(callid));
+
+	mutex_lock(&r->notify_lock);
+	struct redis_notify_entry *e = g_hash_table_lookup(r->notify_calls, key);
+	if (!e) {
+		e = g_slice_alloc0(sizeof(*e));
+		e->key = key;
+		key = NULL;
+		str_init_len(&e->callid, strchr(e->key, ':') + 1, callid->len);
+		e->db = db;
+		g_hash_table_insert(r->notify_calls, e->key, e);
+		if (!r->notify_queue.length) {
+			gettimeofday(&r->notify_first, NULL);
+			cond_signal(&r->notify_cond);
+		}
+		g_queue_push_tail(&r->notify_queue, e);
+	}
+	e->op = op;
+	mutex_unlock(&r->notify_lock);
+}
+
 void on_redis_notification(redisAsyncContext *actx, void *reply, void *privdata) {
 	struct redis *r = 0;
 	struct call *c = NULL;
@@ -356,6 +435,14 @@ void on_redis_notification(redisAsyncContext *actx, void *reply, void *privdata)
 	// now at <key>
 	callid = keyspace_id;
 
+	if (rtpe_config.redis_notify_batch) {
+		if (strncmp(rr->element[3]->str,"set",3)==0 || strncmp(rr->element[3]->str,"hset",4)==0)
+			redis_notify_queue(r, r->db, &callid, REDIS_WRITE_UPDATE);
+		else if (strncmp(rr->element[3]->str,"del",3)==0)
+			redis_notify_queue(r, r->db, &callid, REDIS_WRITE_DELETE);
+		goto err;
+	}
+
 	if (redis_check_conn(r) == REDIS_STATE_DISCONNECTED)
 		goto err;
 
@@ -368,7 +455,7 @@ void on_redis_notification(redisAsyncContext *actx, void *reply, void *privdata)
 		goto err;
 	}
 
-	if (strncmp(rr->element[3]->str,"set",3)==0) {
+	if (strncmp(rr->element[3]->str,"set",3)==0 || strncmp(rr->element[3]->str,"hset",4)==0) {
 		c = call_get(&callid);
 		if (c) {
 			rwlock_unlock_w(&c->master_lock);
@@ -818,6 +905,13 @@ struct redis *redis_new(const endpoint_t *ep, int db, const char *auth,
 	r->restore_tick = 0;
 	r->consecutive_errors = 0;
 	mutex_init(&r->lock);
+	mutex_init(&r->write_lock);
+	redis_bin_init();
+	cond_init(&r->write_cond);
+	r->write_calls = g_hash_table_new(g_direct_hash, g_direct_equal);
+	mutex_init(&r->notify_lock);
+	cond_init(&r->notify_cond);
+	r->notify_calls = g_hash_table_new(g_str_hash, g_str_equal);
 
 	if (redis_connect(r, 10)) {
 		if (r->no_redis_required) {
@@ -835,7 +929,13 @@ struct redis *redis_new(const endpoint_t *ep, int db, const char *auth,
 	return r;
 
 err:
+	g_hash_table_destroy(r->write_calls);
+	g_hash_table_destroy(r->notify_calls);
 	mutex_destroy(&r->lock);
+	mutex_destroy(&r->write_lock);
+	cond_destroy(&r->write_cond);
+	mutex_destroy(&r->notify_lock);
+	cond_destroy(&r->notify_cond);
 	g_slice_free1(sizeof(*r), r);
 	return NULL;
 }
@@ -847,7 +947,17 @@ void redis_close(struct redis *r) {
 	if (r->ctx)
 		redisFree(r->ctx);
 	r->ctx = NULL;
+	struct call *c;
+	while ((c = g_queue_pop_head(&r->write_queue)))
+		obj_put(c);
+	g_hash_table_destroy(r->write_calls);
+	g_queue_clear_full(&r->notify_queue, (GDestroyNotify) redis_notify_entry_free);
+	g_hash_table_destroy(r->notify_calls);
 	mutex_destroy(&r->lock);
+	mutex_destroy(&r->write_lock);
+	cond_destroy(&r->write_cond);
+	mutex_destroy(&r->notify_lock);
+	cond_destroy(&r->notify_cond);
 	g_slice_free1(sizeof(*r), r);
 }
 
@@ -941,10 +1051,459 @@ static void redis_delete_async_call_json(struct call *c, struct redis *r) {
 	g_queue_push_tail(&r->async_queue, redis_command);
 }
 
-INLINE void json_builder_add_string_value_uri_enc(JsonBuilder *builder, const char* tmp, int len) {
+/*
+ * Call state is written either as JSON or in a compact binary form carrying the same
+ * document structure: objects and arrays of strings, with member names replaced by
+ * tags from the table below where possible. Binary data starts with a magic and a
+ * version byte, which is how it's told apart from JSON on restore.
+ */
+#define REDIS_BIN_MAGIC "RTPB"
+#define REDIS_BIN_VERSION 1
+#define REDIS_BIN_MAX_DEPTH 8
+
+enum redis_bin_op {
+	RB_OBJECT = 1,
+	RB_ARRAY,
+	RB_END,
+	RB_STRING,	// varint length + bytes
+	RB_KEY,		// varint length + bytes
+	RB_KEY_TAG,	// tag byte
+	RB_KEY_TAG_ID,	// tag byte + varint ID, for "<name>-<ID>"
+};
+
+// append only - the index is the tag on the wire
+static const char * const redis_bin_keys[] = {
+	"json", "created", "last_signal", "tos", "deleted", "num_sfds", "num_streams", "num_medias",
+	"num_tags", "num_maps", "ml_deleted", "created_from", "created_from_addr", "redis_hosted_db",
+	"recording_metadata", "block_dtmf", "block_media", "recording_meta_prefix",
+	"sfd", "pref_family", "localport", "logical_intf", "local_intf_uid", "stream",
+	"-crypto_suite", "-master_key", "-master_salt", "-unenc-srtp", "-unenc-srtcp", "-unauth-srtp",
+	"-mki", "media", "rtcp_sibling", "last_packet", "ps_flags", "component", "endpoint",
+	"advertised_endpoint", "stats-packets", "stats-bytes", "stats-errors", "stream_sfds",
+	"rtp_sinks", "rtcp_sinks", "tag", "via-branch", "label", "other_tags", "branches", "medias",
+	"ssrc_table", "ssrc", "in_srtp_index", "in_srtcp_index", "in_payload_type", "out_srtp_index",
+	"out_srtcp_index", "out_payload_type", "subscriptions-oa", "subscriptions-noa", "index",
+	"type", "format_str", "media_id", "protocol", "desired_family", "ptime", "media_flags",
+	"sdes_in_tag", "sdes_in-crypto_suite", "sdes_in-master_key", "sdes_in-master_salt",
+	"sdes_in-unenc-srtp", "sdes_in-unenc-srtcp", "sdes_in-unauth-srtp", "sdes_in-mki",
+	"sdes_out_tag", "sdes_out-crypto_suite", "sdes_out-master_key", "sdes_out-master_salt",
+	"sdes_out-unenc-srtp", "sdes_out-unenc-srtcp", "sdes_out-unauth-srtp", "sdes_out-mki",
+	"hash_func", "fingerprint", "streams", "maps", "payload_types", "map", "wildcard",
+	"num_ports", "intf_preferred_family", "map_sfds",
+};
+static GHashTable *redis_bin_key_tags; // name -> tag + 1
+
+// one top-level member of the call state, written as its own hash field with delta updates
+struct redis_field {
+	char *name;
+	char *data;
+	size_t len;
+};
+
+struct redis_builder {
+	JsonBuilder *json;
+	GString *bin;
+	unsigned int depth;
+
+	// full document
+	char *data;
+	size_t len;
+
+	// delta updates
+	GHashTable *old_fields; // as last written, referenced
+	GHashTable *fields; // field name -> fingerprint of the encoded value
+	GQueue changed; // struct redis_field
+	char *member;
+	uint64_t generation;
+};
+
+static void redis_bin_init(void) {
+	if (redis_bin_key_tags)
+		return;
+	redis_bin_key_tags = g_hash_table_new(g_str_hash, g_str_equal);
+	for (unsigned int i = 0; i < G_N_ELEMENTS(redis_bin_keys); i++)
+		g_hash_table_insert(redis_bin_key_tags, (void *) redis_bin_keys[i], GUINT_TO_POINTER(i + 1));
+}
+
+static void redis_bin_put_varint(GString *s, uint64_t u) {
+	while (u >= 0x80) {
+		g_string_append_c(s, (u & 0x7f) | 0x80);
+		u >>= 7;
+	}
+	g_string_append_c(s, u);
+}
+static void redis_bin_put_bytes(GString *s, const char *b, size_t len) {
+	redis_bin_put_varint(s, len);
+	g_string_append_len(s, b, len);
+}
+static unsigned int redis_bin_key_tag(const char *name, size_t len) {
+	char buf[64];
+	if (len >= sizeof(buf))
+		return 0;
+	memcpy(buf, name, len);
+	buf[len] = '\0';
+	return GPOINTER_TO_UINT(g_hash_table_lookup(redis_bin_key_tags, buf));
+}
+static void redis_bin_put_key(GString *s, const char *name) {
+	size_t len = strlen(name);
+	unsigned int tag;
+
+	const char *dash = strrchr(name, '-');
+	if (dash && dash[1] && strspn(dash + 1, "0123456789") == strlen(dash + 1)
+			&& (tag = redis_bin_key_tag(name, dash - name)))
+	{
+		g_string_append_c(s, RB_KEY_TAG_ID);
+		g_string_append_c(s, tag - 1);
+		redis_bin_put_varint(s, strtoull(dash + 1, NULL, 10));
+		return;
+	}
+	if ((tag = redis_bin_key_tag(name, len))) {
+		g_string_append_c(s, RB_KEY_TAG);
+		g_string_append_c(s, tag - 1);
+		return;
+	}
+	g_string_append_c(s, RB_KEY);
+	redis_bin_put_bytes(s, name, len);
+}
+
+static void redis_builder_start(struct redis_builder *b) {
+	if (rtpe_config.redis_format == REDIS_FORMAT_BINARY) {
+		b->bin = g_string_sized_new(b->fields ? 256 : 4096);
+		g_string_append(b->bin, REDIS_BIN_MAGIC);
+		g_string_append_c(b->bin, REDIS_BIN_VERSION);
+	}
+	else
+		b->json = json_builder_new();
+}
+// returns the encoding of what has been built so far, to be free()d
+static char *redis_builder_flush(struct redis_builder *b, size_t *len) {
+	if (b->bin) {
+		*len = b->bin->len;
+		char *ret = g_string_free(b->bin, FALSE);
+		b->bin = NULL;
+		return ret;
+	}
+
+	JsonGenerator *gen = json_generator_new ();
+	JsonNode * root = json_builder_get_root (b->json);
+	json_generator_set_root (gen, root);
+	char* result = json_generator_to_data (gen, len);
+
+	json_node_free (root);
+	g_object_unref (gen);
+	g_object_unref (b->json);
+	b->json = NULL;
+
+	return result;
+}
+static void redis_builder_end_member(struct redis_builder *b) {
+	struct redis_field *f = g_slice_alloc(sizeof(*f));
+	f->data = redis_builder_flush(b, &f->len);
+
+	uint64_t *fp = g_new(uint64_t, 1);
+	*fp = fnv1a_64(FNV1A_64_INIT, f->data, f->len);
+	uint64_t *old_fp = b->old_fields ? g_hash_table_lookup(b->old_fields, b->member) : NULL;
+	g_hash_table_insert(b->fields, g_strdup(b->member), fp);
+
+	if (old_fp && *old_fp == *fp) {
+		free(f->data);
+		g_slice_free1(sizeof(*f), f);
+		g_free(b->member);
+	}
+	else {
+		f->name = b->member;
+		g_queue_push_tail(&b->changed, f);
+	}
+	b->member = NULL;
+}
+
+static void redis_builder_init(struct redis_builder *b, struct call *c) {
+	ZERO(*b);
+	if (!rtpe_config.redis_delta_updates) {
+		redis_builder_start(b);
+		return;
+	}
+	b->fields = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+	// encoding only holds the master lock in R mode, and writer threads may overlap
+	mutex_lock(&c->redis_lock);
+	b->old_fields = c->redis_fields ? g_hash_table_ref(c->redis_fields) : NULL;
+	b->generation = ++c->redis_generation;
+	if (c->redis_writes++)
+		c->redis_overlap = 1;
+	mutex_unlock(&c->redis_lock);
+}
+static void redis_builder_set_member_name(struct redis_builder *b, const char *name) {
+	if (b->fields && b->depth == 1) {
+		b->member = g_strdup(name);
+		redis_builder_start(b);
+	}
+	else if (b->json)
+		json_builder_set_member_name(b->json, name);
+	else
+		redis_bin_put_key(b->bin, name);
+}
+static void redis_builder_begin_object(struct redis_builder *b) {
+	// with delta updates, the top-level object is the hash itself
+	if (!b->fields || b->depth > 0) {
+		if (b->json)
+			json_builder_begin_object(b->json);
+		else
+			g_string_append_c(b->bin, RB_OBJECT);
+	}
+	b->depth++;
+}
+static void redis_builder_begin_array(struct redis_builder *b) {
+	if (b->json)
+		json_builder_begin_array(b->json);
+	else
+		g_string_append_c(b->bin, RB_ARRAY);
+	b->depth++;
+}
+static void redis_builder_end_object(struct redis_builder *b) {
+	b->depth--;
+	if (b->fields && b->depth == 0)
+		return;
+	if (b->json)
+		json_builder_end_object(b->json);
+	else
+		g_string_append_c(b->bin, RB_END);
+	if (b->fields && b->depth == 1)
+		redis_builder_end_member(b);
+}
+static void redis_builder_end_array(struct redis_builder *b) {
+	b->depth--;
+	if (b->json)
+		json_builder_end_array(b->json);
+	else
+		g_string_append_c(b->bin, RB_END);
+	if (b->fields && b->depth == 1)
+		redis_builder_end_member(b);
+}
+static void redis_builder_add_string_value(struct redis_builder *b, const char *s) {
+	if (b->json)
+		json_builder_add_string_value(b->json, s);
+	else {
+		g_string_append_c(b->bin, RB_STRING);
+		redis_bin_put_bytes(b->bin, s, strlen(s));
+	}
+}
+static void redis_builder_finish(struct redis_builder *b) {
+	if (!b->fields)
+		b->data = redis_builder_flush(b, &b->len);
+}
+// delta updates: remembers what was written, or forgets everything if the write failed
+// or raced with another one, so that the next write replaces the whole hash
+static void redis_builder_commit(struct redis_builder *b, struct call *c, int ok) {
+	GHashTable *old;
+
+	if (!b->fields)
+		return;
+
+	mutex_lock(&c->redis_lock);
+	old = c->redis_fields;
+	c->redis_fields = NULL;
+	if (ok && !c->redis_overlap) {
+		c->redis_fields = b->fields;
+		b->fields = NULL;
+	}
+	if (!--c->redis_writes)
+		c->redis_overlap = 0;
+	mutex_unlock(&c->redis_lock);
+
+	if (old)
+		g_hash_table_unref(old);
+}
+static void redis_builder_free(struct redis_builder *b) {
+	struct redis_field *f;
+
+	free(b->data);
+	while ((f = g_queue_pop_head(&b->changed))) {
+		g_free(f->name);
+		free(f->data);
+		g_slice_free1(sizeof(*f), f);
+	}
+	if (b->fields)
+		g_hash_table_unref(b->fields);
+	if (b->old_fields)
+		g_hash_table_unref(b->old_fields);
+	g_free(b->member);
+}
+
+static int redis_bin_get_varint(const unsigned char **p, const unsigned char *end, uint64_t *out) {
+	uint64_t u = 0;
+	for (unsigned int shift = 0; shift < 64; shift += 7) {
+		if (*p >= end)
+			return -1;
+		unsigned char c = *(*p)++;
+		u |= (uint64_t) (c & 0x7f) << shift;
+		if (!(c & 0x80)) {
+			*out = u;
+			return 0;
+		}
+	}
+	return -1;
+}
+static char *redis_bin_get_bytes(const unsigned char **p, const unsigned char *end) {
+	uint64_t len;
+	if (redis_bin_get_varint(p, end, &len))
+		return NULL;
+	if (len > end - *p)
+		return NULL;
+	char *ret = g_strndup((const char *) *p, len);
+	*p += len;
+	return ret;
+}
+
+static int redis_is_binary(const char *s, size_t len) {
+	return len > strlen(REDIS_BIN_MAGIC) && !memcmp(s, REDIS_BIN_MAGIC, strlen(REDIS_BIN_MAGIC));
+}
+
+// turns the binary encoding into a JSON tree, so the same restore code can be used
+static JsonNode *redis_bin_decode(const char *s, size_t len, int any_root) {
+	const unsigned char *p = (const unsigned char *) s + strlen(REDIS_BIN_MAGIC);
+	const unsigned char *end = (const unsigned char *) s + len;
+	JsonBuilder *builder = json_builder_new();
+	JsonNode *root = NULL;
+	unsigned char stack[REDIS_BIN_MAX_DEPTH];
+	unsigned int depth = 0;
+	int have_key = 0;
+	uint64_t u;
+	char *v;
+
+	if (*p++ != REDIS_BIN_VERSION) {
+		rlog(LOG_ERR, "Unsupported binary call state version %u", p[-1]);
+		goto out;
+	}
+
+	do {
+		if (p >= end)
+			goto err;
+		unsigned char op = *p++;
+		int in_object = depth && stack[depth - 1] == RB_OBJECT;
+
+		switch (op) {
+			case RB_OBJECT:
+			case RB_ARRAY:
+				if ((in_object && !have_key) || depth >= REDIS_BIN_MAX_DEPTH)
+					goto err;
+				if (!depth && op != RB_OBJECT && !any_root)
+					goto err;
+				stack[depth++] = op;
+				have_key = 0;
+				if (op == RB_OBJECT)
+					json_builder_begin_object(builder);
+				else
+					json_builder_begin_array(builder);
+				break;
+			case RB_END:
+				if (!depth || have_key)
+					goto err;
+				if (stack[--depth] == RB_OBJECT)
+					json_builder_end_object(builder);
+				else
+					json_builder_end_array(builder);
+				break;
+			case RB_STRING:
+				if (!depth || (in_object && !have_key))
+					goto err;
+				if (!(v = redis_bin_get_bytes(&p, end)))
+					goto err;
+				json_builder_add_string_value(builder, v);
+				g_free(v);
+				have_key = 0;
+				break;
+			case RB_KEY:
+				if (!in_object || have_key)
+					goto err;
+				if (!(v = redis_bin_get_bytes(&p, end)))
+					goto err;
+				json_builder_set_member_name(builder, v);
+				g_free(v);
+				have_key = 1;
+				break;
+			case RB_KEY_TAG:
+			case RB_KEY_TAG_ID:
+				if (!in_object || have_key || p >= end)
+					goto err;
+				unsigned char tag = *p++;
+				if (tag >= G_N_ELEMENTS(redis_bin_keys))
+					goto err;
+				if (op == RB_KEY_TAG)
+					json_builder_set_member_name(builder, redis_bin_keys[tag]);
+				else {
+					if (redis_bin_get_varint(&p, end, &u))
+						goto err;
+					char key[64];
+					snprintf(key, sizeof(key), "%s-%" PRIu64, redis_bin_keys[tag], u);
+					json_builder_set_member_name(builder, key);
+				}
+				have_key = 1;
+				break;
+			default:
+				goto err;
+		}
+	} while (depth);
+
+	if (p != end)
+		goto err;
+
+	root = json_builder_get_root(builder);
+	goto out;
+
+err:
+	rlog(LOG_ERR, "Corrupt binary call state at offset %zu", (size_t) (p - (const unsigned char *) s));
+out:
+	g_object_unref(builder);
+	return root;
+}
+
+// delta updates: puts the fields of the call's hash back together into one document
+static JsonNode *redis_fields_decode(redisReply *rr) {
+	JsonObject *obj = json_object_new();
+
+	for (size_t i = 0; i + 1 < rr->elements; i += 2) {
+		redisReply *k = rr->element[i], *v = rr->element[i + 1];
+		JsonNode *node = NULL;
+
+		if (k->type != REDIS_REPLY_STRING || v->type != REDIS_REPLY_STRING)
+			goto err;
+
+		AUTO_CLEANUP_GBUF(name);
+		name = g_strndup(k->str, k->len);
+
+		if (!strcmp(name, "generation")) {
+			node = json_node_new(JSON_NODE_VALUE);
+			json_node_set_string(node, v->str);
+		}
+		else if (redis_is_binary(v->str, v->len))
+			node = redis_bin_decode(v->str, v->len, 1);
+		else {
+			JsonParser *parser = json_parser_new();
+			if (json_parser_load_from_data(parser, v->str, v->len, NULL))
+				node = json_node_copy(json_parser_get_root(parser));
+			g_object_unref(parser);
+		}
+		if (!node) {
+			rlog(LOG_ERR, "Failed to decode Redis hash field '%s'", name);
+			goto err;
+		}
+		json_object_set_member(obj, name, node);
+	}
+
+	JsonNode *root = json_node_new(JSON_NODE_OBJECT);
+	json_node_take_object(root, obj);
+	return root;
+
+err:
+	json_object_unref(obj);
+	return NULL;
+}
+
+INLINE void redis_builder_add_string_value_uri_enc(struct redis_builder *builder, const char* tmp, int len) {
 	char enc[len * 3 + 1];
 	str_uri_encode_len(enc, tmp, len);
-	json_builder_add_string_value(builder,enc);
+	redis_builder_add_string_value(builder,enc);
 }
 INLINE str *json_reader_get_string_value_uri_enc(JsonReader *root_reader) {
 	const char *s = json_reader_get_string_value(root_reader);
@@ -1794,8 +2353,8 @@ static int json_build_ssrc(struct call_monologue *ml, JsonReader *root_reader) {
 	return 0;
 }
 
-static void json_restore_call(struct redis *r, const str *callid, int foreign) {
-	redisReply* rr_jsonStr;
+// restores a call from its GET or HGETALL reply. returns 0 on success
+static int json_restore_call_reply(const str *callid, redisReply *rr_jsonStr, int foreign) {
 	struct redis_hash call;
 	struct redis_list tags, sfds, streams, medias, maps;
 	struct call *c = NULL;
@@ -1806,17 +2365,33 @@ static void json_restore_call(struct redis *r, const str *callid, int foreign) {
 	int i;
 	JsonReader *root_reader =0;
 	JsonParser *parser =0;
+	JsonNode *bin_root = NULL;
 
-	rr_jsonStr = redis_get(r, REDIS_REPLY_STRING, "GET " PB, STR(callid));
 	err = "could not retrieve JSON data from redis";
 	if (!rr_jsonStr)
 		goto err1;
 
-	parser = json_parser_new();
-	err = "could not parse JSON data";
-	if (!json_parser_load_from_data (parser, rr_jsonStr->str, -1, NULL))
-		goto err1;
-	root_reader = json_reader_new (json_parser_get_root (parser));
+	if (rr_jsonStr->type == REDIS_REPLY_ARRAY) {
+		err = "could not decode hash fields";
+		bin_root = redis_fields_decode(rr_jsonStr);
+		if (!bin_root)
+			goto err1;
+		root_reader = json_reader_new (bin_root);
+	}
+	else if (redis_is_binary(rr_jsonStr->str, rr_jsonStr->len)) {
+		err = "could not decode binary data";
+		bin_root = redis_bin_decode(rr_jsonStr->str, rr_jsonStr->len, 0);
+		if (!bin_root)
+			goto err1;
+		root_reader = json_reader_new (bin_root);
+	}
+	else {
+		parser = json_parser_new();
+		err = "could not parse JSON data";
+		if (!json_parser_load_from_data (parser, rr_jsonStr->str, -1, NULL))
+			goto err1;
+		root_reader = json_reader_new (json_parser_get_root (parser));
+	}
 	err = "could not read JSON data";
 	if (!root_reader)
 		goto err1;
@@ -1826,6 +2401,13 @@ static void json_restore_call(struct redis *r, const str *callid, int foreign) {
 	if (!c)
 		goto err1;
 
+	if (json_reader_read_member(root_reader, "generation")) {
+		const char *gen = json_reader_get_string_value(root_reader);
+		if (gen)
+			c->redis_generation = strtoull(gen, NULL, 10);
+	}
+	json_reader_end_member(root_reader);
+
 	err = "'call' data incomplete";
 	if (json_get_hash(&call, "json", -1, root_reader))
 		goto err2;
@@ -1943,8 +2525,8 @@ err1:
 		g_object_unref (root_reader);
 	if (parser)
 		g_object_unref (parser);
-	if (rr_jsonStr)
-		freeReplyObject(rr_jsonStr);	
+	if (bin_root)
+		json_node_free (bin_root);
 	log_info_clear();
 	if (err) {
 		rlog(LOG_WARNING, "Failed to restore call ID '" STR_FORMAT_M "' from Redis: %s",
@@ -1965,14 +2547,66 @@ err1:
 	}
 	if (c)
 		obj_put(c);
+	return err ? -1 : 0;
+}
+
+static int json_restore_call(struct redis *r, const str *callid, int foreign) {
+	redisReply *rr_jsonStr = NULL, *rp;
+	int ret;
+
+	// stored either as a string or, with delta updates, as a hash. ask for both in one
+	// round trip, the wrong one returns an error
+	redis_pipe(r, "GET " PB, STR(callid));
+	redis_pipe(r, "HGETALL " PB, STR(callid));
+	while (r->ctx && r->pipeline) {
+		r->pipeline--;
+		if (redisGetReply(r->ctx, (void **) &rp) != REDIS_OK || !rp)
+			continue;
+		if (!rr_jsonStr && (rp->type == REDIS_REPLY_STRING
+					|| (rp->type == REDIS_REPLY_ARRAY && rp->elements)))
+			rr_jsonStr = rp;
+		else
+			freeReplyObject(rp);
+	}
+	r->pipeline = 0;
+
+	ret = json_restore_call_reply(callid, rr_jsonStr, foreign);
+
+	if (rr_jsonStr)
+		freeReplyObject(rr_jsonStr);
+	return ret;
 }
 
 struct thread_ctx {
 	GQueue r_q;
 	mutex_t r_m;
+	cond_t r_c;
 	int foreign;
+	unsigned int pages; // SCAN pages handed out but not finished yet
+	atomic64 restored;
+	atomic64 failed;
+	struct timeval start;
+	struct timeval last_report;
 };
 
+static struct redis *restore_conn_get(struct thread_ctx *ctx) {
+	mutex_lock(&ctx->r_m);
+	struct redis *r = g_queue_pop_head(&ctx->r_q);
+	mutex_unlock(&ctx->r_m);
+	return r;
+}
+static void restore_conn_put(struct thread_ctx *ctx, struct redis *r) {
+	mutex_lock(&ctx->r_m);
+	g_queue_push_tail(&ctx->r_q, r);
+	mutex_unlock(&ctx->r_m);
+}
+static void restore_count(struct thread_ctx *ctx, int ret) {
+	if (ret)
+		atomic64_inc(&ctx->failed);
+	else
+		atomic64_inc(&ctx->restored);
+}
+
 static void restore_thread(void *call_p, void *ctx_p) {
 	struct thread_ctx *ctx = ctx_p;
 	redisReply *call = call_p;
@@ -1982,15 +2616,151 @@ static void restore_thread(void *call_p, void *ctx_p) {
 
 	rlog(LOG_DEBUG, "Processing call ID '%s%.*s%s' from Redis", FMT_M(REDIS_FMT(call)));
 
+	r = restore_conn_get(ctx);
+	restore_count(ctx, json_restore_call(r, &callid, ctx->foreign));
+	restore_conn_put(ctx, r);
+}
+
+// restores all calls from one SCAN page, fetching them with a single MGET
+static void restore_page_thread(void *page_p, void *ctx_p) {
+	struct thread_ctx *ctx = ctx_p;
+	redisReply *page = page_p;
+	redisReply *keys = page->element[1];
+	redisReply *vals = NULL;
+	struct redis *r;
+	unsigned int i, argc = 0;
+
+	const char **argv = g_new(const char *, keys->elements + 1);
+	size_t *argvlen = g_new(size_t, keys->elements + 1);
+	argv[argc] = "MGET";
+	argvlen[argc++] = 4;
+	for (i = 0; i < keys->elements; i++) {
+		if (keys->element[i]->type != REDIS_REPLY_STRING)
+			continue;
+		argv[argc] = keys->element[i]->str;
+		argvlen[argc++] = keys->element[i]->len;
+	}
+
+	r = restore_conn_get(ctx);
+
+	if (argc > 1 && r && r->ctx)
+		vals = redis_expect(REDIS_REPLY_ARRAY,
+				redisCommandArgv(r->ctx, argc, argv, argvlen));
+	if (vals && vals->elements != argc - 1) {
+		freeReplyObject(vals);
+		vals = NULL;
+	}
+
+	for (i = 1; i < argc; i++) {
+		str callid;
+		str_init_len(&callid, (char *) argv[i], argvlen[i]);
+
+		rlog(LOG_DEBUG, "Processing call ID '%s" STR_FORMAT "%s' from Redis",
+				FMT_M(STR_FMT(&callid)));
+
+		redisReply *val = vals ? vals->element[i - 1] : NULL;
+		if (val && val->type == REDIS_REPLY_STRING)
+			restore_count(ctx, json_restore_call_reply(&callid, val, ctx->foreign));
+		else {
+			// not a string (stored as a hash), or the MGET failed
+			restore_count(ctx, json_restore_call(r, &callid, ctx->foreign));
+		}
+	}
+
+	restore_conn_put(ctx, r);
+
+	if (vals)
+		freeReplyObject(vals);
+	g_free(argv);
+	g_free(argvlen);
+	freeReplyObject(page);
+
 	mutex_lock(&ctx->r_m);
-	r = g_queue_pop_head(&ctx->r_q);
+	ctx->pages--;
+	cond_signal(&ctx->r_c);
 	mutex_unlock(&ctx->r_m);
+}
+
+static void restore_report(struct thread_ctx *ctx, int final) {
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	if (!final && timeval_diff(&now, &ctx->last_report) < 1000000)
+		return;
+	ctx->last_report = now;
+
+	uint64_t restored = atomic64_get(&ctx->restored);
+	uint64_t failed = atomic64_get(&ctx->failed);
+	double secs = timeval_diff(&now, &ctx->start) / 1000000.0;
+
+	rlog(LOG_INFO, "%s %" PRIu64 " calls from Redis (%" PRIu64 " failed) in %.1f seconds, %.0f calls/s",
+			final ? "Restored" : "Restoring, so far",
+			restored, failed, secs,
+			secs > 0 ? (restored + failed) / secs : 0.0);
+}
+
+// walks the keyspace with SCAN on its own connection. each page is handed to the
+// restore threads while the next one is being fetched
+static int redis_restore_scan(struct redis *r, int db, struct thread_ctx *ctx, GThreadPool *gtp) {
+	struct redis *scan_r;
+	redisReply *page;
+	char cursor[32] = "0";
+	unsigned int max_pages = rtpe_config.redis_num_threads * 2;
+	int ret = -1;
+
+	scan_r = redis_new(&r->endpoint, db, r->auth, r->role, r->no_redis_required);
+	if (!scan_r || !scan_r->ctx) {
+		rlog(LOG_ERR, "Could not connect to Redis to retrieve call list");
+		goto out;
+	}
+
+	do {
+		page = redis_get(scan_r, REDIS_REPLY_ARRAY, "SCAN %s COUNT %i", cursor,
+				rtpe_config.redis_restore_batch);
+		if (!page || page->elements != 2 || page->element[0]->type != REDIS_REPLY_STRING
+				|| page->element[1]->type != REDIS_REPLY_ARRAY)
+		{
+			rlog(LOG_ERR, "Could not retrieve call list from Redis: %s",
+					scan_r->ctx ? scan_r->ctx->errstr : "No redis context");
+			if (page)
+				freeReplyObject(page);
+			goto out;
+		}
+
+		g_strlcpy(cursor, page->element[0]->str, sizeof(cursor));
+
+		if (!page->element[1]->elements) {
+			freeReplyObject(page);
+			continue;
+		}
+
+		// don't run too far ahead of the restore threads
+		mutex_lock(&ctx->r_m);
+		while (ctx->pages >= max_pages)
+			cond_wait(&ctx->r_c, &ctx->r_m);
+		ctx->pages++;
+		mutex_unlock(&ctx->r_m);
 
-	json_restore_call(r, &callid, ctx->foreign);
+		g_thread_pool_push(gtp, page, NULL);
 
+		restore_report(ctx, 0);
+	} while (strcmp(cursor, "0"));
+
+	ret = 0;
+
+out:
 	mutex_lock(&ctx->r_m);
-	g_queue_push_tail(&ctx->r_q, r);
+	while (ctx->pages) {
+		cond_wait(&ctx->r_c, &ctx->r_m);
+		mutex_unlock(&ctx->r_m);
+		restore_report(ctx, 0);
+		mutex_lock(&ctx->r_m);
+	}
 	mutex_unlock(&ctx->r_m);
+
+	if (scan_r)
+		redis_close(scan_r);
+	return ret;
 }
 
 int redis_restore(struct redis *r, int foreign, int db) {
@@ -2007,6 +2777,10 @@ int redis_restore(struct redis *r, int foreign, int db) {
 
 	rlog(LOG_DEBUG, "Restoring calls from Redis...");
 
+	ZERO(ctx);
+	gettimeofday(&ctx.start, NULL);
+	ctx.last_report = ctx.start;
+
 	mutex_lock(&r->lock);
 	// coverity[sleep : FALSE]
 	if (redis_check_conn(r) == REDIS_STATE_DISCONNECTED) {
@@ -2014,38 +2788,50 @@ int redis_restore(struct redis *r, int foreign, int db) {
 		ret = 0;
 		goto err;
 	}
-	if (db != -1)
-		redis_select_db(r, db);
 
-	calls = redis_get(r, REDIS_REPLY_ARRAY, "KEYS *");
+	if (!rtpe_config.redis_restore_batch) {
+		if (db != -1)
+			redis_select_db(r, db);
 
-	if (db != -1)
-		redis_select_db(r, r->db);
-	else
+		calls = redis_get(r, REDIS_REPLY_ARRAY, "KEYS *");
+
+		if (db != -1)
+			redis_select_db(r, r->db);
+	}
+	if (db == -1)
 		db = r->db;
 
 	mutex_unlock(&r->lock);
 
-	if (!calls) {
+	if (!rtpe_config.redis_restore_batch && !calls) {
 		rlog(LOG_ERR, "Could not retrieve call list from Redis: %s",
 				r->ctx ? r->ctx->errstr : "No redis context");
 		goto err;
 	}
 
 	mutex_init(&ctx.r_m);
+	cond_init(&ctx.r_c);
 	g_queue_init(&ctx.r_q);
 	ctx.foreign = foreign;
 	for (i = 0; i < rtpe_config.redis_num_threads; i++)
 		g_queue_push_tail(&ctx.r_q,
 				redis_new(&r->endpoint, db, r->auth, r->role, r->no_redis_required));
-	gtp = g_thread_pool_new(restore_thread, &ctx, rtpe_config.redis_num_threads, TRUE, NULL);
 
-	for (i = 0; i < calls->elements; i++) {
-		call = calls->element[i];
-		if (call->type != REDIS_REPLY_STRING)
-			continue;
+	if (calls) {
+		gtp = g_thread_pool_new(restore_thread, &ctx, rtpe_config.redis_num_threads, TRUE, NULL);
 
-		g_thread_pool_push(gtp, call, NULL);
+		for (i = 0; i < calls->elements; i++) {
+			call = calls->element[i];
+			if (call->type != REDIS_REPLY_STRING)
+				continue;
+
+			g_thread_pool_push(gtp, call, NULL);
+		}
+		ret = 0;
+	}
+	else {
+		gtp = g_thread_pool_new(restore_page_thread, &ctx, rtpe_config.redis_num_threads, TRUE, NULL);
+		ret = redis_restore_scan(r, db, &ctx, gtp);
 	}
 
 	g_thread_pool_stop_unused_threads();
@@ -2054,9 +2840,11 @@ int redis_restore(struct redis *r, int foreign, int db) {
 	g_thread_pool_free(gtp, FALSE, TRUE);
 	while ((r = g_queue_pop_head(&ctx.r_q)))
 		redis_close(r);
-	ret = 0;
 
-	freeReplyObject(calls);
+	if (calls)
+		freeReplyObject(calls);
+
+	restore_report(&ctx, 1);
 
 err:
 	for (unsigned int i = 0; i < num_log_levels; i++)
@@ -2067,31 +2855,31 @@ err:
 
 #define JSON_ADD_STRING(f...) do { \
 		int len = snprintf(tmp,sizeof(tmp), f); \
-		json_builder_add_string_value_uri_enc(builder, tmp, len); \
+		redis_builder_add_string_value_uri_enc(builder, tmp, len); \
 	} while (0)
 #define JSON_SET_NSTRING(a,b,c,d) do { \
 		snprintf(tmp,sizeof(tmp), a,b); \
-		json_builder_set_member_name(builder, tmp); \
+		redis_builder_set_member_name(builder, tmp); \
 		JSON_ADD_STRING(c, d); \
 	} while (0)
 #define JSON_SET_NSTRING_CSTR(a,b,d) JSON_SET_NSTRING_LEN(a, b, strlen(d), d)
 #define JSON_SET_NSTRING_LEN(a,b,l,d) do { \
 		snprintf(tmp,sizeof(tmp), a,b); \
-		json_builder_set_member_name(builder, tmp); \
-		json_builder_add_string_value_uri_enc(builder, d, l); \
+		redis_builder_set_member_name(builder, tmp); \
+		redis_builder_add_string_value_uri_enc(builder, d, l); \
 	} while (0)
 #define JSON_SET_SIMPLE(a,c,d) do { \
-		json_builder_set_member_name(builder, a); \
+		redis_builder_set_member_name(builder, a); \
 		JSON_ADD_STRING(c, d); \
 	} while (0)
 #define JSON_SET_SIMPLE_LEN(a,l,d) do { \
-		json_builder_set_member_name(builder, a); \
-		json_builder_add_string_value_uri_enc(builder, d, l); \
+		redis_builder_set_member_name(builder, a); \
+		redis_builder_add_string_value_uri_enc(builder, d, l); \
 	} while (0)
 #define JSON_SET_SIMPLE_CSTR(a,d) JSON_SET_SIMPLE_LEN(a, strlen(d), d)
 #define JSON_SET_SIMPLE_STR(a,d) JSON_SET_SIMPLE_LEN(a, (d)->len, (d)->s)
 
-static void json_update_crypto_params(JsonBuilder *builder, const char *key, struct crypto_params *p) {
+static void json_update_crypto_params(struct redis_builder *builder, const char *key, struct crypto_params *p) {
 	char tmp[2048];
 
 	if (!p->crypto_suite)
@@ -2109,7 +2897,7 @@ static void json_update_crypto_params(JsonBuilder *builder, const char *key, str
 		JSON_SET_NSTRING_LEN("%s-mki", key, p->mki_len, (char *) p->mki);
 }
 
-static int json_update_sdes_params(JsonBuilder *builder, const char *pref,
+static int json_update_sdes_params(struct redis_builder *builder, const char *pref,
 		unsigned int unique_id,
 		const char *k, GQueue *q)
 {
@@ -2135,7 +2923,7 @@ static int json_update_sdes_params(JsonBuilder *builder, const char *pref,
 	return 0;
 }
 
-static void json_update_dtls_fingerprint(JsonBuilder *builder, const char *pref,
+static void json_update_dtls_fingerprint(struct redis_builder *builder, const char *pref,
 		unsigned int unique_id,
 		const struct dtls_fingerprint *f)
 {
@@ -2150,7 +2938,7 @@ static void json_update_dtls_fingerprint(JsonBuilder *builder, const char *pref,
  * encodes the few (k,v) pairs for one call under one json structure
  */
 
-char* redis_encode_json(struct call *c) {
+static void redis_encode_call(struct call *c, struct redis_builder *builder) {
 
 	GList *l=0,*k=0, *m=0, *n=0;
 	struct endpoint_map *ep;
@@ -2160,16 +2948,16 @@ char* redis_encode_json(struct call *c) {
 	struct packet_stream *ps;
 	struct intf_list *il;
 	struct call_monologue *ml, *ml2;
-	JsonBuilder *builder = json_builder_new ();
 	struct recording *rec = 0;
 
 	char tmp[2048];
 
-	json_builder_begin_object (builder);
+	redis_builder_init(builder, c);
+	redis_builder_begin_object(builder);
 	{
-		json_builder_set_member_name(builder, "json");
+		redis_builder_set_member_name(builder, "json");
 
-		json_builder_begin_object (builder);
+		redis_builder_begin_object(builder);
 
 		{
 			JSON_SET_SIMPLE("created","%lli", timeval_us(&c->created));
@@ -2194,15 +2982,15 @@ char* redis_encode_json(struct call *c) {
 			}
 		}
 
-		json_builder_end_object (builder);
+		redis_builder_end_object(builder);
 
 		for (l = c->stream_fds.head; l; l = l->next) {
 			sfd = l->data;
 
 			snprintf(tmp, sizeof(tmp), "sfd-%u", sfd->unique_id);
-			json_builder_set_member_name(builder, tmp);
+			redis_builder_set_member_name(builder, tmp);
 
-			json_builder_begin_object (builder);
+			redis_builder_begin_object(builder);
 
 			{
 				JSON_SET_SIMPLE_CSTR("pref_family",sfd->local_intf->logical->preferred_family->rfc_name);
@@ -2214,7 +3002,7 @@ char* redis_encode_json(struct call *c) {
 				json_update_crypto_params(builder, "", &sfd->crypto.params);
 
 			}
-			json_builder_end_object (builder);
+			redis_builder_end_object(builder);
 
 		} // --- for
 
@@ -2225,9 +3013,9 @@ char* redis_encode_json(struct call *c) {
 			mutex_lock(&ps->out_lock);
 
 			snprintf(tmp, sizeof(tmp), "stream-%u", ps->unique_id);
-			json_builder_set_member_name(builder, tmp);
+			redis_builder_set_member_name(builder, tmp);
 
-			json_builder_begin_object (builder);
+			redis_builder_begin_object(builder);
 
 			{
 				JSON_SET_SIMPLE("media","%u",ps->media->unique_id);
@@ -2245,7 +3033,7 @@ char* redis_encode_json(struct call *c) {
 				json_update_crypto_params(builder, "", &ps->crypto.params);
 			}
 
-			json_builder_end_object (builder);
+			redis_builder_end_object(builder);
 
 			// stream_sfds was here before
 			mutex_unlock(&ps->in_lock);
@@ -2262,33 +3050,33 @@ char* redis_encode_json(struct call *c) {
 			mutex_lock(&ps->out_lock);
 
 			snprintf(tmp, sizeof(tmp), "stream_sfds-%u", ps->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_builder_set_member_name(builder, tmp);
+			redis_builder_begin_array(builder);
 			for (k = ps->sfds.head; k; k = k->next) {
 				sfd = k->data;
 				JSON_ADD_STRING("%u",sfd->unique_id);
 			}
-			json_builder_end_array (builder);
+			redis_builder_end_array(builder);
 
 			snprintf(tmp, sizeof(tmp), "rtp_sinks-%u", ps->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array(builder);
+			redis_builder_set_member_name(builder, tmp);
+			redis_builder_begin_array(builder);
 			for (k = ps->rtp_sinks.head; k; k = k->next) {
 				struct sink_handler *sh = k->data;
 				struct packet_stream *sink = sh->sink;
 				JSON_ADD_STRING("%u", sink->unique_id);
 			}
-			json_builder_end_array (builder);
+			redis_builder_end_array(builder);
 
 			snprintf(tmp, sizeof(tmp), "rtcp_sinks-%u", ps->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array(builder);
+			redis_builder_set_member_name(builder, tmp);
+			redis_builder_begin_array(builder);
 			for (k = ps->rtcp_sinks.head; k; k = k->next) {
 				struct sink_handler *sh = k->data;
 				struct packet_stream *sink = sh->sink;
 				JSON_ADD_STRING("%u", sink->unique_id);
 			}
-			json_builder_end_array (builder);
+			redis_builder_end_array(builder);
 
 			mutex_unlock(&ps->in_lock);
 			mutex_unlock(&ps->out_lock);
@@ -2299,9 +3087,9 @@ char* redis_encode_json(struct call *c) {
 			ml = l->data;
 
 			snprintf(tmp, sizeof(tmp), "tag-%u", ml->unique_id);
-			json_builder_set_member_name(builder, tmp);
+			redis_builder_set_member_name(builder, tmp);
 
-			json_builder_begin_object (builder);
+			redis_builder_begin_object(builder);
 			{
 
 				JSON_SET_SIMPLE("created","%llu",(long long unsigned) ml->created);
@@ -2316,7 +3104,7 @@ char* redis_encode_json(struct call *c) {
 				if (ml->label.s)
 					JSON_SET_SIMPLE_STR("label",&ml->label);
 			}
-			json_builder_end_object (builder);
+			redis_builder_end_object(builder);
 
 			// other_tags and medias- was here before
 
@@ -2328,46 +3116,46 @@ char* redis_encode_json(struct call *c) {
 			// XXX these should all go into the above loop
 			k = g_hash_table_get_values(ml->other_tags);
 			snprintf(tmp, sizeof(tmp), "other_tags-%u", ml->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_builder_set_member_name(builder, tmp);
+			redis_builder_begin_array(builder);
 			for (m = k; m; m = m->next) {
 				ml2 = m->data;
 				JSON_ADD_STRING("%u",ml2->unique_id);
 			}
-			json_builder_end_array (builder);
+			redis_builder_end_array(builder);
 
 			g_list_free(k);
 
 			k = g_hash_table_get_values(ml->branches);
 			snprintf(tmp, sizeof(tmp), "branches-%u", ml->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_builder_set_member_name(builder, tmp);
+			redis_builder_begin_array(builder);
 			for (m = k; m; m = m->next) {
 				ml2 = m->data;
 				JSON_ADD_STRING("%u",ml2->unique_id);
 			}
-			json_builder_end_array (builder);
+			redis_builder_end_array(builder);
 
 			g_list_free(k);
 
 			snprintf(tmp, sizeof(tmp), "medias-%u", ml->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_builder_set_member_name(builder, tmp);
+			redis_builder_begin_array(builder);
 			for (k = ml->medias.head; k; k = k->next) {
 				media = k->data;
 				JSON_ADD_STRING("%u",media->unique_id);
 			}
-			json_builder_end_array (builder);
+			redis_builder_end_array(builder);
 
 			// SSRC table dump
 			rwlock_lock_r(&ml->ssrc_hash->lock);
 			k = g_hash_table_get_values(ml->ssrc_hash->ht);
 			snprintf(tmp, sizeof(tmp), "ssrc_table-%u", ml->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_builder_set_member_name(builder, tmp);
+			redis_builder_begin_array(builder);
 			for (m = k; m; m = m->next) {
 				struct ssrc_entry_call *se = m->data;
-				json_builder_begin_object (builder);
+				redis_builder_begin_object(builder);
 
 				JSON_SET_SIMPLE("ssrc","%" PRIu32, se->h.ssrc);
 				// XXX use function for in/out
@@ -2379,34 +3167,34 @@ char* redis_encode_json(struct call *c) {
 				JSON_SET_SIMPLE("out_payload_type","%i", se->output_ctx.tracker.most[0]);
 				// XXX add rest of info
 
-				json_builder_end_object (builder);
+				redis_builder_end_object(builder);
 			}
-			json_builder_end_array (builder);
+			redis_builder_end_array(builder);
 
 			g_list_free(k);
 			rwlock_unlock_r(&ml->ssrc_hash->lock);
 
 			snprintf(tmp, sizeof(tmp), "subscriptions-oa-%u", ml->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array(builder);
+			redis_builder_set_member_name(builder, tmp);
+			redis_builder_begin_array(builder);
 			for (k = ml->subscriptions.head; k; k = k->next) {
 				struct call_subscription *cs = k->data;
 				if (!cs->offer_answer)
 					continue;
 				JSON_ADD_STRING("%u", cs->monologue->unique_id);
 			}
-			json_builder_end_array(builder);
+			redis_builder_end_array(builder);
 
 			snprintf(tmp, sizeof(tmp), "subscriptions-noa-%u", ml->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array(builder);
+			redis_builder_set_member_name(builder, tmp);
+			redis_builder_begin_array(builder);
 			for (k = ml->subscriptions.head; k; k = k->next) {
 				struct call_subscription *cs = k->data;
 				if (cs->offer_answer)
 					continue;
 				JSON_ADD_STRING("%u", cs->monologue->unique_id);
 			}
-			json_builder_end_array(builder);
+			redis_builder_end_array(builder);
 		}
 
 
@@ -2414,9 +3202,9 @@ char* redis_encode_json(struct call *c) {
 			media = l->data;
 
 			snprintf(tmp, sizeof(tmp), "media-%u", media->unique_id);
-			json_builder_set_member_name(builder, tmp);
+			redis_builder_set_member_name(builder, tmp);
 
-			json_builder_begin_object (builder);
+			redis_builder_begin_object(builder);
 			{
 				JSON_SET_SIMPLE("tag","%u",media->monologue->unique_id);
 				JSON_SET_SIMPLE("index","%u",media->index);
@@ -2437,7 +3225,7 @@ char* redis_encode_json(struct call *c) {
 						&media->sdes_out);
 				json_update_dtls_fingerprint(builder, "media", media->unique_id, &media->fingerprint);
 			}
-			json_builder_end_object (builder);
+			redis_builder_end_object(builder);
 
 		} // --- for medias.head
 
@@ -2447,26 +3235,26 @@ char* redis_encode_json(struct call *c) {
 			media = l->data;
 
 			snprintf(tmp, sizeof(tmp), "streams-%u", media->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_builder_set_member_name(builder, tmp);
+			redis_builder_begin_array(builder);
 			for (m = media->streams.head; m; m = m->next) {
 				ps = m->data;
 				JSON_ADD_STRING("%u",ps->unique_id);
 			}
-			json_builder_end_array (builder);
+			redis_builder_end_array(builder);
 
 			snprintf(tmp, sizeof(tmp), "maps-%u", media->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_builder_set_member_name(builder, tmp);
+			redis_builder_begin_array(builder);
 			for (m = media->endpoint_maps.head; m; m = m->next) {
 				ep = m->data;
 				JSON_ADD_STRING("%u",ep->unique_id);
 			}
-			json_builder_end_array (builder);
+			redis_builder_end_array(builder);
 
 			snprintf(tmp, sizeof(tmp), "payload_types-%u", media->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_builder_set_member_name(builder, tmp);
+			redis_builder_begin_array(builder);
 			for (m = media->codecs.codec_prefs.head; m; m = m->next) {
 				pt = m->data;
 				JSON_ADD_STRING("%u/" STR_FORMAT "/%u/" STR_FORMAT "/" STR_FORMAT "/%i/%i",
@@ -2474,16 +3262,16 @@ char* redis_encode_json(struct call *c) {
 						pt->clock_rate, STR_FMT(&pt->encoding_parameters),
 						STR_FMT(&pt->format_parameters), pt->bitrate, pt->ptime);
 			}
-			json_builder_end_array (builder);
+			redis_builder_end_array(builder);
 		}
 
 		for (l = c->endpoint_maps.head; l; l = l->next) {
 			ep = l->data;
 
 			snprintf(tmp, sizeof(tmp), "map-%u", ep->unique_id);
-			json_builder_set_member_name(builder, tmp);
+			redis_builder_set_member_name(builder, tmp);
 
-			json_builder_begin_object (builder);
+			redis_builder_begin_object(builder);
 			{
 				JSON_SET_SIMPLE("wildcard","%i",ep->wildcard);
 				JSON_SET_SIMPLE("num_ports","%u",ep->num_ports);
@@ -2492,7 +3280,7 @@ char* redis_encode_json(struct call *c) {
 				JSON_SET_SIMPLE_CSTR("endpoint",endpoint_print_buf(&ep->endpoint));
 
 			}
-			json_builder_end_object (builder);
+			redis_builder_end_object(builder);
 
 		} // --- for c->endpoint_maps.head
 
@@ -2501,8 +3289,8 @@ char* redis_encode_json(struct call *c) {
 			ep = l->data;
 
 			snprintf(tmp, sizeof(tmp), "map_sfds-%u", ep->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_builder_set_member_name(builder, tmp);
+			redis_builder_begin_array(builder);
 			for (m = ep->intf_sfds.head; m; m = m->next) {
 				il = m->data;
 				JSON_ADD_STRING("loc-%u",il->local_intf->unique_id);
@@ -2511,34 +3299,474 @@ char* redis_encode_json(struct call *c) {
 					JSON_ADD_STRING("%u",sfd->unique_id);
 				}
 			}
-			json_builder_end_array (builder);
+			redis_builder_end_array(builder);
 		}
 
 	}
-	json_builder_end_object (builder);
+	redis_builder_end_object(builder);
 
-	JsonGenerator *gen = json_generator_new ();
-	JsonNode * root = json_builder_get_root (builder);
-	json_generator_set_root (gen, root);
-	char* result = json_generator_to_data (gen, NULL);
+	redis_builder_finish(builder);
+}
 
-	json_node_free (root);
-	g_object_unref (gen);
-	g_object_unref (builder);
 
-	return result;
+/* called with r->lock held */
+static void redis_pipe_call(struct redis *r, const str *callid, struct redis_builder *b) {
+	if (!b->fields)
+		redis_pipe(r, "SET "PB" "PB, STR(callid), S_LEN(b->data, b->len));
+	else {
+		unsigned int argc = 0;
+		const char **argv = g_new(const char *, 4 + b->changed.length * 2);
+		size_t *argvlen = g_new(size_t, 4 + b->changed.length * 2);
+		char gen[24];
+
+		// so that a restore never sees a half-written update
+		redis_pipe(r, "MULTI");
+
+		// don't know what's stored, possibly not even a hash
+		if (!b->old_fields)
+			redis_pipe(r, "DEL "PB, STR(callid));
+
+		argv[argc] = "HSET";
+		argvlen[argc++] = 4;
+		argv[argc] = callid->s;
+		argvlen[argc++] = callid->len;
+		argv[argc] = "generation";
+		argvlen[argc++] = 10;
+		argvlen[argc] = snprintf(gen, sizeof(gen), "%" PRIu64, b->generation);
+		argv[argc++] = gen;
+		for (GList *l = b->changed.head; l; l = l->next) {
+			struct redis_field *f = l->data;
+			argv[argc] = f->name;
+			argvlen[argc++] = strlen(f->name);
+			argv[argc] = f->data;
+			argvlen[argc++] = f->len;
+		}
+		redis_pipe_argv(r, argc, argv, argvlen);
+		g_free(argv);
+		g_free(argvlen);
+
+		// fields of objects that have gone away
+		if (b->old_fields) {
+			GPtrArray *gone = g_ptr_array_new();
+			GHashTableIter iter;
+			gpointer key;
+			g_ptr_array_add(gone, "HDEL");
+			g_ptr_array_add(gone, callid->s);
+			g_hash_table_iter_init(&iter, b->old_fields);
+			while (g_hash_table_iter_next(&iter, &key, NULL)) {
+				if (!g_hash_table_contains(b->fields, key))
+					g_ptr_array_add(gone, key);
+			}
+			if (gone->len > 2) {
+				size_t *gonelen = g_new(size_t, gone->len);
+				for (unsigned int i = 0; i < gone->len; i++)
+					gonelen[i] = strlen(g_ptr_array_index(gone, i));
+				gonelen[1] = callid->len;
+				redis_pipe_argv(r, gone->len, (const char **) gone->pdata, gonelen);
+				g_free(gonelen);
+			}
+			g_ptr_array_free(gone, TRUE);
+		}
+
+		redis_pipe(r, "EXPIRE "PB" %i", STR(callid), rtpe_config.redis_expires_secs);
+		redis_pipe(r, "EXEC");
+		return;
+	}
+	redis_pipe(r, "EXPIRE "PB" %i", STR(callid), rtpe_config.redis_expires_secs);
+}
+
+// marks the call for the writer thread, merging with a pending write if there is one
+static void redis_write_queue(struct call *c, struct redis *r, enum redis_write_op op) {
+	mutex_lock(&r->write_lock);
+	enum redis_write_op old = GPOINTER_TO_INT(g_hash_table_lookup(r->write_calls, c));
+	if (old == REDIS_WRITE_NONE) {
+		g_queue_push_tail(&r->write_queue, obj_get(c));
+		atomic64_set(&rtpe_stats.redis_write_queue, r->write_queue.length);
+		cond_signal(&r->write_cond);
+	}
+	if (op > old)
+		g_hash_table_insert(r->write_calls, c, GINT_TO_POINTER(op));
+	mutex_unlock(&r->write_lock);
+}
+
+struct redis_write_entry {
+	struct call *call;
+	enum redis_write_op op;
+	int db;
+	int encoded;
+	int failed;
+	unsigned int replies; // pipelined, not yet consumed
+	struct redis_builder rb;
+};
+
+/* called with r->lock held */
+static void redis_write_consume(struct redis *r, struct redis_write_entry *ents, unsigned int num) {
+	for (unsigned int i = 0; i < num; i++) {
+		struct redis_write_entry *e = &ents[i];
+		if (!e->replies)
+			continue;
+		if (redis_consume_num(r, e->replies))
+			e->failed = 1;
+		e->replies = 0;
+	}
+}
+
+/* called lock-free. takes over the call references */
+static void redis_write_batch(struct redis *r, struct redis_write_entry *ents, unsigned int num) {
+	struct timeval start, end;
+	unsigned int i, writes = 0;
+	int ok = 0;
+
+	// encode first, without holding the redis lock
+	for (i = 0; i < num; i++) {
+		struct redis_write_entry *e = &ents[i];
+		struct call *c = e->call;
+
+		if (e->op != REDIS_WRITE_DELETE) {
+			// changes only on the first write of a call, so the write lock is rarely needed
+			rwlock_lock_r(&c->master_lock);
+			int set_db = !c->foreign_call && c->redis_hosted_db != r->db;
+			rwlock_unlock_r(&c->master_lock);
+			if (set_db) {
+				rwlock_lock_w(&c->master_lock);
+				c->redis_hosted_db = r->db;
+				rwlock_unlock_w(&c->master_lock);
+			}
+		}
+
+		rwlock_lock_r(&c->master_lock);
+		if (e->op == REDIS_WRITE_DELETE)
+			e->db = c->redis_hosted_db;
+		else if (!c->foreign_call) {
+			e->db = r->db;
+			redis_encode_call(c, &e->rb);
+			e->encoded = 1;
+		}
+		rwlock_unlock_r(&c->master_lock);
+	}
+
+	gettimeofday(&start, NULL);
+
+	mutex_lock(&r->lock);
+	// coverity[sleep : FALSE]
+	if (redis_check_conn(r) == REDIS_STATE_DISCONNECTED)
+		goto out;
+
+	for (i = 0; i < num; i++) {
+		struct redis_write_entry *e = &ents[i];
+
+		if (e->op != REDIS_WRITE_DELETE && !e->encoded)
+			continue;
+
+		if (e->db != r->current_db) {
+			// SELECT is not pipelined
+			redis_write_consume(r, ents, i);
+			if (redis_select_db(r, e->db)) {
+				rlog(LOG_ERR, " >>>>>>>>>>>>>>>>> Redis error.");
+				if (r->ctx && r->ctx->err)
+					rlog(LOG_ERR, "Redis error: %s", r->ctx->errstr);
+				redisFree(r->ctx);
+				r->ctx = NULL;
+				r->pipeline = 0;
+				goto out;
+			}
+		}
+
+		unsigned int pipeline = r->pipeline;
+		if (e->op == REDIS_WRITE_DELETE)
+			redis_pipe(r, "DEL "PB"", STR(&e->call->callid));
+		else
+			redis_pipe_call(r, &e->call->callid, &e->rb);
+		e->replies = r->pipeline - pipeline;
+		writes++;
+	}
+
+	redis_write_consume(r, ents, num);
+	ok = r->ctx && !r->ctx->err;
+
+out:
+	mutex_unlock(&r->lock);
+
+	if (writes) {
+		gettimeofday(&end, NULL);
+		atomic64_add(&rtpe_totalstats.total_redis_writes, writes);
+		atomic64_inc(&rtpe_totalstats.total_redis_write_batches);
+		atomic64_add(&rtpe_totalstats.total_redis_write_time, timeval_diff(&end, &start));
+	}
+
+	for (i = 0; i < num; i++) {
+		if (ents[i].encoded) {
+			redis_builder_commit(&ents[i].rb, ents[i].call, ok && !ents[i].failed);
+			redis_builder_free(&ents[i].rb);
+		}
+		obj_put(ents[i].call);
+	}
+}
+
+void redis_write_loop(void *d) {
+	struct redis *r = rtpe_redis_write;
+	struct redis_write_entry ents[REDIS_WRITE_BATCH];
+	unsigned int num;
+
+	if (!r)
+		return;
+
+	struct thread_waker waker = { .lock = &r->write_lock, .cond = &r->write_cond };
+	thread_waker_add(&waker);
+
+	mutex_lock(&r->write_lock);
+	while (1) {
+		while (!r->write_queue.length && !rtpe_shutdown)
+			cond_wait(&r->write_cond, &r->write_lock);
+		// flush what's left before exiting
+		if (!r->write_queue.length)
+			break;
+
+		for (num = 0; num < REDIS_WRITE_BATCH && r->write_queue.length; num++) {
+			struct call *c = g_queue_pop_head(&r->write_queue);
+			ents[num] = (struct redis_write_entry) {
+				.call = c,
+				.op = GPOINTER_TO_INT(g_hash_table_lookup(r->write_calls, c)),
+			};
+			g_hash_table_remove(r->write_calls, c);
+		}
+		atomic64_set(&rtpe_stats.redis_write_queue, r->write_queue.length);
+		mutex_unlock(&r->write_lock);
+
+		redis_write_batch(r, ents, num);
+
+		mutex_lock(&r->write_lock);
+	}
+	mutex_unlock(&r->write_lock);
+
+	thread_waker_del(&waker);
+}
+
+
+struct redis_notify_ctx {
+	mutex_t lock;
+	cond_t cond;
+	unsigned int pending;
+};
+
+static void redis_notify_thread(void *ent_p, void *ctx_p) {
+	struct redis_notify_entry *e = ent_p;
+	struct redis_notify_ctx *ctx = ctx_p;
+	struct call *c;
+
+	c = call_get(&e->callid);
+	if (c) {
+		rwlock_unlock_w(&c->master_lock);
+		if (!IS_FOREIGN_CALL(c)) {
+			rlog(LOG_WARN, "Redis-Notifier: Ignoring %s received for OWN call: " STR_FORMAT_M,
+					e->op == REDIS_WRITE_DELETE ? "DEL" : "SET", STR_FMT_M(&e->callid));
+			goto out;
+		}
+		call_destroy(c);
+	}
+	else if (e->op == REDIS_WRITE_DELETE)
+		rlog(LOG_NOTICE, "Redis-Notifier: DEL did not find call with callid: " STR_FORMAT_M,
+				STR_FMT_M(&e->callid));
+
+	// gone again in the meantime if there's no reply
+	if (e->op == REDIS_WRITE_UPDATE && e->reply)
+		json_restore_call_reply(&e->callid, e->reply, 1);
+
+out:
+	if (c) {
+		obj_put(c);
+		log_info_clear();
+	}
+
+	mutex_lock(&ctx->lock);
+	ctx->pending--;
+	cond_signal(&ctx->cond);
+	mutex_unlock(&ctx->lock);
+}
+
+static int redis_notify_entry_cmp(const void *a, const void *b) {
+	const struct redis_notify_entry *const *A = a, *const *B = b;
+	return (*A)->db - (*B)->db;
+}
+
+// fetches all updated calls from one db in one round trip, with a follow-up for
+// calls stored as hashes
+static void redis_notify_fetch(struct redis *r, struct redis_notify_entry **ents, unsigned int num,
+		GQueue *replies)
+{
+	unsigned int i, argc = 0;
+	redisReply *vals;
+	const char **argv = g_new(const char *, num + 1);
+	size_t *argvlen = g_new(size_t, num + 1);
+	struct redis_notify_entry **upd = g_new(struct redis_notify_entry *, num);
+
+	argv[argc] = "MGET";
+	argvlen[argc++] = 4;
+	for (i = 0; i < num; i++) {
+		if (ents[i]->op != REDIS_WRITE_UPDATE)
+			continue;
+		upd[argc - 1] = ents[i];
+		argv[argc] = ents[i]->callid.s;
+		argvlen[argc++] = ents[i]->callid.len;
+	}
+	if (argc == 1)
+		goto out;
+
+	vals = redis_expect(REDIS_REPLY_ARRAY, redisCommandArgv(r->ctx, argc, argv, argvlen));
+	if (!vals || vals->elements != argc - 1) {
+		rlog(LOG_ERR, "Redis-Notifier: failed to fetch %u updated calls: %s", argc - 1,
+				r->ctx->err ? r->ctx->errstr : "unexpected reply");
+		if (vals)
+			freeReplyObject(vals);
+		// leave them alone rather than deleting them
+		for (i = 1; i < argc; i++)
+			upd[i - 1]->op = REDIS_WRITE_NONE;
+		goto out;
+	}
+	g_queue_push_tail(replies, vals);
+
+	for (i = 1; i < argc; i++) {
+		if (vals->element[i - 1]->type == REDIS_REPLY_STRING)
+			upd[i - 1]->reply = vals->element[i - 1];
+		else
+			redis_pipe(r, "HGETALL " PB, STR(&upd[i - 1]->callid));
+	}
+	for (i = 1; i < argc && r->pipeline; i++) {
+		redisReply *rp;
+		if (upd[i - 1]->reply)
+			continue;
+		r->pipeline--;
+		if (redisGetReply(r->ctx, (void **) &rp) != REDIS_OK || !rp)
+			continue;
+		if (rp->type == REDIS_REPLY_ARRAY && rp->elements)
+			upd[i - 1]->reply = rp;
+		g_queue_push_tail(replies, rp);
+	}
+	redis_consume(r);
 
+out:
+	g_free(argv);
+	g_free(argvlen);
+	g_free(upd);
+}
+
+static void redis_notify_batch(struct redis *r, struct redis_notify_entry **ents, unsigned int num,
+		GThreadPool *gtp, struct redis_notify_ctx *ctx)
+{
+	unsigned int i, j;
+	GQueue replies = G_QUEUE_INIT;
+	int conn = (redis_check_conn(r) != REDIS_STATE_DISCONNECTED);
+
+	// one MGET per db
+	qsort(ents, num, sizeof(*ents), redis_notify_entry_cmp);
+	for (i = 0; i < num; i = j) {
+		for (j = i + 1; j < num && ents[j]->db == ents[i]->db; j++)
+			;
+		if (conn && !redis_select_db(r, ents[i]->db))
+			redis_notify_fetch(r, ents + i, j - i, &replies);
+		else {
+			for (unsigned int k = i; k < j; k++)
+				if (ents[k]->op == REDIS_WRITE_UPDATE)
+					ents[k]->op = REDIS_WRITE_NONE;
+		}
+	}
+
+	mutex_lock(&ctx->lock);
+	for (i = 0; i < num; i++) {
+		if (ents[i]->op == REDIS_WRITE_NONE)
+			continue;
+		ctx->pending++;
+		g_thread_pool_push(gtp, ents[i], NULL);
+	}
+	// the next batch may contain the same calls again
+	while (ctx->pending)
+		cond_wait(&ctx->cond, &ctx->lock);
+	mutex_unlock(&ctx->lock);
+
+	rlog(LOG_DEBUG, "Redis-Notifier: processed batch of %u notifications", num);
+
+	g_queue_clear_full(&replies, (GDestroyNotify) freeReplyObject);
+	for (i = 0; i < num; i++)
+		redis_notify_entry_free(ents[i]);
+}
+
+void redis_notify_batch_loop(void *d) {
+	struct redis *r = rtpe_redis_notify;
+	struct redis *conn;
+	struct redis_notify_entry **ents;
+	struct redis_notify_ctx ctx;
+	GThreadPool *gtp;
+	unsigned int num;
+	struct timeval now, until;
+
+	if (!r)
+		return;
+
+	// separate connection, as the notification handler keeps using its own
+	conn = redis_new(&r->endpoint, rtpe_config.redis_db, r->auth, r->role, r->no_redis_required);
+	if (!conn) {
+		rlog(LOG_ERR, "Redis-Notifier: failed to connect for batched processing");
+		return;
+	}
+
+	mutex_init(&ctx.lock);
+	cond_init(&ctx.cond);
+	ctx.pending = 0;
+	gtp = g_thread_pool_new(redis_notify_thread, &ctx, rtpe_config.redis_num_threads, TRUE, NULL);
+	ents = g_new(struct redis_notify_entry *, REDIS_NOTIFY_BATCH);
+
+	struct thread_waker waker = { .lock = &r->notify_lock, .cond = &r->notify_cond };
+	thread_waker_add(&waker);
+
+	mutex_lock(&r->notify_lock);
+	while (!rtpe_shutdown) {
+		if (!r->notify_queue.length) {
+			cond_wait(&r->notify_cond, &r->notify_lock);
+			continue;
+		}
+
+		// let the window fill up
+		until = r->notify_first;
+		timeval_add_usec(&until, rtpe_config.redis_notify_batch * 1000L);
+		gettimeofday(&now, NULL);
+		if (timeval_cmp(&now, &until) < 0) {
+			cond_timedwait(&r->notify_cond, &r->notify_lock, &until);
+			continue;
+		}
+
+		for (num = 0; num < REDIS_NOTIFY_BATCH && r->notify_queue.length; num++) {
+			ents[num] = g_queue_pop_head(&r->notify_queue);
+			g_hash_table_remove(r->notify_calls, ents[num]->key);
+		}
+		mutex_unlock(&r->notify_lock);
+
+		redis_notify_batch(conn, ents, num, gtp, &ctx);
+
+		mutex_lock(&r->notify_lock);
+	}
+	mutex_unlock(&r->notify_lock);
+
+	thread_waker_del(&waker);
+
+	g_thread_pool_free(gtp, FALSE, TRUE);
+	g_free(ents);
+	redis_close(conn);
 }
 
 
 void redis_update_onekey(struct call *c, struct redis *r) {
-	unsigned int redis_expires_s;
+	struct redis_builder rb;
 
 	if (!r)
 		return;
 	if (c->foreign_call)
 		return;
 
+	if (rtpe_config.redis_update_async) {
+		redis_write_queue(c, r, REDIS_WRITE_UPDATE);
+		return;
+	}
+
 	mutex_lock(&r->lock);
 	// coverity[sleep : FALSE]
 	if (redis_check_conn(r) == REDIS_STATE_DISCONNECTED) {
@@ -2548,25 +3776,18 @@ void redis_update_onekey(struct call *c, struct redis *r) {
 
 	rwlock_lock_r(&c->master_lock);
 
-	redis_expires_s = rtpe_config.redis_expires_secs;
-
 	c->redis_hosted_db = r->db;
 	if (redis_select_db(r, c->redis_hosted_db)) {
 		rlog(LOG_ERR, " >>>>>>>>>>>>>>>>> Redis error.");
 		goto err;
 	}
 
-	char* result = redis_encode_json(c);
-	if (!result)
-		goto err;
-
-	redis_pipe(r, "SET "PB" %s", STR(&c->callid), result);
-	redis_pipe(r, "EXPIRE "PB" %i", STR(&c->callid), redis_expires_s);
+	redis_encode_call(c, &rb);
+	redis_pipe_call(r, &c->callid, &rb);
+	int failed = redis_consume_num(r, r->pipeline);
 
-	redis_consume(r);
-
-	if (result)
-		free(result);
+	redis_builder_commit(&rb, c, r->ctx && !r->ctx->err && !failed);
+	redis_builder_free(&rb);
 	mutex_unlock(&r->lock);
 	rwlock_unlock_r(&c->master_lock);
 
@@ -2589,6 +3810,12 @@ void redis_delete(struct call *c, struct redis *r) {
 	if (!r)
 		return;
 
+	// keep the ordering with pending updates
+	if (rtpe_config.redis_update_async) {
+		redis_write_queue(c, r, REDIS_WRITE_DELETE);
+		return;
+	}
+
 	if (delete_async) {
 		mutex_lock(&r->async_lock);
 		rwlock_lock_r(&c->master_lock);
@@ -43,12 +43,54 @@ struct sdp_connection {
 	unsigned int parsed:1;
 };
 
+struct sdp_attr_chunk;
+
+enum attr_id {
+	ATTR_OTHER = 0,
+	ATTR_RTCP,
+	ATTR_CANDIDATE,
+	ATTR_ICE,
+	ATTR_ICE_LITE,
+	ATTR_ICE_OPTIONS,
+	ATTR_ICE_UFRAG,
+	ATTR_ICE_PWD,
+	ATTR_CRYPTO,
+	ATTR_SSRC,
+	ATTR_INACTIVE,
+	ATTR_SENDRECV,
+	ATTR_SENDONLY,
+	ATTR_RECVONLY,
+	ATTR_RTCP_MUX,
+	ATTR_EXTMAP,
+	ATTR_GROUP,
+	ATTR_MID,
+	ATTR_FINGERPRINT,
+	ATTR_SETUP,
+	ATTR_RTPMAP,
+	ATTR_FMTP,
+	ATTR_IGNORE,
+	ATTR_RTPENGINE,
+	ATTR_PTIME,
+	ATTR_RTCP_FB,
+	ATTR_T38FAXVERSION,
+	ATTR_T38FAXUDPEC,
+	ATTR_T38FAXUDPECDEPTH,
+	ATTR_T38FAXUDPFECMAXSPAN,
+	ATTR_T38FAXMAXDATAGRAM,
+	ATTR_T38FAXMAXIFP,
+	ATTR_T38FAXFILLBITREMOVAL,
+	ATTR_T38FAXTRANSCODINGMMR,
+	ATTR_T38FAXTRANSCODINGJBIG,
+	ATTR_T38FAXRATEMANAGEMENT,
+	ATTR_END_OF_CANDIDATES,
+	__ATTR_LAST
+};
+
 struct sdp_attributes {
 	GQueue list;
-	/* GHashTable *name_hash; */
-	/* GHashTable *name_lists_hash; */
-	GHashTable *id_lists_hash;
-	GHashTable *id_hash;
+	/* dense per-type index, first occurrence and list of all occurrences */
+	struct sdp_attribute *id_first[__ATTR_LAST];
+	GQueue id_lists[__ATTR_LAST];
 };
 
 struct sdp_session {
@@ -59,6 +101,7 @@ struct sdp_session {
 	int rr, rs;
 	struct sdp_attributes attributes;
 	GQueue media_streams;
+	struct sdp_attr_chunk *attr_chunks; /* backing store for session and media attributes */
 };
 
 struct sdp_media {
@@ -216,45 +259,10 @@ struct sdp_attribute {	/* example: a=rtpmap:8 PCMA/8000 */
 	    key,	/* "rtpmap:8" */
 	    param;	/* "PCMA/8000" */
 
-	enum {
-		ATTR_OTHER = 0,
-		ATTR_RTCP,
-		ATTR_CANDIDATE,
-		ATTR_ICE,
-		ATTR_ICE_LITE,
-		ATTR_ICE_OPTIONS,
-		ATTR_ICE_UFRAG,
-		ATTR_ICE_PWD,
-		ATTR_CRYPTO,
-		ATTR_SSRC,
-		ATTR_INACTIVE,
-		ATTR_SENDRECV,
-		ATTR_SENDONLY,
-		ATTR_RECVONLY,
-		ATTR_RTCP_MUX,
-		ATTR_EXTMAP,
-		ATTR_GROUP,
-		ATTR_MID,
-		ATTR_FINGERPRINT,
-		ATTR_SETUP,
-		ATTR_RTPMAP,
-		ATTR_FMTP,
-		ATTR_IGNORE,
-		ATTR_RTPENGINE,
-		ATTR_PTIME,
-		ATTR_RTCP_FB,
-		ATTR_T38FAXVERSION,
-		ATTR_T38FAXUDPEC,
-		ATTR_T38FAXUDPECDEPTH,
-		ATTR_T38FAXUDPFECMAXSPAN,
-		ATTR_T38FAXMAXDATAGRAM,
-		ATTR_T38FAXMAXIFP,
-		ATTR_T38FAXFILLBITREMOVAL,
-		ATTR_T38FAXTRANSCODINGMMR,
-		ATTR_T38FAXTRANSCODINGJBIG,
-		ATTR_T38FAXRATEMANAGEMENT,
-		ATTR_END_OF_CANDIDATES,
-	} attr;
+	enum attr_id attr;
+
+	GList list_link,	/* embedded links for sdp_attributes, no allocations */
+	      id_link;
 
 	union {
 		struct attribute_rtcp rtcp;
@@ -276,6 +284,17 @@ struct sdp_attribute {	/* example: a=rtpmap:8 PCMA/8000 */
 
 
 
+#define SDP_ATTR_CHUNK_SIZE 16
+
+/* attributes are carved out of per-session chunks instead of being allocated one by one */
+struct sdp_attr_chunk {
+	struct sdp_attr_chunk *next;
+	unsigned int used;
+	struct sdp_attribute attrs[SDP_ATTR_CHUNK_SIZE];
+};
+
+
+
 static char __id_buf[6*2 + 1]; // 6 hex encoded characters
 const str rtpe_instance_id = STR_CONST_INIT(__id_buf);
 
@@ -283,10 +302,10 @@ const str rtpe_instance_id = STR_CONST_INIT(__id_buf);
 
 
 INLINE struct sdp_attribute *attr_get_by_id(struct sdp_attributes *a, int id) {
-	return g_hash_table_lookup(a->id_hash, &id);
+	return a->id_first[id];
 }
 INLINE GQueue *attr_list_get_by_id(struct sdp_attributes *a, int id) {
-	return g_hash_table_lookup(a->id_lists_hash, &id);
+	return a->id_lists[id].length ? &a->id_lists[id] : NULL;
 }
 
 static struct sdp_attribute *attr_get_by_id_m_s(struct sdp_media *m, int id) {
@@ -410,14 +429,31 @@ static int parse_media(str *value_str, struct sdp_media *output) {
 	return 0;
 }
 
-static void attrs_init(struct sdp_attributes *a) {
-	g_queue_init(&a->list);
-	/* a->name_hash = g_hash_table_new(str_hash, str_equal); */
-	a->id_hash = g_hash_table_new(g_int_hash, g_int_equal);
-	/* a->name_lists_hash = g_hash_table_new_full(str_hash, str_equal,
-			NULL, (GDestroyNotify) g_queue_free); */
-	a->id_lists_hash = g_hash_table_new_full(g_int_hash, g_int_equal,
-			NULL, (GDestroyNotify) g_queue_free);
+static struct sdp_attribute *attr_alloc(struct sdp_session *session) {
+	struct sdp_attr_chunk *c = session->attr_chunks;
+	if (!c || c->used >= SDP_ATTR_CHUNK_SIZE) {
+		c = g_slice_alloc(sizeof(*c));
+		c->next = session->attr_chunks;
+		c->used = 0;
+		session->attr_chunks = c;
+	}
+	struct sdp_attribute *a = &c->attrs[c->used++];
+	memset(a, 0, sizeof(*a));
+	return a;
+}
+/* returns the most recently allocated attribute to the chunk */
+static void attr_alloc_undo(struct sdp_session *session, struct sdp_attribute *a) {
+	struct sdp_attr_chunk *c = session->attr_chunks;
+	assert(c && c->used && &c->attrs[c->used - 1] == a);
+	c->used--;
+}
+static void attrs_add(struct sdp_attributes *attrs, struct sdp_attribute *attr) {
+	attr->list_link.data = attr;
+	g_queue_push_tail_link(&attrs->list, &attr->list_link);
+	if (!attrs->id_first[attr->attr])
+		attrs->id_first[attr->attr] = attr;
+	attr->id_link.data = attr;
+	g_queue_push_tail_link(&attrs->id_lists[attr->attr], &attr->id_link);
 }
 
 static int parse_attribute_group(struct sdp_attribute *output) {
@@ -849,16 +885,13 @@ static int parse_attribute_fmtp(struct sdp_attribute *output) {
 	return 0;
 }
 
-static int parse_attribute_int(struct sdp_attribute *output, int attr_id, int defval) {
-	output->attr = attr_id;
+static int parse_attribute_int(struct sdp_attribute *output, int defval) {
 	output->u.i = str_to_i(&output->value, defval);
-	return 0;
+	return output->u.i;
 }
 
 // XXX combine this with parse_attribute_setup ?
 static int parse_attribute_t38faxudpec(struct sdp_attribute *output) {
-	output->attr = ATTR_T38FAXUDPEC;
-
 	switch (__csh_lookup(&output->value)) {
 		case CSH_LOOKUP("t38UDPNoEC"):
 			output->u.t38faxudpec.ec = EC_NONE;
@@ -1018,23 +1051,25 @@ static int parse_attribute(struct sdp_attribute *a) {
 		case CSH_LOOKUP("rtcp-fb"):
 			ret = parse_attribute_rtcp_fb(a);
 			break;
+		// T.38 attribute values are only parsed when needed, see __sdp_t38(), unless
+		// they can be malformed, in which case they must be discarded right away
 		case CSH_LOOKUP("T38FaxVersion"):
-			ret = parse_attribute_int(a, ATTR_T38FAXVERSION, -1);
+			a->attr = ATTR_T38FAXVERSION;
 			break;
 		case CSH_LOOKUP("T38FaxUdpEC"):
-			ret = parse_attribute_t38faxudpec(a);
+			a->attr = ATTR_T38FAXUDPEC;
 			break;
 		case CSH_LOOKUP("T38FaxUdpECDepth"):
 			ret = parse_attribute_t38faxudpecdepth(a);
 			break;
 		case CSH_LOOKUP("T38FaxUdpFECMaxSpan"):
-			ret = parse_attribute_int(a, ATTR_T38FAXUDPFECMAXSPAN, 0);
+			a->attr = ATTR_T38FAXUDPFECMAXSPAN;
 			break;
 		case CSH_LOOKUP("T38FaxMaxDatagram"):
-			ret = parse_attribute_int(a, ATTR_T38FAXMAXDATAGRAM, -1);
+			a->attr = ATTR_T38FAXMAXDATAGRAM;
 			break;
 		case CSH_LOOKUP("T38FaxMaxIFP"):
-			ret = parse_attribute_int(a, ATTR_T38FAXMAXIFP, -1);
+			a->attr = ATTR_T38FAXMAXIFP;
 			break;
 		case CSH_LOOKUP("T38FaxFillBitRemoval"):
 			a->attr = ATTR_T38FAXFILLBITREMOVAL;
@@ -1058,10 +1093,8 @@ int sdp_parse(str *body, GQueue *sessions, const struct sdp_ng_flags *flags) {
 	struct sdp_session *session = NULL;
 	struct sdp_media *media = NULL;
 	const char *errstr;
-	struct sdp_attributes *attrs;
 	struct sdp_attribute *attr;
 	str *adj_s;
-	GQueue *attr_queue;
 
 	b = body->s;
 	end = str_end(body);
@@ -1112,7 +1145,6 @@ int sdp_parse(str *body, GQueue *sessions, const struct sdp_ng_flags *flags) {
 new_session:
 				session = g_slice_alloc0(sizeof(*session));
 				g_queue_init(&session->media_streams);
-				attrs_init(&session->attributes);
 				g_queue_push_tail(sessions, session);
 				media = NULL;
 				session->s.s = b;
@@ -1136,7 +1168,6 @@ new_session:
 
 				media = g_slice_alloc0(sizeof(*media));
 				media->session = session;
-				attrs_init(&media->attributes);
 				errstr = "Error parsing m= line";
 				if (parse_media(&value_str, media))
 					goto error;
@@ -1158,7 +1189,7 @@ new_session:
 				if (media && !media->c_line_pos)
 					media->c_line_pos = b;
 
-				attr = g_slice_alloc0(sizeof(*attr));
+				attr = attr_alloc(session);
 
 				attr->full_line.s = b;
 				attr->full_line.len = next_line ? (next_line - b) : (line_end - b);
@@ -1167,23 +1198,11 @@ new_session:
 				attr->line_value.len = line_end - value;
 
 				if (parse_attribute(attr)) {
-					g_slice_free1(sizeof(*attr), attr);
+					attr_alloc_undo(session, attr);
 					break;
 				}
 
-				attrs = media ? &media->attributes : &session->attributes;
-				g_queue_push_tail(&attrs->list, attr);
-				/* g_hash_table_insert(attrs->name_hash, &attr->name, attr); */
-				if (!g_hash_table_lookup(attrs->id_hash, &attr->attr))
-					g_hash_table_insert(attrs->id_hash, &attr->attr, attr);
-				/* if (attr->key.s)
-					g_hash_table_insert(attrs->name_hash, &attr->key, attr); */
-
-				/* attr_queue = g_hash_table_lookup_queue_new(attrs->name_lists_hash, &attr->name);
-				g_queue_push_tail(attr_queue, attr); */
-				attr_queue = g_hash_table_lookup_queue_new(attrs->id_lists_hash, &attr->attr,
-						NULL);
-				g_queue_push_tail(attr_queue, attr);
+				attrs_add(media ? &media->attributes : &session->attributes, attr);
 
 				break;
 
@@ -1246,26 +1265,19 @@ error:
 	return -1;
 }
 
-static void attr_free(void *p) {
-	g_slice_free1(sizeof(struct sdp_attribute), p);
-}
-static void free_attributes(struct sdp_attributes *a) {
-	/* g_hash_table_destroy(a->name_hash); */
-	g_hash_table_destroy(a->id_hash);
-	/* g_hash_table_destroy(a->name_lists_hash); */
-	g_hash_table_destroy(a->id_lists_hash);
-	g_queue_clear_full(&a->list, attr_free);
-}
 static void media_free(void *p) {
 	struct sdp_media *media = p;
-	free_attributes(&media->attributes);
 	g_queue_clear_full(&media->format_list, str_slice_free);
 	g_slice_free1(sizeof(*media), media);
 }
 static void session_free(void *p) {
 	struct sdp_session *session = p;
 	g_queue_clear_full(&session->media_streams, media_free);
-	free_attributes(&session->attributes);
+	struct sdp_attr_chunk *c;
+	while ((c = session->attr_chunks)) {
+		session->attr_chunks = c->next;
+		g_slice_free1(sizeof(*c), c);
+	}
 	g_slice_free1(sizeof(*session), session);
 }
 void sdp_free(GQueue *sessions) {
@@ -1450,10 +1462,11 @@ static void __sdp_t38(struct stream_params *sp, struct sdp_media *media) {
 
 	attr = attr_get_by_id(&media->attributes, ATTR_T38FAXVERSION);
 	if (attr)
-		to->version = attr->u.i;
+		to->version = parse_attribute_int(attr, -1);
 
 	attr = attr_get_by_id(&media->attributes, ATTR_T38FAXUDPEC);
 	if (attr) {
+		parse_attribute_t38faxudpec(attr);
 		if (attr->u.t38faxudpec.ec == EC_REDUNDANCY)
 			to->max_ec_entries = to->min_ec_entries = 3; // defaults
 		else if (attr->u.t38faxudpec.ec == EC_FEC) {
@@ -1474,15 +1487,15 @@ static void __sdp_t38(struct stream_params *sp, struct sdp_media *media) {
 
 	attr = attr_get_by_id(&media->attributes, ATTR_T38FAXUDPFECMAXSPAN);
 	if (attr)
-		to->fec_span = attr->u.i;
+		to->fec_span = parse_attribute_int(attr, 0);
 
 	attr = attr_get_by_id(&media->attributes, ATTR_T38FAXMAXDATAGRAM);
 	if (attr)
-		to->max_datagram = attr->u.i;
+		to->max_datagram = parse_attribute_int(attr, -1);
 
 	attr = attr_get_by_id(&media->attributes, ATTR_T38FAXMAXIFP);
 	if (attr)
-		to->max_ifp = attr->u.i;
+		to->max_ifp = parse_attribute_int(attr, -1);
 
 	attr = attr_get_by_id(&media->attributes, ATTR_T38FAXFILLBITREMOVAL);
 	if (attr && (!attr->value.len || str_cmp(&attr->value, "0")))
@@ -2754,6 +2767,125 @@ error:
 	return -1;
 }
 
+/* Output cache for repeated identical offer/answers (e.g. re-INVITEs and session refreshes).
+ * An entry is valid only as long as both the input and the relevant call state are unchanged,
+ * and only stored if the negotiation that produced it left the call state untouched.
+ * The o= version is volatile (it goes up with every re-INVITE) and so is excluded from the
+ * input fingerprint, and patched into the cached output instead. */
+struct sdp_out_cache {
+	uint64_t input_fp;
+	uint64_t state_fp;
+	GString *output;
+	GArray *versions; // struct sdp_out_version, one per session, empty if not passed through
+};
+
+struct sdp_out_version {
+	size_t pos;
+	size_t len;
+};
+
+uint64_t sdp_input_fingerprint(const str *sdp, GQueue *sessions, uint64_t h) {
+	const char *start = sdp->s;
+	const char *end = sdp->s + sdp->len;
+
+	for (GList *l = sessions->head; l; l = l->next) {
+		struct sdp_session *session = l->data;
+		str *version = &session->origin.version_str;
+		if (!version->s || version->s < start || version->s + version->len > end)
+			continue;
+		h = fnv1a_64(h, start, version->s - start);
+		start = version->s + version->len;
+	}
+
+	return fnv1a_64(h, start, end - start);
+}
+
+int sdp_replace_cached(struct sdp_chopper *chop, GQueue *sessions, struct call_monologue *monologue,
+		uint64_t input_fp, uint64_t state_fp)
+{
+	struct sdp_out_cache *c = monologue->sdp_out_cache;
+
+	if (!c)
+		return -1;
+	if (c->input_fp != input_fp || c->state_fp != state_fp)
+		return -1;
+	if (c->versions->len && c->versions->len != sessions->length)
+		return -1;
+
+	g_string_truncate(chop->output, 0);
+
+	// copy the cached output, with the o= versions taken from the new input
+	size_t pos = 0;
+	GList *l = sessions->head;
+	for (unsigned int i = 0; i < c->versions->len; i++, l = l->next) {
+		struct sdp_out_version *v = &g_array_index(c->versions, struct sdp_out_version, i);
+		struct sdp_session *session = l->data;
+		g_string_append_len(chop->output, c->output->str + pos, v->pos - pos);
+		g_string_append_len(chop->output, session->origin.version_str.s,
+				session->origin.version_str.len);
+		pos = v->pos + v->len;
+	}
+	g_string_append_len(chop->output, c->output->str + pos, c->output->len - pos);
+
+	ilog(LOG_DEBUG, "Reusing cached SDP output (%zu bytes)", chop->output->len);
+	return 0;
+}
+
+void sdp_out_cache_update(struct call_monologue *monologue, const struct sdp_chopper *chop,
+		GQueue *sessions, const struct sdp_ng_flags *flags,
+		uint64_t input_fp, uint64_t state_before, uint64_t state_after)
+{
+	if (state_before != state_after) {
+		// not a fixpoint: repeating this negotiation would change things again
+		sdp_out_cache_free(monologue);
+		return;
+	}
+
+	struct sdp_out_cache *c = monologue->sdp_out_cache;
+	if (!c) {
+		c = g_slice_alloc0(sizeof(*c));
+		c->output = g_string_sized_new(chop->output->len);
+		c->versions = g_array_new(FALSE, FALSE, sizeof(struct sdp_out_version));
+		monologue->sdp_out_cache = c;
+	}
+	c->input_fp = input_fp;
+	c->state_fp = state_after;
+	g_string_truncate(c->output, 0);
+	g_string_append_len(c->output, chop->output->str, chop->output->len);
+
+	// with replace-sdp-version, our own version is unchanged as long as the output is, so
+	// there's nothing to patch. otherwise the version is passed through from the input
+	g_array_set_size(c->versions, 0);
+	if (flags->replace_sdp_version)
+		return;
+	for (GList *l = sessions->head; l; l = l->next) {
+		struct sdp_session *session = l->data;
+		struct sdp_out_version v = {
+			.pos = session->origin.version_output_pos,
+			.len = session->origin.version_str.len,
+		};
+		if (v.pos + v.len > c->output->len || (c->versions->len
+					&& v.pos < g_array_index(c->versions, struct sdp_out_version,
+						c->versions->len - 1).pos))
+		{
+			// can't patch this reliably
+			sdp_out_cache_free(monologue);
+			return;
+		}
+		g_array_append_val(c->versions, v);
+	}
+}
+
+void sdp_out_cache_free(struct call_monologue *monologue) {
+	struct sdp_out_cache *c = monologue->sdp_out_cache;
+	if (!c)
+		return;
+	g_string_free(c->output, TRUE);
+	g_array_free(c->versions, TRUE);
+	g_slice_free1(sizeof(*c), c);
+	monologue->sdp_out_cache = NULL;
+}
+
 int sdp_create(str *out, struct call_monologue *monologue, struct sdp_ng_flags *flags) {
 	if (!monologue->medias.length)
 		return -1; // need at least one media
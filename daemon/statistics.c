@@ -474,6 +474,8 @@ GQueue *statistics_gather_metrics(void) {
 	METRIC("sessionstotal", "Total sessions", UINT64F, UINT64F, cur_sessions);
 	METRIC("transcodedmedia", "Transcoded media", UINT64F, UINT64F, atomic64_get(&rtpe_stats.transcoded_media));
 	PROM("transcoded_media", "gauge");
+	METRIC("rediswritequeue", "Calls pending a Redis write", UINT64F, UINT64F, atomic64_get(&rtpe_stats.redis_write_queue));
+	PROM("redis_write_queue", "gauge");
 
 	METRIC("packetrate", "Packets per second", UINT64F, UINT64F, atomic64_get(&rtpe_stats.packets));
 	METRIC("byterate", "Bytes per second", UINT64F, UINT64F, atomic64_get(&rtpe_stats.bytes));
@@ -526,6 +528,19 @@ GQueue *statistics_gather_metrics(void) {
 	PROM("zero_packet_streams_total", "counter");
 	METRIC("onewaystreams", "Total number of 1-way streams", UINT64F, UINT64F,atomic64_get(&rtpe_totalstats.total_oneway_stream_sess));
 	PROM("one_way_sessions_total", "counter");
+
+	uint64_t redis_batches = atomic64_get(&rtpe_totalstats.total_redis_write_batches);
+	uint64_t redis_time = atomic64_get(&rtpe_totalstats.total_redis_write_time);
+	uint64_t redis_avg = redis_batches ? redis_time / redis_batches : 0;
+	METRIC("rediswrites", "Total call states written to Redis", UINT64F, UINT64F, atomic64_get(&rtpe_totalstats.total_redis_writes));
+	PROM("redis_writes_total", "counter");
+	METRIC("rediswritebatches", "Total pipelined Redis write batches", UINT64F, UINT64F, redis_batches);
+	PROM("redis_write_batches_total", "counter");
+	METRIC("rediswritetime", "Total Redis write time in microseconds", UINT64F, UINT64F, redis_time);
+	PROM("redis_write_microseconds_total", "counter");
+	METRICva("avgrediswritelatency", "Average Redis write batch latency", "%llu.%06llu", "%llu.%06llu sec",
+			(unsigned long long) redis_avg / 1000000, (unsigned long long) redis_avg % 1000000);
+
 	METRICva("avgcallduration", "Average call duration", "%ld.%06ld", "%ld.%06ld", avg.tv_sec, avg.tv_usec);
 
 	mutex_lock(&rtpe_totalstats_lastinterval_lock);
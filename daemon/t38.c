@@ -15,14 +15,44 @@
 #include "str.h"
 #include "media_player.h"
 #include "log_funcs.h"
+#include "main.h"
 
 
 
+#define T38_MAX_QUEUED 50 // input jobs per gateway, about one second of audio
+
+
 struct udptl_packet {
 	seq_packet_t p;
 	str *s;
 };
 
+struct t38_job {
+	struct t38_gateway *tg; // holds reference
+	struct call *call; // holds reference
+	bool udptl;
+	unsigned int len; // UDPTL bytes or PCM samples
+	char data[0];
+};
+
+struct t38_worker {
+	mutex_t lock;
+	cond_t cond;
+	GQueue jobs;
+};
+
+
+static struct t38_worker *t38_workers;
+static int t38_worker_rr;
+
+
+
+static uint64_t __thread_cpu_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 
 
 static void __add_udptl_len(GString *s, const void *buf, unsigned int len) {
@@ -243,6 +273,8 @@ static int t38_gateway_handler(t38_core_state_t *stat, void *user_data, const ui
 void __t38_gateway_free(void *p) {
 	struct t38_gateway *tg = p;
 	ilog(LOG_DEBUG, "Destroying T.38 gateway");
+	ilog(LOG_INFO, "T.38 gateway used %" PRIu64 " ms of CPU time, %lu inputs dropped",
+			tg->cpu_ns / 1000000, tg->dropped);
 	if (tg->gw)
 		t38_gateway_free(tg->gw);
 	if (tg->pcm_player) {
@@ -273,7 +305,9 @@ static void t38_pcm_player(struct media_player *mp) {
 	mutex_lock(&tg->lock);
 
 	int16_t smp[80];
+	uint64_t cpu = __thread_cpu_ns();
 	int num = t38_gateway_tx(tg->gw, smp, 80);
+	tg->cpu_ns += __thread_cpu_ns() - cpu;
 	if (num <= 0) {
 		// use a fixed interval of 10 ms
 		timeval_add_usec(&mp->next_run, 10000);
@@ -369,6 +403,8 @@ int t38_gateway_pair(struct call_media *t38_media, struct call_media *pcm_media,
 	tg->udptl_fec = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
 			(GDestroyNotify) __udptl_packet_free);
 	tg->options = opts;
+	if (t38_workers)
+		tg->worker = (unsigned int) g_atomic_int_add(&t38_worker_rr, 1) % rtpe_config.t38_num_threads;
 
 	tg->pcm_pt.payload_type = -1;
 	str_init(&tg->pcm_pt.encoding, "PCM-S16LE");
@@ -492,22 +528,67 @@ void t38_gateway_start(struct t38_gateway *tg) {
 
 
 // call is locked in R
-int t38_gateway_input_samples(struct t38_gateway *tg, int16_t amp[], int len) {
-	if (!tg)
-		return 0;
-	if (len <= 0)
-		return 0;
+static void t38_worker_push(struct t38_gateway *tg, bool udptl, const void *data, unsigned int len,
+		size_t bytes)
+{
+	struct t38_worker *w = &t38_workers[tg->worker];
+
+	mutex_lock(&w->lock);
+	if (tg->queued >= T38_MAX_QUEUED) {
+		tg->dropped++;
+		mutex_unlock(&w->lock);
+		ilog(LOG_WARN | LOG_FLAG_LIMIT, "T.38 gateway is falling behind, discarding %s",
+				udptl ? "UDPTL packet" : "PCM samples");
+		return;
+	}
 
+	struct t38_job *job = g_malloc(sizeof(*job) + bytes);
+	job->tg = obj_get(tg);
+	job->call = obj_get(tg->pcm_media->call);
+	job->udptl = udptl;
+	job->len = len;
+	memcpy(job->data, data, bytes);
+
+	tg->queued++;
+	g_queue_push_tail(&w->jobs, job);
+	cond_signal(&w->cond);
+	mutex_unlock(&w->lock);
+}
+
+static void t38_job_free(struct t38_job *job) {
+	obj_put(job->tg);
+	obj_put(job->call);
+	g_free(job);
+}
+
+
+// call is locked in R
+static void __t38_gateway_input_samples(struct t38_gateway *tg, int16_t amp[], int len) {
 	ilog(LOG_DEBUG, "Adding %i samples to T.38 encoder", len);
 
 	mutex_lock(&tg->lock);
 
+	uint64_t cpu = __thread_cpu_ns();
 	int left = t38_gateway_rx(tg->gw, amp, len);
+	tg->cpu_ns += __thread_cpu_ns() - cpu;
 	if (left)
 		ilog(LOG_WARN | LOG_FLAG_LIMIT, "%i PCM samples were not processed by the T.38 gateway",
 				left);
 
 	mutex_unlock(&tg->lock);
+}
+
+// call is locked in R
+int t38_gateway_input_samples(struct t38_gateway *tg, int16_t amp[], int len) {
+	if (!tg)
+		return 0;
+	if (len <= 0)
+		return 0;
+
+	if (t38_workers)
+		t38_worker_push(tg, false, amp, len, len * sizeof(*amp));
+	else
+		__t38_gateway_input_samples(tg, amp, len);
 
 	return 0;
 }
@@ -559,15 +640,11 @@ static void __fec_save(struct t38_gateway *tg, const str *piece, uint16_t seq) {
 	g_hash_table_insert(tg->udptl_fec, GUINT_TO_POINTER(seq), up);
 }
 
-int t38_gateway_input_udptl(struct t38_gateway *tg, const str *buf) {
+// call is locked in R
+static int __t38_gateway_input_udptl(struct t38_gateway *tg, const str *buf) {
 	const char *err = NULL;
 	struct udptl_packet *up = NULL;
 
-	if (!tg)
-		return 0;
-	if (!buf || !buf->len)
-		return 0;
-
 	if (buf->len < 4) {
 		ilog(LOG_INFO | LOG_FLAG_LIMIT, "Ignoring short UDPTL packet (%zu bytes)", buf->len);
 		return 0;
@@ -738,6 +815,7 @@ int t38_gateway_input_udptl(struct t38_gateway *tg, const str *buf) {
 seq_ok:;
 
 	t38_core_state_t *t38 = t38_gateway_get_t38_core_state(tg->gw);
+	uint64_t cpu = __thread_cpu_ns();
 
 	// process any packets that we can
 	while (1) {
@@ -752,6 +830,8 @@ seq_ok:;
 		__udptl_packet_free(up);
 	}
 
+	tg->cpu_ns += __thread_cpu_ns() - cpu;
+
 out:
 	mutex_unlock(&tg->lock);
 	return 0;
@@ -767,6 +847,71 @@ err_nolock:
 }
 
 
+// call is locked in R
+int t38_gateway_input_udptl(struct t38_gateway *tg, const str *buf) {
+	if (!tg)
+		return 0;
+	if (!buf || !buf->len)
+		return 0;
+
+	if (!t38_workers)
+		return __t38_gateway_input_udptl(tg, buf);
+
+	t38_worker_push(tg, true, buf->s, buf->len, buf->len);
+	return 0;
+}
+
+
+static void t38_job_run(struct t38_job *job) {
+	struct call *call = job->call;
+	struct t38_gateway *tg = job->tg;
+
+	log_info_call(call);
+	rwlock_lock_r(&call->master_lock);
+
+	// skip gateways that have been replaced or shut down in the meantime
+	if (tg->pcm_media && tg->pcm_media->t38_gateway == tg) {
+		if (job->udptl) {
+			str s;
+			str_init_len(&s, job->data, job->len);
+			__t38_gateway_input_udptl(tg, &s);
+		}
+		else
+			__t38_gateway_input_samples(tg, (int16_t *) job->data, job->len);
+	}
+
+	rwlock_unlock_r(&call->master_lock);
+	log_info_clear();
+}
+
+void t38_worker_loop(void *p) {
+	struct t38_worker *w = &t38_workers[GPOINTER_TO_UINT(p)];
+
+	struct thread_waker waker = { .lock = &w->lock, .cond = &w->cond };
+	thread_waker_add(&waker);
+
+	mutex_lock(&w->lock);
+	while (!rtpe_shutdown) {
+		struct t38_job *job = g_queue_pop_head(&w->jobs);
+		if (!job) {
+			cond_wait(&w->cond, &w->lock);
+			continue;
+		}
+		job->tg->queued--;
+		mutex_unlock(&w->lock);
+
+		gettimeofday(&rtpe_now, NULL);
+		t38_job_run(job);
+		t38_job_free(job);
+
+		mutex_lock(&w->lock);
+	}
+	mutex_unlock(&w->lock);
+
+	thread_waker_del(&waker);
+}
+
+
 void t38_gateway_stop(struct t38_gateway *tg) {
 	if (!tg)
 		return;
@@ -779,6 +924,26 @@ void t38_gateway_stop(struct t38_gateway *tg) {
 
 void t38_init(void) {
 	my_span_mh(NULL);
+
+	if (rtpe_config.t38_num_threads > 0) {
+		t38_workers = g_new0(struct t38_worker, rtpe_config.t38_num_threads);
+		for (int i = 0; i < rtpe_config.t38_num_threads; i++) {
+			mutex_init(&t38_workers[i].lock);
+			cond_init(&t38_workers[i].cond);
+		}
+	}
+}
+
+void t38_free(void) {
+	if (!t38_workers)
+		return;
+	for (int i = 0; i < rtpe_config.t38_num_threads; i++) {
+		g_queue_clear_full(&t38_workers[i].jobs, (GDestroyNotify) t38_job_free);
+		mutex_destroy(&t38_workers[i].lock);
+		cond_destroy(&t38_workers[i].cond);
+	}
+	g_free(t38_workers);
+	t38_workers = NULL;
 }
 
 
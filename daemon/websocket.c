@@ -400,20 +400,28 @@ static const char *websocket_cli_process(struct websocket_message *wm) {
 }
 
 
-static void websocket_ng_send_ws(str *cookie, str *body, const endpoint_t *sin, void *p1) {
+static void websocket_ng_queue_body(struct websocket_conn *wc, struct iovec *iov, unsigned int iovcnt) {
+	for (unsigned int i = NG_REPLY_IOV_HEAD; i < iovcnt; i++)
+		websocket_queue_raw(wc, iov[i].iov_base, iov[i].iov_len);
+}
+static void websocket_ng_send_ws(str *cookie, struct iovec *iov, unsigned int iovcnt, size_t body_len,
+		const endpoint_t *sin, void *p1)
+{
 	struct websocket_conn *wc = p1;
 	websocket_queue_raw(wc, cookie->s, cookie->len);
 	websocket_queue_raw(wc, " ", 1);
-	websocket_queue_raw(wc, body->s, body->len);
+	websocket_ng_queue_body(wc, iov, iovcnt);
 	websocket_write_binary(wc, NULL, 0, 1);
 }
-static void websocket_ng_send_http(str *cookie, str *body, const endpoint_t *sin, void *p1) {
+static void websocket_ng_send_http(str *cookie, struct iovec *iov, unsigned int iovcnt, size_t body_len,
+		const endpoint_t *sin, void *p1)
+{
 	struct websocket_conn *wc = p1;
-	if (websocket_http_response(wc, 200, "application/x-rtpengine-ng", cookie->len + 1 + body->len))
+	if (websocket_http_response(wc, 200, "application/x-rtpengine-ng", cookie->len + 1 + body_len))
 		ilogs(http, LOG_WARN, "Failed to write HTTP headers");
 	websocket_queue_raw(wc, cookie->s, cookie->len);
 	websocket_queue_raw(wc, " ", 1);
-	websocket_queue_raw(wc, body->s, body->len);
+	websocket_ng_queue_body(wc, iov, iovcnt);
 	websocket_write_http(wc, NULL, 1);
 }
 
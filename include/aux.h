@@ -281,6 +281,18 @@ INLINE void swap_ptrs(void *a, void *b) {
 	*bb = t;
 }
 
+/* 64-bit FNV-1a, for cheap fingerprinting of state */
+#define FNV1A_64_INIT 0xcbf29ce484222325ULL
+INLINE uint64_t fnv1a_64(uint64_t h, const void *p, size_t len) {
+	const unsigned char *c = p;
+	for (size_t i = 0; i < len; i++) {
+		h ^= c[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+#define fnv1a_64_val(h, v) fnv1a_64(h, &(v), sizeof(v))
+
 INLINE int rlim(int res, rlim_t val) {
 	struct rlimit rlim;
 
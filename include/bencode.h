@@ -16,6 +16,7 @@ typedef enum bencode_type bencode_type_t;
 typedef struct bencode_buffer bencode_buffer_t;
 typedef struct bencode_item bencode_item_t;
 typedef void (*free_func_t)(void *);
+typedef int (*bencode_key_lookup_t)(const char *, size_t);
 
 enum bencode_type {
 	BENCODE_INVALID = 0,
@@ -41,6 +42,7 @@ struct bencode_buffer {
 	struct __bencode_buffer_piece *pieces;
 	struct __bencode_free_list *free_list;
 	unsigned int error:1;	/* set to !0 if allocation failed at any point */
+	unsigned int incomplete:1; /* set to !0 by the decoder if the input ended prematurely */
 };
 
 
@@ -287,6 +289,13 @@ INLINE bencode_item_t *bencode_decode_expect(bencode_buffer_t *buf, const char *
 /* Identical to bencode_decode_expect() but takes a "str" argument. */
 INLINE bencode_item_t *bencode_decode_expect_str(bencode_buffer_t *buf, const str *s, bencode_type_t expect);
 
+/* Identical to bencode_decode(), but suitable for decoding from a stream of consecutive documents.
+ * Decoding is strict: containers must be terminated and numbers must be well-formed. On success, the
+ * number of bytes consumed by the decoded document is returned in *used. On failure, NULL is returned
+ * and *used is set to -1 if more bytes are needed or -2 on error, making a separate validation pass
+ * through bencode_valid() unnecessary. */
+bencode_item_t *bencode_decode_prefix(bencode_buffer_t *buf, const char *s, size_t len, ssize_t *used);
+
 /* Returns the number of bytes that could successfully be decoded from 's', -1 if more bytes are needed or -2 on error */
 ssize_t bencode_valid(const char *s, size_t len);
 
@@ -301,6 +310,13 @@ INLINE bencode_item_t *bencode_dictionary_get(bencode_item_t *dict, const char *
 /* Identical to bencode_dictionary_get() but doesn't require the key to be null-terminated. */
 bencode_item_t *bencode_dictionary_get_len(bencode_item_t *dict, const char *key, size_t key_len);
 
+/* Builds a direct-mapped index of well-known keys for a dictionary created through the decoding
+ * process. "lookup" must map a key to a unique number between 0 and "num" - 1 (e.g. through a perfect
+ * hash), or return -1 for unknown keys. Subsequent lookups of well-known keys through the
+ * bencode_dictionary_get_* functions then take constant time regardless of the number of keys
+ * present, including lookups of keys that are absent. Returns 0 on success. */
+int bencode_dictionary_index(bencode_item_t *dict, bencode_key_lookup_t lookup, unsigned int num);
+
 /* Identical to bencode_dictionary_get() but returns the value only if its type is a string, and
  * returns it as a pointer to the string itself. Returns NULL if the value is of some other type. The
  * returned string is NOT null-terminated. Length of the string is returned in *len, which must be a
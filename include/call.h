@@ -215,6 +215,7 @@ struct jitter_buffer;
 struct codec_tracker;
 struct rtcp_timer;
 struct mqtt_timer;
+struct sdp_out_cache;
 
 
 typedef bencode_buffer_t call_buffer_t;
@@ -410,6 +411,7 @@ struct call_monologue {
 	GQueue			last_in_sdp_parsed;
 	GQueue			last_in_sdp_streams;
 	GString			*last_out_sdp;
+	struct sdp_out_cache	*sdp_out_cache;
 	char			*sdp_username;
 	char			*sdp_session_name;
 	struct ssrc_hash	*ssrc_hash;
@@ -482,6 +484,11 @@ struct call {
 	sockaddr_t		xmlrpc_callback;
 
 	unsigned int		redis_hosted_db;
+	mutex_t			redis_lock; // protects the delta update state below
+	GHashTable		*redis_fields; // delta updates: hash field -> fingerprint of the last written value
+	uint64_t		redis_generation;
+	unsigned int		redis_writes; // delta updates in flight
+	int			redis_overlap; // writes were in flight concurrently, next one must be complete
 
 	struct recording 	*recording;
 	str			metadata;
@@ -544,6 +551,7 @@ int call_get_mono_dialogue(struct call_monologue *dialogue[2], struct call *call
 struct call_monologue *call_get_monologue(struct call *call, const str *fromtag);
 struct call *call_get(const str *callid);
 int monologue_offer_answer(struct call_monologue *dialogue[2], GQueue *streams, struct sdp_ng_flags *flags);
+uint64_t dialogue_state_fingerprint(struct call_monologue *dialogue[2]);
 void codecs_offer_answer(struct call_media *media, struct call_media *other_media,
 		struct stream_params *sp, struct sdp_ng_flags *flags);
 int call_delete_branch(const str *callid, const str *branch,
@@ -39,6 +39,7 @@ struct codec_handler {
 	unsigned int kernelize:1;
 	unsigned int transcoder:1;
 	unsigned int pcm_dtmf_detect:1;
+	unsigned int direct:1;
 
 	struct ssrc_hash *ssrc_hash;
 	struct codec_handler *input_handler; // == main handler for supp codecs
@@ -48,6 +49,7 @@ struct codec_handler {
 #ifdef WITH_TRANSCODING
 	int (*packet_encoded)(encoder_t *enc, void *u1, void *u2);
 	int (*packet_decoded)(decoder_t *, AVFrame *, void *, void *);
+	volatile unsigned int direct_ssrc; // input SSRC last repacketized
 #endif
 
 	// for media playback
@@ -83,6 +85,8 @@ struct codec_handler *codec_handler_get(struct call_media *, int payload_type, s
 void codec_handlers_free(struct call_media *);
 struct codec_handler *codec_handler_make_playback(const struct rtp_payload_type *src_pt,
 		const struct rtp_payload_type *dst_pt, unsigned long ts, struct call_media *);
+struct codec_handler *codec_handler_make_playback_cached(const struct rtp_payload_type *dst_pt,
+		unsigned long ts, struct call_media *);
 void codec_calc_jitter(struct ssrc_ctx *, unsigned long ts, unsigned int clockrate, const struct timeval *);
 
 void codec_store_cleanup(struct codec_store *cs);
@@ -125,6 +129,8 @@ void codec_decoder_skip_pts(struct codec_ssrc_handler *ch, uint64_t);
 uint64_t codec_decoder_unskip_pts(struct codec_ssrc_handler *ch);
 void codec_tracker_update(struct codec_store *);
 void codec_handlers_stop(GQueue *);
+void codec_worker_loop(void *);
+void codec_dtx_start(void);
 
 #else
 
@@ -59,6 +59,12 @@ struct ng_buffer {
 	struct obj *ref;
 };
 
+// Replies are passed to the sending callback as an array of `iovcnt` iovecs. The first
+// NG_REPLY_IOV_HEAD elements are unused and are available to the callback to prepend the cookie.
+#define NG_REPLY_IOV_HEAD 2
+typedef void (*ng_reply_func_t)(str *cookie, struct iovec *iov, unsigned int iovcnt, size_t body_len,
+		const endpoint_t *, void *);
+
 extern const char *ng_command_strings[NGC_COUNT];
 extern const char *ng_command_strings_short[NGC_COUNT];
 
@@ -67,8 +73,8 @@ struct control_ng *control_ng_tcp_new(struct poller *, endpoint_t *, struct cont
 void notify_ng_tcp_clients(str *);
 void control_ng_init(void);
 void control_ng_cleanup(void);
-int control_ng_process(str *buf, const endpoint_t *sin, char *addr,
-		void (*cb)(str *, str *, const endpoint_t *, void *), void *p1, struct obj *);
+int control_ng_process(str *buf, const endpoint_t *sin, char *addr, ng_reply_func_t cb, void *p1,
+		struct obj *);
 
 INLINE void ng_buffer_release(struct ng_buffer *ngbuf) {
 	mutex_unlock(&ngbuf->lock);
@@ -2,26 +2,44 @@
 #define _COOKIE_CACHE_H_
 
 #include <time.h>
+#include <sys/uio.h>
 #include <glib.h>
 #include "aux.h"
+#include "obj.h"
 #include "str.h"
 
-struct cookie_cache_state {
-	GHashTable *in_use;
-	GHashTable *cookies;
+#define COOKIE_CACHE_SHARDS	32
+#define COOKIE_CACHE_GEN_SECS	30
+
+struct cookie_cache_entry {
+	struct obj obj;
+	str cookie;
+	str reply;
+	time_t generation;
+	cond_t cond;		// per-cookie waiters, protected by the shard lock
+	unsigned int done:1;
+	unsigned int removed:1;
 };
 
-struct cookie_cache {
+struct cookie_cache_shard {
 	mutex_t lock;
-	cond_t cond;
-	struct cookie_cache_state current, old;
-	time_t swap_time;
+	GHashTable *entries;	// str * -> struct cookie_cache_entry *
+	time_t generation;
+};
+
+struct cookie_cache {
+	struct cookie_cache_shard shards[COOKIE_CACHE_SHARDS];
 };
 
 void cookie_cache_init(struct cookie_cache *);
-str *cookie_cache_lookup(struct cookie_cache *, const str *);
+struct cookie_cache_entry *cookie_cache_lookup(struct cookie_cache *, const str *);
 void cookie_cache_insert(struct cookie_cache *, const str *, const str *);
+void cookie_cache_insert_iov(struct cookie_cache *, const str *, const struct iovec *, unsigned int, size_t);
 void cookie_cache_remove(struct cookie_cache *, const str *);
 void cookie_cache_cleanup(struct cookie_cache *);
 
+INLINE void cookie_cache_entry_put(struct cookie_cache_entry *e) {
+	obj_put(e);
+}
+
 #endif
@@ -17,6 +17,19 @@ struct jb_packet {
 	struct media_packet mp;
 };
 
+// one entry of the sequence-indexed ring used with --jb-adaptive
+struct jb_slot {
+	char *buf; // kept and reused for following packets
+	unsigned int size; // allocated
+	unsigned int len;
+	bool used;
+	uint16_t seq;
+	long long ts_us; // media time relative to base_ts
+	struct stream_fd *sfd;
+	endpoint_t fsin;
+	struct timeval tv;
+};
+
 struct jitter_buffer {
 	struct timerthread_queue ttq;
 	mutex_t        		lock;
@@ -39,6 +52,25 @@ struct jitter_buffer {
 	int                     clock_drift_val;
 	struct call             *call;
 	int			disabled;
+
+	// --jb-adaptive only
+	struct jb_slot		*slots;
+	unsigned int		slots_mask;
+	unsigned int		ring_count; // used slots
+	bool			ring_started;
+	unsigned int		ring_clock_rate; // of the stream being buffered
+	bool			draining; // release everything regardless of time
+	bool			releasing; // a thread is busy sending packets out
+	uint16_t		next_seq; // next to be played out
+	uint16_t		last_seq;
+	uint32_t		base_ts;
+	uint32_t		last_ts;
+	long long		ref_transit; // arrival time minus media time, low watermark
+	long long		prev_transit;
+	long long		jitter; // RFC 3550 interarrival jitter, in us
+	long long		delay; // current playout delay, in us
+	long long		interval; // packet interval, in us
+	struct timeval		armed; // timer is scheduled for this time
 };
 
 void jitter_buffer_init(void);
@@ -50,6 +50,8 @@ struct rtpengine_config {
 	endpoint_t		graphite_ep;
 	int			graphite_interval;
 	int			redis_num_threads;
+	int			redis_restore_batch;
+	int			redis_notify_batch;
 	GQueue			interfaces;
 	endpoint_t		tcp_listen_ep;
 	endpoint_t		udp_listen_ep;
@@ -74,11 +76,16 @@ struct rtpengine_config {
 	int			redis_connect_timeout;
 	int			redis_delete_async;
 	int			redis_delete_async_interval;
+	int			redis_update_async;
+	int			redis_delta_updates;
 	char			*redis_auth;
 	char			*redis_write_auth;
 	int			active_switchover;
 	int			num_threads;
 	int			media_num_threads;
+	int			transcode_num_threads;
+	int			t38_num_threads;
+	int			codec_pool;
 	char			*spooldir;
 	char			*rec_method;
 	char			*rec_format;
@@ -96,12 +103,17 @@ struct rtpengine_config {
 	char			*mysql_user;
 	char			*mysql_pass;
 	char			*mysql_query;
+	int			player_cache_size;
+	int			mysql_cache_size;
+	int			mysql_cache_ttl;
 	endpoint_t		dtmf_udp_ep;
 	int			dtmf_via_ng;
 	int			dtmf_no_suppress;
+	int			dtmf_spandsp;
 	enum endpoint_learning	endpoint_learning;
 	int                     jb_length;
 	int                     jb_clock_drift;
+	int                     jb_adaptive;
 	int			dtls_rsa_key_size;
 	int			dtls_mtu;
 	char			*dtls_ciphers;
@@ -124,6 +136,9 @@ struct rtpengine_config {
 	int			reorder_codecs;
 	char			*software_id;
 	int			poller_per_thread;
+	int			reuse_sdp;
+	int			socket_pool_low;
+	int			socket_pool_high;
 	char			*mqtt_host;
 	int			mqtt_port;
 	char			*mqtt_id;
@@ -147,6 +162,10 @@ struct rtpengine_config {
 		MOS_CQ = 0,
 		MOS_LQ,
 	}			mos;
+	enum {
+		REDIS_FORMAT_JSON = 0,
+		REDIS_FORMAT_BINARY,
+	}			redis_format;
 };
 
 
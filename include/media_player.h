@@ -17,6 +17,7 @@ struct packet_stream;
 struct codec_packet;
 struct media_player;
 struct rtp_payload_type;
+struct media_player_cache_entry;
 
 
 #ifdef WITH_TRANSCODING
@@ -53,6 +54,14 @@ struct media_player {
 	AVIOContext *avioctx;
 	str *blob;
 	str read_pos;
+
+	// pre-encoded playback
+	struct media_player_cache_entry *cache_entry; // playing from this
+	struct media_player_cache_entry *cache_build; // or recording into this
+	unsigned int cache_pos;
+	unsigned long cache_ts; // added to the cached timestamps, for repeats
+
+	unsigned int db_serial; // bumped on every stop, to discard outdated database fetches
 };
 
 INLINE void media_player_put(struct media_player **mp) {
@@ -99,6 +108,11 @@ void media_player_add_packet(struct media_player *mp, char *buf, size_t len,
 void media_player_init(void);
 void media_player_free(void);
 void media_player_loop(void *);
+void media_player_db_loop(void *);
+unsigned int media_player_db_run(void);
+
+// returns a newly allocated blob or NULL. can be replaced for testing
+extern str *(*media_player_db_fetch)(long long id);
 
 struct send_timer *send_timer_new(struct packet_stream *);
 void send_timer_push(struct send_timer *, struct codec_packet *);
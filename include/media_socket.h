@@ -84,6 +84,12 @@ struct port_pool {
 	mutex_t				free_list_lock;
 	GQueue				free_list;
 	BIT_ARRAY_DECLARE(free_list_used, 0x10000);
+
+	mutex_t				prebound_lock;
+	GQueue				prebound; /* socket_t, RTP/RTCP pairs ready for use */
+	volatile unsigned int		prebound_ports;
+	atomic64			prebound_retry; // monotonic time of the next refill after a failure
+	unsigned int			prebound_backoff; // refill thread only
 };
 struct intf_address {
 	socktype_t			*type;
@@ -161,6 +167,7 @@ struct logical_intf *get_logical_interface(const str *name, sockfamily_t *fam, i
 struct local_intf *get_interface_address(const struct logical_intf *lif, sockfamily_t *fam);
 struct local_intf *get_any_interface_address(const struct logical_intf *lif, sockfamily_t *fam);
 void interfaces_exclude_port(unsigned int port);
+void socket_pool_loop(void *);
 int is_local_endpoint(const struct intf_address *addr, unsigned int port);
 
 //int get_port(socket_t *r, unsigned int port, const struct local_intf *lif, const struct call *c);
@@ -195,6 +202,7 @@ int media_packet_encrypt(rewrite_func encrypt_func, struct packet_stream *out, s
 const struct transport_protocol *transport_protocol(const str *s);
 //void play_buffered(struct packet_stream *sink, struct codec_packet *cp, int buffered);
 void play_buffered(struct jb_packet *cp);
+void play_buffered_raw(struct stream_fd *sfd, const endpoint_t *fsin, const struct timeval *tv, const str *s);
 
 /* XXX shouldn't be necessary */
 /*
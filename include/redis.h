@@ -17,6 +17,8 @@
 
 
 #define REDIS_RESTORE_NUM_THREADS 4
+#define REDIS_WRITE_BATCH 256
+#define REDIS_NOTIFY_BATCH 1024
 
 
 enum redis_role {
@@ -36,6 +38,12 @@ enum event_base_action {
 	EVENT_BASE_LOOPBREAK,
 };
 
+enum redis_write_op {
+	REDIS_WRITE_NONE = 0,
+	REDIS_WRITE_UPDATE,
+	REDIS_WRITE_DELETE, // overrides a pending update
+};
+
 enum subscribe_action {
 	SUBSCRIBE_KEYSPACE = 0,
 	UNSUBSCRIBE_KEYSPACE,
@@ -68,6 +76,17 @@ struct redis {
 	mutex_t                   async_lock;
 	GQueue                    async_queue;
 	int                       async_last;
+
+	mutex_t			write_lock;
+	cond_t			write_cond;
+	GHashTable		*write_calls; // struct call * -> enum redis_write_op
+	GQueue			write_queue; // struct call *, holds a reference
+
+	mutex_t			notify_lock;
+	cond_t			notify_cond;
+	GHashTable		*notify_calls; // "<db>:<call-id>" -> struct redis_notify_entry
+	GQueue			notify_queue; // struct redis_notify_entry
+	struct timeval		notify_first; // arrival of the oldest queued notification
 };
 
 struct redis_hash {
@@ -104,6 +123,8 @@ INLINE gboolean g_hash_table_insert_check(GHashTable *h, gpointer k, gpointer v)
 
 void redis_notify_loop(void *d);
 void redis_delete_async_loop(void *d);
+void redis_write_loop(void *d);
+void redis_notify_batch_loop(void *d);
 
 
 struct redis *redis_new(const endpoint_t *, int, const char *, enum redis_role, int);
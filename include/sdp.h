@@ -26,6 +26,13 @@ int sdp_replace(struct sdp_chopper *, GQueue *, struct call_monologue *, struct
 int sdp_is_duplicate(GQueue *sessions);
 int sdp_create(str *out, struct call_monologue *, struct sdp_ng_flags *flags);
 
+uint64_t sdp_input_fingerprint(const str *sdp, GQueue *sessions, uint64_t h);
+int sdp_replace_cached(struct sdp_chopper *, GQueue *, struct call_monologue *, uint64_t input_fp,
+		uint64_t state_fp);
+void sdp_out_cache_update(struct call_monologue *, const struct sdp_chopper *, GQueue *,
+		const struct sdp_ng_flags *, uint64_t input_fp, uint64_t state_before, uint64_t state_after);
+void sdp_out_cache_free(struct call_monologue *);
+
 struct sdp_chopper *sdp_chopper_new(str *input);
 void sdp_chopper_destroy(struct sdp_chopper *chop);
 
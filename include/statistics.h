@@ -23,6 +23,7 @@ struct stats {
 	atomic64			ipv4_sessions;
 	atomic64			ipv6_sessions;
 	atomic64			mixed_sessions;
+	atomic64			redis_write_queue;
 };
 
 
@@ -56,6 +57,9 @@ struct totalstats {
 	atomic64		total_relayed_bytes;
 	atomic64		total_nopacket_relayed_sess;
 	atomic64		total_oneway_stream_sess;
+	atomic64		total_redis_writes;
+	atomic64		total_redis_write_batches;
+	atomic64		total_redis_write_time; // in microseconds
 
 	uint64_t		foreign_sessions;
 	uint64_t		own_sessions;
@@ -71,11 +71,20 @@ struct t38_gateway {
 	// player for PCM data
 	struct media_player *pcm_player;
 	unsigned long long pts;
+
+	// with --t38-num-threads
+	unsigned int worker; // index into the worker pool
+	unsigned int queued; // input jobs waiting, protected by the worker's lock
+	unsigned long dropped; // ditto
+
+	uint64_t cpu_ns; // spent in spandsp, protected by ->lock
 };
 
 
 
 void t38_init(void);
+void t38_free(void);
+void t38_worker_loop(void *);
 
 int t38_gateway_pair(struct call_media *t38_media, struct call_media *pcm_media, const struct t38_options *);
 void t38_gateway_start(struct t38_gateway *);
@@ -98,6 +107,7 @@ INLINE void t38_gateway_put(struct t38_gateway **tp) {
 
 // stubs
 INLINE void t38_init(void) { }
+INLINE void t38_free(void) { }
 INLINE void t38_gateway_start(struct t38_gateway *tg) { }
 INLINE void t38_gateway_stop(struct t38_gateway *tg) { }
 INLINE void t38_gateway_put(struct t38_gateway **tp) { }
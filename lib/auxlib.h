@@ -107,6 +107,7 @@ typedef pthread_cond_t cond_t;
 #define rwlock_unlock_w(l) __debug_rwlock_unlock_w(l, __FILE__, __LINE__)
 
 #define cond_init(c) __debug_cond_init(c, __FILE__, __LINE__)
+#define cond_destroy(c) __debug_cond_destroy(c, __FILE__, __LINE__)
 #define cond_wait(c,m) __debug_cond_wait(c,m, __FILE__, __LINE__)
 #define cond_timedwait(c,m,t) __debug_cond_timedwait(c,m,t, __FILE__, __LINE__)
 #define cond_signal(c) __debug_cond_signal(c, __FILE__, __LINE__)
@@ -136,6 +137,7 @@ INLINE int __cond_timedwait_tv(cond_t *c, mutex_t *m, const struct timeval *tv)
 #define __debug_rwlock_unlock_w(l, F, L) pthread_rwlock_unlock(l)
 
 #define __debug_cond_init(c, F, L) pthread_cond_init(c, NULL)
+#define __debug_cond_destroy(c, F, L) pthread_cond_destroy(c)
 #define __debug_cond_wait(c, m, F, L) pthread_cond_wait(c,m)
 #define __debug_cond_timedwait(c, m, t, F, L) __cond_timedwait_tv(c,m,t)
 #define __debug_cond_signal(c, F, L) pthread_cond_signal(c)
@@ -207,6 +209,7 @@ INLINE int __debug_rwlock_unlock_w(rwlock_t *m, const char *file, unsigned int l
 }
 
 #define __debug_cond_init(c, F, L) pthread_cond_init(c, NULL)
+#define __debug_cond_destroy(c, F, L) pthread_cond_destroy(c)
 #define __debug_cond_wait(c, m, F, L) pthread_cond_wait(c,m)
 #define __debug_cond_timedwait(c, m, t, F, L) __cond_timedwait_tv(c,m,t)
 #define __debug_cond_signal(c, F, L) pthread_cond_signal(c)
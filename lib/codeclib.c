@@ -5,6 +5,7 @@
 #include <libavutil/opt.h>
 #include <glib.h>
 #include <arpa/inet.h>
+#include <assert.h>
 #ifdef HAVE_BCG729
 #include <bcg729/encoder.h>
 #include <bcg729/decoder.h>
@@ -16,10 +17,13 @@
 #include "rtplib.h"
 #include "bitstr.h"
 #include "dtmflib.h"
+#include "dsp.h"
 
 
 
 #define PACKET_SEQ_DUPE_THRES 100
+#define PACKET_SEQ_RING_SIZE 128 // power of two, larger than PACKET_SEQ_DUPE_THRES
+#define PACKET_SEQ_RING_MASK (PACKET_SEQ_RING_SIZE - 1)
 #define PACKET_TS_RESET_THRES 5000 // milliseconds
 
 
@@ -585,6 +589,259 @@ const codec_def_t *codec_find_by_av(enum AVCodecID id) {
 
 
 
+// idle libav contexts that have already been opened, for one combination of everything
+// that went into opening them. also the template to open more in the background
+struct codec_pool {
+	char *key;
+	GQueue contexts; // AVCodecContext *
+	int filling;
+	unsigned int requests;
+	unsigned int refs; // decoders/encoders that will return a context to this pool
+	gint64 last_used;
+	GList link; // in codec_pool_lru
+
+	int encoder;
+	const codec_def_t *def;
+	format_t format;
+	int bitrate;
+	int ptime;
+	char *fmtp;
+	char *extra_opts;
+};
+
+static unsigned int codec_pool_size;
+static mutex_t codec_pool_lock = MUTEX_STATIC_INIT;
+static GHashTable *codec_pools; // char * -> struct codec_pool
+static GQueue codec_pool_lru; // least recently used first
+static GThreadPool *codec_pool_filler;
+static __thread int codec_pool_filling;
+
+#define CODEC_POOL_MAX_KEYS	64
+#define CODEC_POOL_IDLE_US	(5 * 60 * 1000000LL)
+
+static void codec_pool_free(void *p);
+
+// lock must be held. pools that are in use or being filled are never evicted. evicted
+// pools are moved to `out` so that their contexts can be freed without holding the lock
+static void codec_pool_evict(GQueue *out, gint64 now) {
+	GList *l = codec_pool_lru.head;
+	while (l) {
+		struct codec_pool *pool = l->data;
+		l = l->next;
+		if (g_hash_table_size(codec_pools) < CODEC_POOL_MAX_KEYS
+				&& now - pool->last_used < CODEC_POOL_IDLE_US)
+			break;
+		if (pool->refs || pool->filling)
+			continue;
+		g_queue_unlink(&codec_pool_lru, &pool->link);
+		g_hash_table_steal(codec_pools, pool->key);
+		g_queue_push_tail(out, pool);
+	}
+}
+
+// returns an already opened context if there is one. `*poolp` is set either way if pooling
+// is possible, so that the context can be returned to the pool when closed
+static AVCodecContext *codec_pool_get(struct codec_pool **poolp, int encoder, const codec_def_t *def,
+		const format_t *format, int bitrate, int ptime, const str *fmtp, const str *extra_opts)
+{
+	AVCodecContext *ret = NULL;
+	GQueue evicted = G_QUEUE_INIT;
+	gint64 now = g_get_monotonic_time();
+
+	*poolp = NULL;
+	if (!codec_pools || codec_pool_filling)
+		return NULL;
+	// a pooled encoder is used as it was opened, which only works for codecs that
+	// can also have their contexts returned. this also leaves out encoders such as
+	// AMR whose set_enc_options() sets up state outside of the context
+#ifdef AV_CODEC_CAP_ENCODER_FLUSH
+	if (encoder && !(def->encoder->capabilities & AV_CODEC_CAP_ENCODER_FLUSH))
+		return NULL;
+#else
+	if (encoder)
+		return NULL;
+#endif
+
+	AUTO_CLEANUP_GBUF(key);
+	key = g_strdup_printf("%c/%s/%i/%i/%i/%i/%i/" STR_FORMAT "/" STR_FORMAT,
+			encoder ? 'e' : 'd', def->rtpname,
+			format->clockrate, format->channels, format->format, bitrate, ptime,
+			STR_FMT0(fmtp), STR_FMT0(extra_opts));
+
+	mutex_lock(&codec_pool_lock);
+
+	struct codec_pool *pool = g_hash_table_lookup(codec_pools, key);
+	if (pool)
+		g_queue_unlink(&codec_pool_lru, &pool->link);
+	else {
+		codec_pool_evict(&evicted, now);
+		pool = g_slice_alloc0(sizeof(*pool));
+		pool->link.data = pool;
+		pool->key = key;
+		pool->encoder = encoder;
+		pool->def = def;
+		pool->format = *format;
+		pool->bitrate = bitrate;
+		pool->ptime = ptime;
+		pool->fmtp = fmtp ? g_strndup(fmtp->s, fmtp->len) : NULL;
+		pool->extra_opts = extra_opts ? g_strndup(extra_opts->s, extra_opts->len) : NULL;
+		g_hash_table_insert(codec_pools, pool->key, pool);
+		key = NULL;
+	}
+	g_queue_push_tail_link(&codec_pool_lru, &pool->link);
+	pool->last_used = now;
+	pool->requests++;
+	pool->refs++;
+
+	ret = g_queue_pop_head(&pool->contexts);
+
+	// top up in the background, but only for configurations that are seen repeatedly
+	if (pool->requests > 1 && pool->contexts.length < codec_pool_size / 2 + 1 && !pool->filling) {
+		pool->filling = 1;
+		g_thread_pool_push(codec_pool_filler, pool, NULL);
+	}
+
+	mutex_unlock(&codec_pool_lock);
+
+	g_queue_clear_full(&evicted, codec_pool_free);
+
+	*poolp = pool;
+	return ret;
+}
+
+// releases the reference taken by codec_pool_get()
+static void codec_pool_release(struct codec_pool *pool) {
+	if (!pool)
+		return;
+	mutex_lock(&codec_pool_lock);
+	pool->refs--;
+	pool->last_used = g_get_monotonic_time();
+	g_queue_unlink(&codec_pool_lru, &pool->link);
+	g_queue_push_tail_link(&codec_pool_lru, &pool->link);
+	mutex_unlock(&codec_pool_lock);
+}
+
+// returns 1 if the context was taken. the reference to the pool must be released
+// separately either way
+static int codec_pool_put(struct codec_pool *pool, AVCodecContext *ctx) {
+	if (!pool)
+		return 0;
+
+	if (pool->encoder) {
+		// encoder state can only be reset if the codec supports it
+#ifdef AV_CODEC_CAP_ENCODER_FLUSH
+		if (!(ctx->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH))
+			return 0;
+#else
+		return 0;
+#endif
+	}
+
+	mutex_lock(&codec_pool_lock);
+	if (pool->contexts.length >= codec_pool_size) {
+		mutex_unlock(&codec_pool_lock);
+		return 0;
+	}
+	mutex_unlock(&codec_pool_lock);
+
+	avcodec_flush_buffers(ctx);
+
+	// the pool may have been filled up in the meantime, in which case the caller frees the context
+	int ret = 0;
+	mutex_lock(&codec_pool_lock);
+	if (pool->contexts.length < codec_pool_size) {
+		g_queue_push_tail(&pool->contexts, ctx);
+		ret = 1;
+	}
+	mutex_unlock(&codec_pool_lock);
+	return ret;
+}
+
+// opens a context in the same way as avc_decoder_init/avc_encoder_init would
+static AVCodecContext *codec_pool_open(struct codec_pool *pool) {
+	AVCodecContext *ret = NULL;
+	str fmtp, extra_opts;
+
+	if (pool->fmtp)
+		str_init(&fmtp, pool->fmtp);
+	if (pool->extra_opts)
+		str_init(&extra_opts, pool->extra_opts);
+
+	if (pool->encoder) {
+		encoder_t *enc = encoder_new();
+		enc->def = pool->def;
+		enc->requested_format = pool->format;
+		enc->bitrate = pool->bitrate;
+		enc->ptime = pool->ptime;
+		if (!avc_encoder_init(enc, pool->fmtp ? &fmtp : NULL, pool->extra_opts ? &extra_opts : NULL)) {
+			ret = enc->u.avc.avcctx;
+			enc->u.avc.avcctx = NULL;
+		}
+		encoder_free(enc);
+	}
+	else {
+		decoder_t *dec = g_slice_alloc0(sizeof(*dec));
+		dec->def = pool->def;
+		dec->in_format = pool->format;
+		dec->ptime = pool->ptime;
+		if (!avc_decoder_init(dec, pool->fmtp ? &fmtp : NULL, pool->extra_opts ? &extra_opts : NULL)) {
+			ret = dec->u.avc.avcctx;
+			dec->u.avc.avcctx = NULL;
+		}
+		avc_decoder_close(dec);
+		g_slice_free1(sizeof(*dec), dec);
+	}
+
+	return ret;
+}
+
+static void codec_pool_fill(void *p, void *d) {
+	struct codec_pool *pool = p;
+
+	codec_pool_filling = 1;
+
+	while (1) {
+		mutex_lock(&codec_pool_lock);
+		if (pool->contexts.length >= codec_pool_size)
+			break;
+		mutex_unlock(&codec_pool_lock);
+
+		AVCodecContext *ctx = codec_pool_open(pool);
+
+		mutex_lock(&codec_pool_lock);
+		if (!ctx)
+			break;
+		g_queue_push_tail(&pool->contexts, ctx);
+		mutex_unlock(&codec_pool_lock);
+	}
+
+	pool->filling = 0;
+	mutex_unlock(&codec_pool_lock);
+}
+
+static void codec_pool_free(void *p) {
+	struct codec_pool *pool = p;
+	AVCodecContext *ctx;
+
+	while ((ctx = g_queue_pop_head(&pool->contexts)))
+		avcodec_free_context(&ctx);
+	g_free(pool->key);
+	g_free(pool->fmtp);
+	g_free(pool->extra_opts);
+	g_slice_free1(sizeof(*pool), pool);
+}
+
+void codeclib_pool_init(unsigned int size) {
+	codec_pool_size = size;
+	if (!size)
+		return;
+	codec_pools = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, codec_pool_free);
+	codec_pool_filler = g_thread_pool_new(codec_pool_fill, NULL, 1, FALSE, NULL);
+}
+
+
+
+
 static const char *avc_decoder_init(decoder_t *dec, const str *fmtp, const str *extra_opts) {
 	AVCodec *codec = dec->def->decoder;
 	if (!codec)
@@ -592,7 +849,10 @@ static const char *avc_decoder_init(decoder_t *dec, const str *fmtp, const str *
 
 	dec->u.avc.avpkt = av_packet_alloc();
 
-	dec->u.avc.avcctx = avcodec_alloc_context3(codec);
+	AVCodecContext *pooled = codec_pool_get(&dec->u.avc.pool, 0, dec->def, &dec->in_format, 0,
+			dec->ptime, fmtp, extra_opts);
+
+	dec->u.avc.avcctx = pooled ? : avcodec_alloc_context3(codec);
 	if (!dec->u.avc.avcctx)
 		return "failed to alloc codec context";
 	dec->u.avc.avcctx->channels = dec->in_format.channels;
@@ -601,9 +861,14 @@ static const char *avc_decoder_init(decoder_t *dec, const str *fmtp, const str *
 	if (dec->def->set_dec_options)
 		dec->def->set_dec_options(dec, fmtp, extra_opts);
 
+	if (pooled)
+		return NULL;
+
 	int i = avcodec_open2(dec->u.avc.avcctx, codec, NULL);
 	if (i) {
 		ilog(LOG_ERR | LOG_FLAG_LIMIT, "Error returned from libav: %s", av_error(i));
+		codec_pool_release(dec->u.avc.pool);
+		dec->u.avc.pool = NULL;
 		return "failed to open codec context";
 	}
 
@@ -716,6 +981,10 @@ gboolean decoder_has_dtx(decoder_t *dec) {
 
 
 static void avc_decoder_close(decoder_t *dec) {
+	if (dec->u.avc.avcctx && codec_pool_put(dec->u.avc.pool, dec->u.avc.avcctx))
+		dec->u.avc.avcctx = NULL;
+	codec_pool_release(dec->u.avc.pool);
+	dec->u.avc.pool = NULL;
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(56, 1, 0)
 	avcodec_free_context(&dec->u.avc.avcctx);
 #else
@@ -982,11 +1251,69 @@ static void avc_def_init(codec_def_t *def) {
 }
 
 void codeclib_free(void) {
+	if (codec_pool_filler)
+		g_thread_pool_free(codec_pool_filler, TRUE, TRUE);
+	codec_pool_filler = NULL;
+	if (codec_pools)
+		g_hash_table_destroy(codec_pools);
+	codec_pools = NULL;
+	g_queue_init(&codec_pool_lru);
 	g_hash_table_destroy(codecs_ht);
 	g_hash_table_destroy(codecs_ht_by_av);
 	avformat_network_deinit();
 }
 
+// direct G.711 A-law <> mu-law translation
+unsigned char g711_alaw2ulaw[256];
+unsigned char g711_ulaw2alaw[256];
+
+static int __g711_alaw_decode(unsigned char a) {
+	a ^= 0x55;
+	int t = (a & 0x0f) << 4;
+	int seg = (a & 0x70) >> 4;
+	if (seg == 0)
+		t += 8;
+	else
+		t = (t + 0x108) << (seg - 1);
+	return (a & 0x80) ? t : -t;
+}
+static int __g711_ulaw_decode(unsigned char u) {
+	u = ~u;
+	int t = (((u & 0x0f) << 3) + 0x84) << ((u & 0x70) >> 4);
+	return (u & 0x80) ? (0x84 - t) : (t - 0x84);
+}
+// 14-bit linear to A-law or mu-law, rounding to the nearest level in the same way as
+// the libavcodec PCM encoders, so that the translation gives the same output as
+// decoding and encoding
+static void __g711_linear_table(unsigned char *tab, int (*decode)(unsigned char), unsigned char mask) {
+	int j = 1;
+	tab[8192] = mask;
+	for (int i = 0; i < 127; i++) {
+		int v = (decode(i ^ mask) + decode((i + 1) ^ mask) + 4) >> 3;
+		for (; j < v; j++) {
+			tab[8192 - j] = i ^ (mask ^ 0x80);
+			tab[8192 + j] = i ^ mask;
+		}
+	}
+	for (; j < 8192; j++) {
+		tab[8192 - j] = 127 ^ (mask ^ 0x80);
+		tab[8192 + j] = 127 ^ mask;
+	}
+	tab[0] = tab[1];
+}
+static void __g711_init(void) {
+	unsigned char *alaw = g_malloc(16384);
+	unsigned char *ulaw = g_malloc(16384);
+	__g711_linear_table(alaw, __g711_alaw_decode, 0xd5);
+	__g711_linear_table(ulaw, __g711_ulaw_decode, 0xff);
+	for (int i = 0; i < 256; i++) {
+		g711_alaw2ulaw[i] = ulaw[(__g711_alaw_decode(i) + 32768) >> 2];
+		g711_ulaw2alaw[i] = alaw[(__g711_ulaw_decode(i) + 32768) >> 2];
+	}
+	g_free(alaw);
+	g_free(ulaw);
+}
+
 void codeclib_init(int print) {
 #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 9, 100)
 	av_register_all();
@@ -995,6 +1322,8 @@ void codeclib_init(int print) {
 #endif
 	avformat_network_init();
 	av_log_set_callback(avlog_ilog);
+	dsp_init();
+	__g711_init();
 
 	codecs_ht = g_hash_table_new(str_case_hash, str_case_equal);
 	codecs_ht_by_av = g_hash_table_new(g_direct_hash, g_direct_equal);
@@ -1071,100 +1400,75 @@ void codeclib_init(int print) {
 
 
 
-static int ptr_cmp(const void *a, const void *b, void *dummy) {
-	if (a < b)
-		return -1;
-	if (a > b)
-		return 1;
-	return 0;
-}
-
 void __packet_sequencer_init(packet_sequencer_t *ps, GDestroyNotify ffunc) {
-	ps->packets = g_tree_new_full(ptr_cmp, NULL, NULL, ffunc);
+	ps->packets = g_new0(seq_packet_t *, PACKET_SEQ_RING_SIZE);
+	ps->free_func = ffunc;
 	ps->seq = -1;
 }
+static void __packet_sequencer_clear(packet_sequencer_t *ps) {
+	for (unsigned int i = 0; i < PACKET_SEQ_RING_SIZE && ps->num_packets; i++) {
+		seq_packet_t *p = ps->packets[i];
+		if (!p)
+			continue;
+		ps->packets[i] = NULL;
+		ps->num_packets--;
+		if (ps->free_func)
+			ps->free_func(p);
+	}
+}
 void packet_sequencer_destroy(packet_sequencer_t *ps) {
-	if (ps->packets)
-		g_tree_destroy(ps->packets);
+	if (!ps->packets)
+		return;
+	__packet_sequencer_clear(ps);
+	g_free(ps->packets);
 	ps->packets = NULL;
 }
-struct tree_searcher {
-	int find_seq,
-	    found_seq;
-};
-static int packet_tree_search(const void *testseq_p, const void *ts_p) {
-	struct tree_searcher *ts = (void *) ts_p;
-	int testseq = GPOINTER_TO_INT(testseq_p);
-	// called as a binary search test function. we're looking for the lowest
-	// seq number that is higher than find_seq. if our test number is too low,
-	// we proceed with higher numbers. if it's too high, we proceed to the lower
-	// numbers, but remember the lowest we've seen along that path.
-	if (G_UNLIKELY(testseq == ts->find_seq)) {
-		// we've struck gold
-		ts->found_seq = testseq;
-		return 0;
-	}
-	if (testseq < ts->find_seq)
-		return 1;
-	// testseq > ts->find_seq
-	if (ts->found_seq == -1 || testseq < ts->found_seq)
-		ts->found_seq = testseq;
-	return -1;
+// all packets held are within PACKET_SEQ_DUPE_THRES ahead of the next expected seq,
+// so each has its own slot in the ring
+INLINE seq_packet_t *__packet_sequencer_get(packet_sequencer_t *ps, int seq) {
+	seq_packet_t *p = ps->packets[seq & PACKET_SEQ_RING_MASK];
+	if (p && p->seq == seq)
+		return p;
+	return NULL;
 }
 // caller must take care of locking
 static void *__packet_sequencer_next_packet(packet_sequencer_t *ps, int num_wait) {
 	// see if we have a packet with the correct seq nr in the queue
-	seq_packet_t *packet = g_tree_lookup(ps->packets, GINT_TO_POINTER(ps->seq));
+	seq_packet_t *packet = __packet_sequencer_get(ps, ps->seq);
 	if (G_LIKELY(packet != NULL)) {
 		cdbg("returning in-sequence packet (seq %i)", ps->seq);
 		goto out;
 	}
 
 	// why not? do we have anything? (we should)
-	int nnodes = g_tree_nnodes(ps->packets);
-	if (G_UNLIKELY(nnodes == 0)) {
+	if (G_UNLIKELY(ps->num_packets == 0)) {
 		cdbg("packet queue empty");
 		return NULL;
 	}
-	if (G_LIKELY(nnodes < num_wait)) {
-		cdbg("only %i packets in queue - waiting for more", nnodes);
+	if (G_LIKELY(ps->num_packets < num_wait)) {
+		cdbg("only %u packets in queue - waiting for more", ps->num_packets);
 		return NULL; // need to wait for more
 	}
 
-	// packet was probably lost. search for the next highest seq
-	struct tree_searcher ts = { .find_seq = ps->seq + 1, .found_seq = -1 };
-	packet = g_tree_search(ps->packets, packet_tree_search, &ts);
-	if (packet) {
-		// bullseye
-		cdbg("lost packet - returning packet with next seq %i", packet->seq);
-		goto out;
-	}
-	if (G_UNLIKELY(ts.found_seq == -1)) {
-		// didn't find anything. seq must have wrapped around. retry
-		// starting from zero
-		ts.find_seq = 0;
-		packet = g_tree_search(ps->packets, packet_tree_search, &ts);
-		if (packet) {
-			cdbg("lost packet - returning packet with next seq %i (after wrap)", packet->seq);
-			goto out;
-		}
-		if (G_UNLIKELY(ts.found_seq == -1))
-			abort();
+	// packet was probably lost. search for the next highest seq, which is
+	// the next occupied slot in the ring, allowing for wrap-around
+	for (unsigned int i = 1; i < PACKET_SEQ_RING_SIZE; i++) {
+		packet = ps->packets[(ps->seq + i) & PACKET_SEQ_RING_MASK];
+		if (packet)
+			break;
 	}
-
-	// pull out the packet we found
-	packet = g_tree_lookup(ps->packets, GINT_TO_POINTER(ts.found_seq));
 	if (G_UNLIKELY(packet == NULL))
 		abort();
 
-	cdbg("lost multiple packets - returning packet with next highest seq %i", packet->seq);
+	cdbg("lost packet(s) - returning packet with next highest seq %i", packet->seq);
 
 out:
 	;
 	uint16_t l = packet->seq - ps->seq;
 	ps->lost_count += l;
 
-	g_tree_steal(ps->packets, GINT_TO_POINTER(packet->seq));
+	ps->packets[packet->seq & PACKET_SEQ_RING_MASK] = NULL;
+	ps->num_packets--;
 	ps->seq = (packet->seq + 1) & 0xffff;
 
 	if (packet->seq < ps->ext_seq)
@@ -1181,7 +1485,7 @@ void *packet_sequencer_force_next_packet(packet_sequencer_t *ps) {
 }
 
 int packet_sequencer_next_ok(packet_sequencer_t *ps) {
-	if (g_tree_lookup(ps->packets, GINT_TO_POINTER(ps->seq)))
+	if (__packet_sequencer_get(ps, ps->seq))
 		return 1;
 	return 0;
 }
@@ -1215,11 +1519,13 @@ int packet_sequencer_insert(packet_sequencer_t *ps, seq_packet_t *p) {
 	ps->seq = p->seq;
 	ret = 1;
 	// seq ok - fall through
-	g_tree_clear(ps->packets);
-seq_ok:
-	if (g_tree_lookup(ps->packets, GINT_TO_POINTER(p->seq)))
+	__packet_sequencer_clear(ps);
+seq_ok:;
+	seq_packet_t **slot = &ps->packets[p->seq & PACKET_SEQ_RING_MASK];
+	if (*slot)
 		return -1;
-	g_tree_insert(ps->packets, GINT_TO_POINTER(p->seq), p);
+	*slot = p;
+	ps->num_packets++;
 
 	return ret;
 }
@@ -1239,7 +1545,10 @@ static const char *avc_encoder_init(encoder_t *enc, const str *fmtp, const str *
 	if (!enc->u.avc.codec)
 		return "output codec not found";
 
-	enc->u.avc.avcctx = avcodec_alloc_context3(enc->u.avc.codec);
+	AVCodecContext *pooled = codec_pool_get(&enc->u.avc.pool, 1, enc->def, &enc->requested_format,
+			enc->bitrate, enc->ptime, fmtp, extra_opts);
+
+	enc->u.avc.avcctx = pooled ? : avcodec_alloc_context3(enc->u.avc.codec);
 	if (!enc->u.avc.avcctx)
 		return "failed to alloc codec context";
 
@@ -1257,6 +1566,17 @@ static const char *avc_encoder_init(encoder_t *enc, const str *fmtp, const str *
 	cdbg("using output sample format %s for codec %s",
 			av_get_sample_fmt_name(enc->actual_format.format), enc->u.avc.codec->name);
 
+	enc->samples_per_frame = enc->actual_format.clockrate * enc->ptime / 1000;
+	enc->samples_per_packet = enc->samples_per_frame;
+
+	if (pooled) {
+		// already opened with the same settings, which are all part of the pool key
+		assert(pooled->sample_rate == enc->actual_format.clockrate);
+		assert(pooled->channels == enc->actual_format.channels);
+		assert(pooled->sample_fmt == enc->actual_format.format);
+		return NULL;
+	}
+
 	enc->u.avc.avcctx->channels = enc->actual_format.channels;
 	enc->u.avc.avcctx->channel_layout = av_get_default_channel_layout(enc->actual_format.channels);
 	enc->u.avc.avcctx->sample_rate = enc->actual_format.clockrate;
@@ -1264,10 +1584,10 @@ static const char *avc_encoder_init(encoder_t *enc, const str *fmtp, const str *
 	enc->u.avc.avcctx->time_base = (AVRational){1,enc->actual_format.clockrate};
 	enc->u.avc.avcctx->bit_rate = enc->bitrate;
 
-	enc->samples_per_frame = enc->actual_format.clockrate * enc->ptime / 1000;
-	if (enc->u.avc.avcctx->frame_size)
+	if (enc->u.avc.avcctx->frame_size) {
 		enc->samples_per_frame = enc->u.avc.avcctx->frame_size;
-	enc->samples_per_packet = enc->samples_per_frame;
+		enc->samples_per_packet = enc->samples_per_frame;
+	}
 
 	if (enc->def->set_enc_options)
 		enc->def->set_enc_options(enc, fmtp, extra_opts);
@@ -1275,6 +1595,8 @@ static const char *avc_encoder_init(encoder_t *enc, const str *fmtp, const str *
 	int i = avcodec_open2(enc->u.avc.avcctx, enc->u.avc.codec, NULL);
 	if (i) {
 		ilog(LOG_ERR | LOG_FLAG_LIMIT, "Error returned from libav: %s", av_error(i));
+		codec_pool_release(enc->u.avc.pool);
+		enc->u.avc.pool = NULL;
 		return "failed to open output context";
 	}
 
@@ -1330,8 +1652,11 @@ int encoder_config_fmtp(encoder_t *enc, const codec_def_t *def, int bitrate, int
 		if (av_frame_get_buffer(enc->frame, 0) < 0)
 			abort();
 
+		// room for a partial frame plus a full decoded input frame, so that
+		// the fifo doesn't need to grow during normal operation
 		enc->fifo = av_audio_fifo_alloc(enc->frame->format, enc->actual_format.channels,
-				enc->frame->nb_samples);
+				enc->frame->nb_samples * 4);
+		enc->slice = av_frame_alloc();
 
 		ilog(LOG_DEBUG, "Initialized encoder with frame size %u samples", enc->frame->nb_samples);
 	}
@@ -1351,12 +1676,14 @@ err:
 }
 
 static void avc_encoder_close(encoder_t *enc) {
-	if (enc->u.avc.avcctx) {
+	if (enc->u.avc.avcctx && !codec_pool_put(enc->u.avc.pool, enc->u.avc.avcctx)) {
 		avcodec_close(enc->u.avc.avcctx);
 		avcodec_free_context(&enc->u.avc.avcctx);
 	}
 	enc->u.avc.avcctx = NULL;
 	enc->u.avc.codec = NULL;
+	codec_pool_release(enc->u.avc.pool);
+	enc->u.avc.pool = NULL;
 }
 
 void encoder_close(encoder_t *enc) {
@@ -1368,6 +1695,7 @@ void encoder_close(encoder_t *enc) {
 	format_init(&enc->actual_format);
 	av_audio_fifo_free(enc->fifo);
 	av_frame_free(&enc->frame);
+	av_frame_free(&enc->slice);
 	enc->mux_dts = 0;
 	enc->fifo = NULL;
 	enc->fifo_pts = 0;
@@ -1495,6 +1823,10 @@ static int encoder_fifo_flush(encoder_t *enc,
 {
 	while (av_audio_fifo_size(enc->fifo) >= enc->frame->nb_samples) {
 
+		// the encoder may still hold a reference to the previous frame
+		if (av_frame_make_writable(enc->frame) < 0)
+			return -1;
+
 		if (av_audio_fifo_read(enc->fifo, (void **) enc->frame->data,
 					enc->frame->nb_samples) <= 0)
 			abort();
@@ -1510,13 +1842,78 @@ static int encoder_fifo_flush(encoder_t *enc,
 	return 0;
 }
 
+// can the encoder's frames be taken straight out of this frame's buffers?
+static bool encoder_can_slice(encoder_t *enc, AVFrame *frame) {
+	if (!frame->buf[0])
+		return false; // not refcounted
+	if (frame->extended_data != frame->data)
+		return false; // too many planes
+	if (frame->format != enc->frame->format)
+		return false;
+	if (frame->channel_layout != enc->frame->channel_layout)
+		return false;
+	return true;
+}
+
+// pointers to the sample data of `frame`, starting at sample `offset`
+static void frame_data_offset(void **ptrs, AVFrame *frame, int channels, int offset) {
+	int bps = av_get_bytes_per_sample(frame->format);
+	if (av_sample_fmt_is_planar(frame->format)) {
+		for (int i = 0; i < channels; i++)
+			ptrs[i] = frame->data[i] + offset * bps;
+	}
+	else
+		ptrs[0] = frame->data[0] + offset * bps * channels;
+}
+
 int encoder_input_fifo(encoder_t *enc, AVFrame *frame,
 		int (*callback)(encoder_t *, void *u1, void *u2), void *u1, void *u2)
 {
-	if (av_audio_fifo_write(enc->fifo, (void **) frame->extended_data, frame->nb_samples) < 0)
-		return -1;
+	if (!encoder_can_slice(enc, frame)) {
+		if (av_audio_fifo_write(enc->fifo, (void **) frame->extended_data, frame->nb_samples) < 0)
+			return -1;
+		return encoder_fifo_flush(enc, callback, u1, u2);
+	}
 
-	return encoder_fifo_flush(enc, callback, u1, u2);
+	int channels = enc->actual_format.channels;
+	int frame_size = enc->frame->nb_samples;
+	int pos = 0;
+	void *ptrs[AV_NUM_DATA_POINTERS];
+
+	// complete a partial frame left over from before
+	int fill = av_audio_fifo_size(enc->fifo);
+	if (fill) {
+		pos = MIN(frame_size - fill, frame->nb_samples);
+		if (av_audio_fifo_write(enc->fifo, (void **) frame->extended_data, pos) < 0)
+			return -1;
+		if (encoder_fifo_flush(enc, callback, u1, u2))
+			return -1;
+	}
+
+	// then pass all complete frames to the encoder by reference, without copying
+	while (frame->nb_samples - pos >= frame_size) {
+		if (av_frame_ref(enc->slice, frame) < 0)
+			return -1;
+		frame_data_offset((void **) enc->slice->data, frame, channels, pos);
+		enc->slice->nb_samples = frame_size;
+		enc->slice->pts = enc->fifo_pts;
+
+		cdbg("output slice pts %lu", (unsigned long) enc->fifo_pts);
+		encoder_input_data(enc, enc->slice, callback, u1, u2);
+		av_frame_unref(enc->slice);
+
+		enc->fifo_pts += frame_size;
+		pos += frame_size;
+	}
+
+	// and keep the rest for later
+	if (pos < frame->nb_samples) {
+		frame_data_offset(ptrs, frame, channels, pos);
+		if (av_audio_fifo_write(enc->fifo, ptrs, frame->nb_samples - pos) < 0)
+			return -1;
+	}
+
+	return 0;
 }
 
 
@@ -60,6 +60,7 @@ struct seq_packet_s;
 struct rtp_payload_type;
 union codec_options_u;
 struct dtx_method_s;
+struct codec_pool;
 
 typedef struct codec_type_s codec_type_t;
 typedef struct decoder_s decoder_t;
@@ -176,6 +177,8 @@ struct format_s {
 struct resample_s {
 	SwrContext *swresample;
 	bool no_filter;
+	AVFrame *frame; // recycled output frame for resample_frame_reuse()
+	int frame_capacity; // in samples
 };
 
 enum codec_event {
@@ -213,6 +216,7 @@ struct decoder_s {
 		struct {
 			AVCodecContext *avcctx;
 			AVPacket *avpkt;
+			struct codec_pool *pool; // to return avcctx to
 
 			union {
 				struct {
@@ -251,6 +255,7 @@ struct encoder_s {
 		struct {
 			AVCodec *codec;
 			AVCodecContext *avcctx;
+			struct codec_pool *pool; // to return avcctx to
 
 			union {
 				struct {
@@ -275,6 +280,7 @@ struct encoder_s {
 	int samples_per_frame; // for encoding
 	int samples_per_packet; // for frame packetizer
 	AVFrame *frame; // to pull samples from the fifo
+	AVFrame *slice; // refers to the input frame's buffers, bypassing the fifo
 	int64_t mux_dts; // last dts passed to muxer
 };
 
@@ -282,7 +288,9 @@ struct seq_packet_s {
 	int seq;
 };
 struct packet_sequencer_s {
-	GTree *packets;
+	seq_packet_t **packets; // ring buffer indexed by seq
+	unsigned int num_packets;
+	GDestroyNotify free_func;
 	unsigned int lost_count;
 	int seq; // next expected
 	unsigned int ext_seq; // last received
@@ -292,9 +300,14 @@ struct packet_sequencer_s {
 
 extern const GQueue * const codec_supplemental_codecs;
 
+// direct G.711 A-law <> mu-law translation, same as decoding and encoding through libavcodec
+extern unsigned char g711_alaw2ulaw[256];
+extern unsigned char g711_ulaw2alaw[256];
+
 
 void codeclib_init(int);
 void codeclib_free(void);
+void codeclib_pool_init(unsigned int size);
 
 
 const codec_def_t *codec_find(const str *name, enum media_type);
@@ -397,6 +410,8 @@ INLINE void codeclib_init(int print) {
 INLINE void codeclib_free(void) {
 	;
 }
+INLINE void codeclib_pool_init(unsigned int size) {
+}
 
 INLINE const codec_def_t *codec_find(const str *name, enum media_type type) {
 	return NULL;
@@ -0,0 +1,283 @@
+#include "dsp.h"
+#include <string.h>
+#include "log.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DSP_X86 1
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__)
+#define DSP_NEON 1
+#include <arm_neon.h>
+#endif
+
+
+
+// scalar reference versions
+
+#define SCAN_SCALAR(type, suffix) \
+static unsigned int scan_ ## suffix ## _scalar(const type *s, unsigned int num, type thres, bool silent) { \
+	for (unsigned int i = 0; i < num; i++) { \
+		bool is_silent = (s[i] <= thres && s[i] >= -thres); \
+		if (is_silent != silent) \
+			return i; \
+	} \
+	return num; \
+}
+
+SCAN_SCALAR(int16_t, s16)
+SCAN_SCALAR(int32_t, s32)
+SCAN_SCALAR(float, flt)
+SCAN_SCALAR(double, dbl)
+
+static void goertzel8_scalar(float *v2, float *v3, const float *fac, const int16_t *s, unsigned int num) {
+	for (unsigned int i = 0; i < num; i++) {
+		float amp = s[i];
+		for (unsigned int k = 0; k < 8; k++) {
+			float v1 = v2[k];
+			v2[k] = v3[k];
+			v3[k] = fac[k] * v2[k] - v1 + amp;
+		}
+	}
+}
+
+static const struct dsp_funcs dsp_scalar = {
+	.name = "scalar",
+	.scan_s16 = scan_s16_scalar,
+	.scan_s32 = scan_s32_scalar,
+	.scan_flt = scan_flt_scalar,
+	.scan_dbl = scan_dbl_scalar,
+	.goertzel8 = goertzel8_scalar,
+};
+
+
+
+#ifdef DSP_X86
+
+// SSE2
+
+__attribute__((target("sse2")))
+static unsigned int scan_s16_sse2(const int16_t *s, unsigned int num, int16_t thres, bool silent) {
+	const __m128i hi = _mm_set1_epi16(thres);
+	const __m128i lo = _mm_set1_epi16(-thres);
+	unsigned int i = 0;
+	for (; i + 8 <= num; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+		__m128i loud = _mm_or_si128(_mm_cmpgt_epi16(v, hi), _mm_cmplt_epi16(v, lo));
+		unsigned int mask = _mm_movemask_epi8(loud); // two bits per sample
+		if (!silent)
+			mask = ~mask & 0xffff;
+		if (mask)
+			return i + __builtin_ctz(mask) / 2;
+	}
+	return i + scan_s16_scalar(s + i, num - i, thres, silent);
+}
+
+__attribute__((target("sse2")))
+static unsigned int scan_flt_sse2(const float *s, unsigned int num, float thres, bool silent) {
+	const __m128 thr = _mm_set1_ps(thres);
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	unsigned int i = 0;
+	for (; i + 4 <= num; i += 4) {
+		__m128 v = _mm_and_ps(_mm_loadu_ps(s + i), abs_mask);
+		unsigned int mask = _mm_movemask_ps(_mm_cmple_ps(v, thr)); // silent samples
+		if (silent)
+			mask = ~mask & 0xf;
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	return i + scan_flt_scalar(s + i, num - i, thres, silent);
+}
+
+__attribute__((target("sse2")))
+static void goertzel8_sse2(float *v2, float *v3, const float *fac, const int16_t *s, unsigned int num) {
+	__m128 f0 = _mm_loadu_ps(fac), f1 = _mm_loadu_ps(fac + 4);
+	__m128 a0 = _mm_loadu_ps(v2), a1 = _mm_loadu_ps(v2 + 4);
+	__m128 b0 = _mm_loadu_ps(v3), b1 = _mm_loadu_ps(v3 + 4);
+	for (unsigned int i = 0; i < num; i++) {
+		__m128 amp = _mm_set1_ps(s[i]);
+		__m128 n0 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(f0, b0), a0), amp);
+		__m128 n1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(f1, b1), a1), amp);
+		a0 = b0;
+		a1 = b1;
+		b0 = n0;
+		b1 = n1;
+	}
+	_mm_storeu_ps(v2, a0);
+	_mm_storeu_ps(v2 + 4, a1);
+	_mm_storeu_ps(v3, b0);
+	_mm_storeu_ps(v3 + 4, b1);
+}
+
+static const struct dsp_funcs dsp_sse2 = {
+	.name = "sse2",
+	.scan_s16 = scan_s16_sse2,
+	.scan_s32 = scan_s32_scalar,
+	.scan_flt = scan_flt_sse2,
+	.scan_dbl = scan_dbl_scalar,
+	.goertzel8 = goertzel8_sse2,
+};
+
+
+// AVX2
+
+__attribute__((target("avx2")))
+static unsigned int scan_s16_avx2(const int16_t *s, unsigned int num, int16_t thres, bool silent) {
+	const __m256i hi = _mm256_set1_epi16(thres);
+	const __m256i lo = _mm256_set1_epi16(-thres);
+	unsigned int i = 0;
+	for (; i + 16 <= num; i += 16) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) (s + i));
+		__m256i loud = _mm256_or_si256(_mm256_cmpgt_epi16(v, hi), _mm256_cmpgt_epi16(lo, v));
+		uint32_t mask = _mm256_movemask_epi8(loud); // two bits per sample
+		if (!silent)
+			mask = ~mask;
+		if (mask)
+			return i + __builtin_ctz(mask) / 2;
+	}
+	return i + scan_s16_sse2(s + i, num - i, thres, silent);
+}
+
+__attribute__((target("avx2")))
+static unsigned int scan_flt_avx2(const float *s, unsigned int num, float thres, bool silent) {
+	const __m256 thr = _mm256_set1_ps(thres);
+	const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	unsigned int i = 0;
+	for (; i + 8 <= num; i += 8) {
+		__m256 v = _mm256_and_ps(_mm256_loadu_ps(s + i), abs_mask);
+		unsigned int mask = _mm256_movemask_ps(_mm256_cmp_ps(v, thr, _CMP_LE_OQ)); // silent samples
+		if (silent)
+			mask = ~mask & 0xff;
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	return i + scan_flt_sse2(s + i, num - i, thres, silent);
+}
+
+__attribute__((target("avx2")))
+static void goertzel8_avx2(float *v2, float *v3, const float *fac, const int16_t *s, unsigned int num) {
+	// no FMA here, so that results are identical to the other versions
+	__m256 f = _mm256_loadu_ps(fac);
+	__m256 a = _mm256_loadu_ps(v2);
+	__m256 b = _mm256_loadu_ps(v3);
+	for (unsigned int i = 0; i < num; i++) {
+		__m256 n = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(f, b), a), _mm256_set1_ps(s[i]));
+		a = b;
+		b = n;
+	}
+	_mm256_storeu_ps(v2, a);
+	_mm256_storeu_ps(v3, b);
+}
+
+static const struct dsp_funcs dsp_avx2 = {
+	.name = "avx2",
+	.scan_s16 = scan_s16_avx2,
+	.scan_s32 = scan_s32_scalar,
+	.scan_flt = scan_flt_avx2,
+	.scan_dbl = scan_dbl_scalar,
+	.goertzel8 = goertzel8_avx2,
+};
+
+#endif
+
+
+
+#ifdef DSP_NEON
+
+static unsigned int scan_s16_neon(const int16_t *s, unsigned int num, int16_t thres, bool silent) {
+	const int16x8_t hi = vdupq_n_s16(thres);
+	const int16x8_t lo = vdupq_n_s16(-thres);
+	unsigned int i = 0;
+	for (; i + 8 <= num; i += 8) {
+		int16x8_t v = vld1q_s16(s + i);
+		uint16x8_t loud = vorrq_u16(vcgtq_s16(v, hi), vcltq_s16(v, lo));
+		// on a state change, let the scalar code find the exact position
+		if (silent ? vmaxvq_u16(loud) : !vminvq_u16(loud))
+			return i + scan_s16_scalar(s + i, 8, thres, silent);
+	}
+	return i + scan_s16_scalar(s + i, num - i, thres, silent);
+}
+
+static unsigned int scan_flt_neon(const float *s, unsigned int num, float thres, bool silent) {
+	const float32x4_t thr = vdupq_n_f32(thres);
+	unsigned int i = 0;
+	for (; i + 4 <= num; i += 4) {
+		uint32x4_t quiet = vcleq_f32(vabsq_f32(vld1q_f32(s + i)), thr);
+		if (silent ? !vminvq_u32(quiet) : vmaxvq_u32(quiet))
+			return i + scan_flt_scalar(s + i, 4, thres, silent);
+	}
+	return i + scan_flt_scalar(s + i, num - i, thres, silent);
+}
+
+static void goertzel8_neon(float *v2, float *v3, const float *fac, const int16_t *s, unsigned int num) {
+	float32x4_t f0 = vld1q_f32(fac), f1 = vld1q_f32(fac + 4);
+	float32x4_t a0 = vld1q_f32(v2), a1 = vld1q_f32(v2 + 4);
+	float32x4_t b0 = vld1q_f32(v3), b1 = vld1q_f32(v3 + 4);
+	for (unsigned int i = 0; i < num; i++) {
+		float32x4_t amp = vdupq_n_f32(s[i]);
+		float32x4_t n0 = vaddq_f32(vsubq_f32(vmulq_f32(f0, b0), a0), amp);
+		float32x4_t n1 = vaddq_f32(vsubq_f32(vmulq_f32(f1, b1), a1), amp);
+		a0 = b0;
+		a1 = b1;
+		b0 = n0;
+		b1 = n1;
+	}
+	vst1q_f32(v2, a0);
+	vst1q_f32(v2 + 4, a1);
+	vst1q_f32(v3, b0);
+	vst1q_f32(v3 + 4, b1);
+}
+
+static const struct dsp_funcs dsp_neon = {
+	.name = "neon",
+	.scan_s16 = scan_s16_neon,
+	.scan_s32 = scan_s32_scalar,
+	.scan_flt = scan_flt_neon,
+	.scan_dbl = scan_dbl_scalar,
+	.goertzel8 = goertzel8_neon,
+};
+
+#endif
+
+
+
+struct dsp_funcs dsp = {
+	.name = "scalar",
+	.scan_s16 = scan_s16_scalar,
+	.scan_s32 = scan_s32_scalar,
+	.scan_flt = scan_flt_scalar,
+	.scan_dbl = scan_dbl_scalar,
+	.goertzel8 = goertzel8_scalar,
+};
+
+
+int dsp_select(const char *name) {
+	const struct dsp_funcs *f = NULL;
+
+	if (!strcmp(name, "scalar"))
+		f = &dsp_scalar;
+#ifdef DSP_X86
+	else if (!strcmp(name, "sse2") && __builtin_cpu_supports("sse2"))
+		f = &dsp_sse2;
+	else if (!strcmp(name, "avx2") && __builtin_cpu_supports("avx2"))
+		f = &dsp_avx2;
+#endif
+#ifdef DSP_NEON
+	else if (!strcmp(name, "neon"))
+		f = &dsp_neon;
+#endif
+
+	if (!f)
+		return -1;
+	dsp = *f;
+	return 0;
+}
+
+void dsp_init(void) {
+#ifdef DSP_X86
+	__builtin_cpu_init();
+#endif
+	if (dsp_select("avx2") && dsp_select("sse2") && dsp_select("neon"))
+		dsp_select("scalar");
+	ilog(LOG_DEBUG, "Using %s DSP kernels", dsp.name);
+}
@@ -0,0 +1,48 @@
+#ifndef _DSP_H_
+#define _DSP_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include "compat.h"
+
+
+// Per-sample audio kernels. Scalar versions are always available; SIMD versions are
+// selected at run time by dsp_init() if the CPU supports them.
+
+
+struct dsp_funcs {
+	const char *name;
+
+	// Threshold scanning: a sample is silent if -thres <= s <= thres. Returns the
+	// index of the first sample whose state differs from `silent`, or `num` if
+	// the whole buffer is in the same state.
+	unsigned int (*scan_s16)(const int16_t *s, unsigned int num, int16_t thres, bool silent);
+	unsigned int (*scan_s32)(const int32_t *s, unsigned int num, int32_t thres, bool silent);
+	unsigned int (*scan_flt)(const float *s, unsigned int num, float thres, bool silent);
+	unsigned int (*scan_dbl)(const double *s, unsigned int num, double thres, bool silent);
+
+	// Runs 8 Goertzel filters in parallel over the same input. For each filter k and
+	// each sample: v1 = v2[k]; v2[k] = v3[k]; v3[k] = fac[k] * v2[k] - v1 + s[i]
+	void (*goertzel8)(float *v2, float *v3, const float *fac, const int16_t *s, unsigned int num);
+};
+
+extern struct dsp_funcs dsp;
+
+
+void dsp_init(void);
+// switch to a specific implementation ("scalar", "sse2", "avx2", "neon"). returns
+// 0 on success, -1 if not supported on this CPU
+int dsp_select(const char *name);
+
+
+// helpers taking thresholds as used by the config and sanitising them for 16 bits
+INLINE unsigned int dsp_scan_s16(const int16_t *s, unsigned int num, int thres, bool silent) {
+	if (thres < 0) // nothing is silent
+		return silent ? 0 : num;
+	if (thres > INT16_MAX) // everything is silent
+		return silent ? num : 0;
+	return dsp.scan_s16(s, num, thres, silent);
+}
+
+
+#endif
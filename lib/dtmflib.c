@@ -2,6 +2,7 @@
 #include <math.h>
 #include "compat.h"
 #include "log.h"
+#include "dsp.h"
 
 struct dtmf_freq {
 	unsigned int prim,
@@ -69,3 +70,179 @@ void dtmf_samples(void *buf, unsigned long offset, unsigned long num, unsigned i
 		offset++;
 	}
 }
+
+
+
+// Native DTMF detector. This follows spandsp's dtmf_rx() closely (block size, Goertzel
+// filters, signal tests and hit logic), so that events are reported identically, but
+// scales the block size to the sample rate instead of requiring 8 kHz input. All 8
+// filters run together through the DSP kernels, and blocks without enough energy to
+// possibly hold a tone skip the filters altogether.
+
+#define DTMF_BLOCK_8K			102	// 12.75 ms
+#define DTMF_THRESHOLD_8K		8.0e7f
+#define DTMF_NORMAL_TWIST		6.309f	// 8 dB
+#define DTMF_REVERSE_TWIST		2.512f	// 4 dB
+#define DTMF_RELATIVE_PEAK		6.309f	// 8 dB
+#define DTMF_TO_TOTAL_ENERGY_8K		42.0f
+#define DTMF_DBM0_MAX_POWER		(3.14f + 3.02f)
+
+static const unsigned int dtmf_det_freqs[8] = { 697, 770, 852, 941, 1209, 1336, 1477, 1633 };
+static const char dtmf_det_positions[] = "123A" "456B" "789C" "*0#D";
+
+struct dtmf_det {
+	dtmf_det_callback_t *callback;
+	void *callback_ptr;
+
+	unsigned int block_size;
+	float threshold;
+	float to_total_energy;
+	float power_offset;
+	float fac[8]; // rows 0-3, columns 4-7
+
+	int16_t *block; // partial block carried over between calls
+	unsigned int current_sample;
+
+	int in_digit;
+	int last_hit;
+	unsigned int duration;
+};
+
+
+struct dtmf_det *dtmf_det_new(unsigned int sample_rate, dtmf_det_callback_t *callback, void *ptr) {
+	if (sample_rate < 8000 || sample_rate > 48000)
+		return NULL;
+
+	struct dtmf_det *d = g_slice_alloc0(sizeof(*d));
+	d->callback = callback;
+	d->callback_ptr = ptr;
+
+	// same frequency resolution as 102 samples at 8 kHz. the Goertzel output of a tone
+	// grows with the square of the block size, the total energy linearly
+	d->block_size = (DTMF_BLOCK_8K * sample_rate + 4000) / 8000;
+	float scale = (float) d->block_size / DTMF_BLOCK_8K;
+	d->threshold = DTMF_THRESHOLD_8K * scale * scale;
+	d->to_total_energy = DTMF_TO_TOTAL_ENERGY_8K * scale;
+	d->power_offset = 10.0f * log10f(32768.0f * 32768.0f * d->block_size);
+
+	for (unsigned int i = 0; i < 8; i++)
+		d->fac[i] = 2.0f * cosf(2.0f * M_PI * dtmf_det_freqs[i] / sample_rate);
+
+	d->block = g_malloc(sizeof(*d->block) * d->block_size);
+
+	return d;
+}
+
+void dtmf_det_free(struct dtmf_det *d) {
+	if (!d)
+		return;
+	g_free(d->block);
+	g_slice_free1(sizeof(*d), d);
+}
+
+static int dtmf_det_hit(struct dtmf_det *d, const int16_t *s, float energy) {
+	float v2[8] = {0,}, v3[8] = {0,}, res[8];
+
+	dsp.goertzel8(v2, v3, d->fac, s, d->block_size);
+
+	for (unsigned int i = 0; i < 8; i++) {
+		// push a zero through and compute the output
+		float v1 = v2[i];
+		v2[i] = v3[i];
+		v3[i] = d->fac[i] * v2[i] - v1;
+		res[i] = v3[i] * v3[i] + v2[i] * v2[i] - v2[i] * v3[i] * d->fac[i];
+	}
+
+	const float *row = res, *col = res + 4;
+	unsigned int best_row = 0, best_col = 0;
+	for (unsigned int i = 1; i < 4; i++) {
+		if (row[i] > row[best_row])
+			best_row = i;
+		if (col[i] > col[best_col])
+			best_col = i;
+	}
+
+	// basic signal level and twist tests
+	if (row[best_row] < d->threshold || col[best_col] < d->threshold)
+		return 0;
+	if (col[best_col] >= row[best_row] * DTMF_REVERSE_TWIST)
+		return 0;
+	if (col[best_col] * DTMF_NORMAL_TWIST <= row[best_row])
+		return 0;
+
+	// relative peak tests
+	for (unsigned int i = 0; i < 4; i++) {
+		if (i != best_col && col[i] * DTMF_RELATIVE_PEAK > col[best_col])
+			return 0;
+		if (i != best_row && row[i] * DTMF_RELATIVE_PEAK > row[best_row])
+			return 0;
+	}
+
+	// fraction of total energy
+	if (row[best_row] + col[best_col] <= d->to_total_energy * energy)
+		return 0;
+
+	return dtmf_det_positions[(best_row << 2) + best_col];
+}
+
+static void dtmf_det_block(struct dtmf_det *d, const int16_t *s) {
+	int64_t e = 0;
+	for (unsigned int i = 0; i < d->block_size; i++)
+		e += (int32_t) s[i] * s[i];
+	float energy = e;
+
+	int hit = 0;
+	// a single filter's output can't exceed the block size times the total energy,
+	// so in quiet blocks none of them can reach the threshold
+	if (energy * d->block_size >= d->threshold)
+		hit = dtmf_det_hit(d, s, energy);
+
+	// require two successive identical hits to start a digit, and two successive
+	// non-matching blocks to end it. see spandsp's dtmf_rx() for the patterns this covers
+	if (hit != d->in_digit && d->last_hit != d->in_digit) {
+		hit = (hit && hit == d->last_hit) ? hit : 0;
+		// avoid reporting multiple no digit conditions on flaky hits
+		if (d->in_digit || hit) {
+			int level = (d->in_digit && !hit) ? -99
+				: lrintf(log10f(energy) * 10.0f - d->power_offset + DTMF_DBM0_MAX_POWER);
+			d->callback(d->callback_ptr, hit, level, d->duration);
+			d->duration = 0;
+		}
+		d->in_digit = hit;
+	}
+	d->last_hit = hit;
+}
+
+void dtmf_det_process(struct dtmf_det *d, const int16_t *s, unsigned int num) {
+	while (num) {
+		unsigned int left = d->block_size - d->current_sample;
+
+		if (!d->current_sample && num >= d->block_size) {
+			// full block straight from the input
+			d->duration += d->block_size;
+			dtmf_det_block(d, s);
+			s += d->block_size;
+			num -= d->block_size;
+			continue;
+		}
+
+		unsigned int len = num < left ? num : left;
+		memcpy(d->block + d->current_sample, s, len * sizeof(*s));
+		d->current_sample += len;
+		d->duration += len;
+		s += len;
+		num -= len;
+
+		if (d->current_sample < d->block_size)
+			break;
+		dtmf_det_block(d, d->block);
+		d->current_sample = 0;
+	}
+}
+
+void dtmf_det_fillin(struct dtmf_det *d, unsigned int num) {
+	// like spandsp, restart the current block and leave the hit state alone. unlike
+	// spandsp, account for the missing samples so that event delays stay accurate
+	d->current_sample = 0;
+	d->duration += num;
+}
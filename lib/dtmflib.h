@@ -22,8 +22,23 @@ struct telephone_event_payload {
 } __attribute__ ((packed));
 
 
+struct dtmf_det;
+
+typedef void dtmf_det_callback_t(void *ptr, int code, int level, int delay);
+
+
 void dtmf_samples(void *buf, unsigned long offset, unsigned long num, unsigned int event, unsigned int volume,
 		unsigned int sample_rate);
 
+// Native in-band DTMF detector, working on mono S16 at the given sample rate. The callback
+// has the same semantics as spandsp's realtime callback: code is the digit character or 0
+// at the end of a digit, level in dBm0 (-99 at the end), and delay is the number of samples
+// since the previous report. Returns NULL for unsupported sample rates.
+struct dtmf_det *dtmf_det_new(unsigned int sample_rate, dtmf_det_callback_t *, void *ptr);
+void dtmf_det_free(struct dtmf_det *);
+void dtmf_det_process(struct dtmf_det *, const int16_t *samples, unsigned int num);
+// a gap in the input: discards the partial detection block
+void dtmf_det_fillin(struct dtmf_det *, unsigned int num);
+
 
 #endif
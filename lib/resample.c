@@ -16,88 +16,177 @@
 
 
 
-AVFrame *resample_frame(resample_t *resample, AVFrame *frame, const format_t *to_format) {
+// returns 1 if the frame is already in the requested format, 0 if the resampler
+// is ready to convert, and -1 on error
+static int __resample_setup(resample_t *resample, AVFrame *frame, const format_t *to_format,
+		uint64_t *to_channel_layout)
+{
 	const char *err;
 	int errcode = 0;
 
-	uint64_t to_channel_layout = av_get_default_channel_layout(to_format->channels);
+	*to_channel_layout = av_get_default_channel_layout(to_format->channels);
 	fix_frame_channel_layout(frame);
 
 	if (frame->format != to_format->format)
 		goto resample;
 	if (frame->sample_rate != to_format->clockrate)
 		goto resample;
-	if (frame->channel_layout != to_channel_layout)
+	if (frame->channel_layout != *to_channel_layout)
 		goto resample;
 
-	return av_frame_clone(frame);
+	return 1;
 
 resample:
+	if (G_LIKELY(resample->swresample))
+		return 0;
+
+	resample->swresample = swr_alloc_set_opts(NULL,
+			*to_channel_layout,
+			to_format->format,
+			to_format->clockrate,
+			frame->channel_layout,
+			frame->format,
+			frame->sample_rate,
+			0, NULL);
+
+	err = "failed to alloc resample context";
+	if (!resample->swresample)
+		goto err;
 
-	if (G_UNLIKELY(!resample->swresample)) {
-		resample->swresample = swr_alloc_set_opts(NULL,
-				to_channel_layout,
-				to_format->format,
-				to_format->clockrate,
-				frame->channel_layout,
-				frame->format,
-				frame->sample_rate,
-				0, NULL);
-
-		err = "failed to alloc resample context";
-		if (!resample->swresample)
-			goto err;
-
-		if (resample->no_filter)
-			av_opt_set_int(resample->swresample, "filter_size", 0, AV_OPT_SEARCH_CHILDREN);
-
-		err = "failed to init resample context";
-		if ((errcode = swr_init(resample->swresample)) < 0)
-			goto err;
-	}
+	if (resample->no_filter)
+		av_opt_set_int(resample->swresample, "filter_size", 0, AV_OPT_SEARCH_CHILDREN);
 
-	// get a large enough buffer for resampled audio - this should be enough so we don't
-	// have to loop
-	int dst_samples = av_rescale_rnd(swr_get_delay(resample->swresample, to_format->clockrate)
-			+ frame->nb_samples,
-				to_format->clockrate, frame->sample_rate, AV_ROUND_UP);
+	err = "failed to init resample context";
+	if ((errcode = swr_init(resample->swresample)) < 0)
+		goto err;
 
-	AVFrame *swr_frame = av_frame_alloc();
+	return 0;
 
-	err = "failed to alloc resampling frame";
-	if (!swr_frame)
-		goto err;
-	av_frame_copy_props(swr_frame, frame);
-	swr_frame->format = to_format->format;
-	swr_frame->channel_layout = to_channel_layout;
-	swr_frame->nb_samples = dst_samples;
-	swr_frame->sample_rate = to_format->clockrate;
-	err = "failed to get resample buffers";
-	if ((errcode = av_frame_get_buffer(swr_frame, 0)) < 0)
-		goto err;
+err:
+	if (errcode)
+		ilog(LOG_ERR | LOG_FLAG_LIMIT, "Error resampling: %s (%s)", err, av_error(errcode));
+	else
+		ilog(LOG_ERR | LOG_FLAG_LIMIT, "Error resampling: %s", err);
+	resample_shutdown(resample);
+	return -1;
+}
+
+// get a large enough buffer for resampled audio - this should be enough so we don't
+// have to loop
+static int __resample_dst_samples(resample_t *resample, AVFrame *frame, const format_t *to_format) {
+	return av_rescale_rnd(swr_get_delay(resample->swresample, to_format->clockrate)
+			+ frame->nb_samples,
+				to_format->clockrate, frame->sample_rate, AV_ROUND_UP);
+}
 
+static int __resample_convert(resample_t *resample, AVFrame *frame, const format_t *to_format,
+		AVFrame *swr_frame, int dst_samples)
+{
 	int ret_samples = swr_convert(resample->swresample, swr_frame->extended_data,
 				dst_samples,
 				(const uint8_t **) frame->extended_data,
 				frame->nb_samples);
-	err = "failed to resample audio";
-	if ((errcode = ret_samples) < 0)
-		goto err;
+	if (ret_samples < 0) {
+		ilog(LOG_ERR | LOG_FLAG_LIMIT, "Error resampling: failed to resample audio (%s)",
+				av_error(ret_samples));
+		resample_shutdown(resample);
+		return -1;
+	}
 
 	swr_frame->nb_samples = ret_samples;
 	swr_frame->pts = av_rescale(frame->pts, to_format->clockrate, frame->sample_rate);
+	return 0;
+}
+
+AVFrame *resample_frame(resample_t *resample, AVFrame *frame, const format_t *to_format) {
+	uint64_t to_channel_layout;
+	int ret = __resample_setup(resample, frame, to_format, &to_channel_layout);
+	if (ret < 0)
+		return NULL;
+	if (ret == 1)
+		return av_frame_clone(frame);
+
+	int dst_samples = __resample_dst_samples(resample, frame, to_format);
+
+	AVFrame *swr_frame = av_frame_alloc();
+	if (!swr_frame) {
+		ilog(LOG_ERR | LOG_FLAG_LIMIT, "Error resampling: failed to alloc resampling frame");
+		return NULL;
+	}
+	av_frame_copy_props(swr_frame, frame);
+	swr_frame->format = to_format->format;
+	swr_frame->channel_layout = to_channel_layout;
+	swr_frame->nb_samples = dst_samples;
+	swr_frame->sample_rate = to_format->clockrate;
+	int errcode;
+	if ((errcode = av_frame_get_buffer(swr_frame, 0)) < 0) {
+		ilog(LOG_ERR | LOG_FLAG_LIMIT, "Error resampling: failed to get resample buffers (%s)",
+				av_error(errcode));
+		av_frame_free(&swr_frame);
+		return NULL;
+	}
+
+	if (__resample_convert(resample, frame, to_format, swr_frame, dst_samples)) {
+		av_frame_free(&swr_frame);
+		return NULL;
+	}
 	return swr_frame;
+}
 
-err:
-	if (errcode)
-		ilog(LOG_ERR | LOG_FLAG_LIMIT, "Error resampling: %s (%s)", err, av_error(errcode));
-	else
-		ilog(LOG_ERR | LOG_FLAG_LIMIT, "Error resampling: %s", err);
-	resample_shutdown(resample);
-	return NULL;
+AVFrame *resample_frame_reuse(resample_t *resample, AVFrame *frame, const format_t *to_format) {
+	uint64_t to_channel_layout;
+	int ret = __resample_setup(resample, frame, to_format, &to_channel_layout);
+	if (ret < 0)
+		return NULL;
+	if (ret == 1)
+		return frame;
+
+	int dst_samples = __resample_dst_samples(resample, frame, to_format);
+
+	AVFrame *swr_frame = resample->frame;
+	if (G_UNLIKELY(!swr_frame)) {
+		swr_frame = resample->frame = av_frame_alloc();
+		if (!swr_frame) {
+			ilog(LOG_ERR | LOG_FLAG_LIMIT, "Error resampling: failed to alloc resampling frame");
+			return NULL;
+		}
+	}
+
+	// the output frame keeps its buffer between calls. only get a new one if it's
+	// too small, the format changed, or somebody is still holding a reference to it
+	if (G_UNLIKELY(!swr_frame->buf[0]
+			|| dst_samples > resample->frame_capacity
+			|| swr_frame->format != to_format->format
+			|| swr_frame->channel_layout != to_channel_layout
+			|| !av_frame_is_writable(swr_frame)))
+	{
+		av_frame_unref(swr_frame);
+		swr_frame->format = to_format->format;
+		swr_frame->channel_layout = to_channel_layout;
+		// leave some room so that slight variations in input size don't
+		// require a new buffer every time
+		swr_frame->nb_samples = MAX(dst_samples, resample->frame_capacity) * 5 / 4;
+		int errcode;
+		if ((errcode = av_frame_get_buffer(swr_frame, 0)) < 0) {
+			ilog(LOG_ERR | LOG_FLAG_LIMIT, "Error resampling: failed to get resample buffers (%s)",
+					av_error(errcode));
+			resample->frame_capacity = 0;
+			return NULL;
+		}
+		resample->frame_capacity = swr_frame->nb_samples;
+	}
+
+	av_frame_copy_props(swr_frame, frame);
+	swr_frame->sample_rate = to_format->clockrate;
+
+	if (__resample_convert(resample, frame, to_format, swr_frame, dst_samples))
+		return NULL;
+	return swr_frame;
 }
 
 
 void resample_shutdown(resample_t *resample) {
 	swr_free(&resample->swresample);
+	av_frame_free(&resample->frame);
+	resample->frame_capacity = 0;
 }
@@ -7,6 +7,9 @@
 
 
 AVFrame *resample_frame(resample_t *resample, AVFrame *frame, const format_t *to_format);
+// returns either `frame` itself if no conversion is needed, or a frame owned by the
+// resampler that remains valid until the next call. must not be freed by the caller.
+AVFrame *resample_frame_reuse(resample_t *resample, AVFrame *frame, const format_t *to_format);
 void resample_shutdown(resample_t *resample);
 
 
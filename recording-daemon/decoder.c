@@ -143,7 +143,9 @@ no_recording:
 	if (ssrc->tls_fwd_stream) {
 		// XXX might be a second resampling to same format
 		dbg("SSRC %lx of stream #%lu has TLS forwarding stream", ssrc->ssrc, stream->id);
-		AVFrame *dec_frame = resample_frame(&ssrc->tls_fwd_resampler, frame, &ssrc->tls_fwd_format);
+		AVFrame *dec_frame = resample_frame_reuse(&ssrc->tls_fwd_resampler, frame, &ssrc->tls_fwd_format);
+		if (!dec_frame)
+			goto err;
 
 		ssrc_tls_state(ssrc);
 
@@ -159,10 +161,12 @@ no_recording:
 			ssrc->sent_intro = 1;
 		}
 
-		dbg("Writing %u bytes PCM to TLS", dec_frame->linesize[0]);
-		streambuf_write(ssrc->tls_fwd_stream, (char *) dec_frame->extended_data[0],
-				dec_frame->linesize[0]);
-		av_frame_free(&dec_frame);
+		// the resampler's frame may have room for more than it holds
+		int len = av_samples_get_buffer_size(NULL, ssrc->tls_fwd_format.channels,
+				dec_frame->nb_samples, dec_frame->format, 1);
+		dbg("Writing %i bytes PCM to TLS", len);
+		if (len > 0)
+			streambuf_write(ssrc->tls_fwd_stream, (char *) dec_frame->extended_data[0], len);
 
 	}
 
@@ -340,12 +340,13 @@ int mix_add(mix_t *mix, AVFrame *frame, unsigned int idx, void *ptr, output_t *o
 			else
 				goto err;
 		}
-		frame = resample_frame(&mix->resample, mix->sink_frame, &mix->out_format);
+		AVFrame *out_frame = resample_frame_reuse(&mix->resample, mix->sink_frame, &mix->out_format);
 
-		ret = output_add(output, frame);
+		ret = -1;
+		if (out_frame)
+			ret = output_add(output, out_frame);
 
 		av_frame_unref(mix->sink_frame);
-		av_frame_free(&frame);
 
 		if (ret)
 			return -1;
@@ -10,7 +10,7 @@ use IPC::Open3;
 
 
 autotest_start(qw(--config-file=none -t -1 -i 203.0.113.1 -i 2001:db8:4321::1
-			-n 2223 -c 12345 -f -L 7 -E -u 2222 --jitter-buffer=10))
+			-n 2223 -c 12345 -f -L 7 -E -u 2222 --jitter-buffer=10), @ARGV)
 		or die;
 
 
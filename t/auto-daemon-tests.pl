@@ -16,6 +16,7 @@ autotest_start(qw(--config-file=none -t -1 -i 203.0.113.1 -i 2001:db8:4321::1
 
 
 my $amr_tests = (POSIX::uname())[1] eq 'moose';
+my $g729_tests = `$ENV{RTPE_BIN} --config-file=none --codecs` =~ /G729: fully supported/;
 
 
 # 100 ms sine wave
@@ -12074,6 +12075,145 @@ rcv($sock_a, $port_b, rtpm(0, 4008, 6280, $ssrc, "\x88" x 160));
 
 
 
+($sock_a, $sock_b) = new_call([qw(198.51.100.1 7340)], [qw(198.51.100.3 7342)]);
+
+($port_a) = offer('PCMA repacketizing, ptime=30 out', {
+	ICE => 'remove', replace => ['origin'], ptime => 30 }, <<SDP);
+v=0
+o=- 1545997027 1 IN IP4 198.51.100.1
+s=tester
+t=0 0
+m=audio 7340 RTP/AVP 8
+c=IN IP4 198.51.100.1
+a=sendrecv
+----------------------------------
+v=0
+o=- 1545997027 1 IN IP4 203.0.113.1
+s=tester
+t=0 0
+m=audio PORT RTP/AVP 8
+c=IN IP4 203.0.113.1
+a=rtpmap:8 PCMA/8000
+a=sendrecv
+a=rtcp:PORT
+a=ptime:30
+SDP
+
+($port_b) = answer('PCMA repacketizing, ptime=30 out',
+	{ ICE => 'remove', replace => ['origin'] }, <<SDP);
+v=0
+o=- 1545997027 1 IN IP4 198.51.100.3
+s=tester
+t=0 0
+m=audio 7342 RTP/AVP 8
+c=IN IP4 198.51.100.3
+a=sendrecv
+a=ptime:30
+--------------------------------------
+v=0
+o=- 1545997027 1 IN IP4 203.0.113.1
+s=tester
+t=0 0
+m=audio PORT RTP/AVP 8
+c=IN IP4 203.0.113.1
+a=rtpmap:8 PCMA/8000
+a=sendrecv
+a=rtcp:PORT
+SDP
+
+# A->B: 20 ms packets cut into 30 ms ones, bytes unchanged
+snd($sock_a, $port_b, rtp(8, 1000, 3000, 0x1234, "\x01" x 160));
+Time::HiRes::usleep(20000); # 20 ms, needed to ensure that packet 1000 is received first
+snd($sock_a, $port_b, rtp(8, 1001, 3160, 0x1234, "\x02" x 160));
+($ssrc) = rcv($sock_b, $port_a, rtpm(8, 1000, 3000, -1, ("\x01" x 160) . ("\x02" x 80)));
+snd($sock_a, $port_b, rtp(8, 1002, 3320, 0x1234, "\x03" x 160));
+rcv($sock_b, $port_a, rtpm(8, 1001, 3240, $ssrc, ("\x02" x 80) . ("\x03" x 160)));
+
+# A->B: SSRC change with 20 ms left in the buffer, which is discarded when the SSRC comes back
+snd($sock_a, $port_b, rtp(8, 1003, 3480, 0x1234, "\x04" x 160));
+Time::HiRes::usleep(1000);
+snd($sock_a, $port_b, rtp(8, 2000, 9000, 0x5678, "\x05" x 160));
+Time::HiRes::usleep(1000);
+snd($sock_a, $port_b, rtp(8, 2001, 9160, 0x5678, "\x06" x 160));
+($ssrc_b) = rcv($sock_b, $port_a, rtpm(8, -1, -1, -1, ("\x05" x 160) . ("\x06" x 80)));
+snd($sock_a, $port_b, rtp(8, 1004, 3640, 0x1234, "\x07" x 160));
+Time::HiRes::usleep(1000);
+snd($sock_a, $port_b, rtp(8, 1005, 3800, 0x1234, "\x08" x 160));
+rcv($sock_b, $port_a, rtpm(8, 1002, 3480, $ssrc, ("\x07" x 160) . ("\x08" x 80)));
+
+# B->A: 30 ms packets cut into 20 ms ones
+snd($sock_b, $port_a, rtp(8, 4000, 5000, 0x4567, "\x11" x 240));
+($ssrc) = rcv($sock_a, $port_b, rtpm(8, 4000, 5000, -1, "\x11" x 160));
+snd($sock_b, $port_a, rtp(8, 4001, 5240, 0x4567, "\x12" x 240));
+rcv($sock_a, $port_b, rtpm(8, 4001, 5160, $ssrc, ("\x11" x 80) . ("\x12" x 80)));
+rcv($sock_a, $port_b, rtpm(8, 4002, 5320, $ssrc, "\x12" x 160));
+
+
+
+if ($g729_tests) {
+
+($sock_a, $sock_b) = new_call([qw(198.51.100.1 7344)], [qw(198.51.100.3 7346)]);
+
+($port_a) = offer('G.729 repacketizing with SID, ptime=30 out', {
+	ICE => 'remove', replace => ['origin'], ptime => 30 }, <<SDP);
+v=0
+o=- 1545997027 1 IN IP4 198.51.100.1
+s=tester
+t=0 0
+m=audio 7344 RTP/AVP 18
+c=IN IP4 198.51.100.1
+a=rtpmap:18 G729/8000
+a=sendrecv
+----------------------------------
+v=0
+o=- 1545997027 1 IN IP4 203.0.113.1
+s=tester
+t=0 0
+m=audio PORT RTP/AVP 18
+c=IN IP4 203.0.113.1
+a=rtpmap:18 G729/8000
+a=sendrecv
+a=rtcp:PORT
+a=ptime:30
+SDP
+
+($port_b) = answer('G.729 repacketizing with SID, ptime=30 out',
+	{ ICE => 'remove', replace => ['origin'] }, <<SDP);
+v=0
+o=- 1545997027 1 IN IP4 198.51.100.3
+s=tester
+t=0 0
+m=audio 7346 RTP/AVP 18
+c=IN IP4 198.51.100.3
+a=rtpmap:18 G729/8000
+a=sendrecv
+a=ptime:30
+--------------------------------------
+v=0
+o=- 1545997027 1 IN IP4 203.0.113.1
+s=tester
+t=0 0
+m=audio PORT RTP/AVP 18
+c=IN IP4 203.0.113.1
+a=rtpmap:18 G729/8000
+a=sendrecv
+a=rtcp:PORT
+SDP
+
+# A->B: 2x 10-byte frames per packet cut into 3 frames per packet
+snd($sock_a, $port_b, rtp(18, 1000, 3000, 0x1234, ("\x01" x 10) . ("\x02" x 10)));
+Time::HiRes::usleep(20000); # 20 ms, needed to ensure that packet 1000 is received first
+snd($sock_a, $port_b, rtp(18, 1001, 3160, 0x1234, ("\x03" x 10) . ("\x04" x 10)));
+($ssrc) = rcv($sock_b, $port_a, rtpm(18, 1000, 3000, -1, ("\x01" x 10) . ("\x02" x 10) . ("\x03" x 10)));
+# a 2-byte SID frame ends the talk spurt and flushes the buffer
+snd($sock_a, $port_b, rtp(18, 1002, 3320, 0x1234, ("\x05" x 10) . "\x06\x06"));
+rcv($sock_b, $port_a, rtpm(18, 1001, 3240, $ssrc, ("\x04" x 10) . ("\x05" x 10) . "\x06\x06"));
+
+}
+
+
+
+
 ($sock_a, $sock_b) = new_call([qw(198.51.100.1 3008)], [qw(198.51.100.3 3010)]);
 
 ($port_a) = offer('default ptime in, no change, ptime=30 response', {
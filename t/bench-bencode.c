@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <assert.h>
+#include <glib.h>
+#include "bencode.h"
+#include "str.h"
+
+// typical "offer" as sent by a SIP proxy
+static const char *offer =
+	"d"
+	"3:sdp"	"160:v=0\r\no=- 1545997027 1 IN IP4 198.51.100.1\r\ns=tester\r\nc=IN IP4 198.51.100.1\r\nt=0 0\r\n"
+		"m=audio 2000 RTP/AVP 0 8 101\r\na=rtpmap:101 telephone-event/8000\r\na=sendrecv\r\n"
+	"5:flags"	"l13:trust-address21:strict-source-address16:symmetric-codecse"
+	"7:replace"	"l6:origin18:session-connectione"
+	"7:call-id"	"36:8d6f2c6e-1d9b-4f1a-9a0d-2f6b7cf1f8a2"
+	"8:from-tag"	"10:a8f3b2c9d1"
+	"10:via-branch"	"18:z9hG4bK776asdhds-0"
+	"8:rtcp-mux"	"l5:demuxe"
+	"13:received from"	"l3:IP412:198.51.100.1e"
+	"3:ICE"		"6:remove"
+	"18:transport protocol"	"7:RTP/AVP"
+	"8:metadata"	"13:from:alice;to"
+	"5:codec"	"d5:stripl3:alle5:offerl4:PCMU4:PCMAee"
+	"7:command"	"5:offer"
+	"e";
+
+static int key_lookup(const char *key, size_t len) {
+	str s = STR_CONST_INIT_LEN((char *) key, len);
+	switch (__csh_lookup(&s)) {
+		case CSH_LOOKUP("command"):		return 0;
+		case CSH_LOOKUP("call-id"):		return 1;
+		case CSH_LOOKUP("from-tag"):		return 2;
+		case CSH_LOOKUP("to-tag"):		return 3;
+		case CSH_LOOKUP("via-branch"):		return 4;
+		case CSH_LOOKUP("label"):		return 5;
+		case CSH_LOOKUP("address"):		return 6;
+		case CSH_LOOKUP("sdp"):			return 7;
+		case CSH_LOOKUP("flags"):		return 8;
+		case CSH_LOOKUP("replace"):		return 9;
+		case CSH_LOOKUP("direction"):		return 10;
+		case CSH_LOOKUP("received from"):	return 11;
+		case CSH_LOOKUP("received-from"):	return 12;
+		case CSH_LOOKUP("ICE"):			return 13;
+		case CSH_LOOKUP("DTLS"):		return 14;
+		case CSH_LOOKUP("rtcp-mux"):		return 15;
+		case CSH_LOOKUP("SDES"):		return 16;
+		case CSH_LOOKUP("transport protocol"):	return 17;
+		case CSH_LOOKUP("transport-protocol"):	return 18;
+		case CSH_LOOKUP("media address"):	return 19;
+		case CSH_LOOKUP("media-address"):	return 20;
+		case CSH_LOOKUP("TOS"):			return 21;
+		case CSH_LOOKUP("record call"):		return 22;
+		case CSH_LOOKUP("record-call"):		return 23;
+		case CSH_LOOKUP("metadata"):		return 24;
+		case CSH_LOOKUP("ptime"):		return 25;
+		case CSH_LOOKUP("codec"):		return 26;
+		case CSH_LOOKUP("media echo"):		return 27;
+		case CSH_LOOKUP("media-echo"):		return 28;
+		case CSH_LOOKUP("xmlrpc-callback"):	return 29;
+		default:
+			return -1;
+	}
+}
+#define NUM_KEYS 30
+
+// the same keys, in the order the daemon looks them up, mostly absent in the message
+static const char *lookups[NUM_KEYS] = {
+	"command", "call-id", "flags", "replace", "from-tag", "to-tag", "via-branch", "label", "address",
+	"sdp", "direction", "received from", "received-from", "ICE", "DTLS", "rtcp-mux", "SDES",
+	"transport-protocol", "transport protocol", "media-address", "media address", "TOS",
+	"record-call", "record call", "metadata", "ptime", "xmlrpc-callback", "codec", "media-echo",
+	"media echo",
+};
+
+#define ITERATIONS 200000
+
+static long long now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void report(const char *name, size_t bytes, int iters, long long elapsed) {
+	// machine readable: name, bytes, iterations, ns per op, MB/s
+	printf("bencode %s %zu %i %.1f %.1f\n", name, bytes, iters,
+			(double) elapsed / iters,
+			(double) bytes * iters / ((double) elapsed / 1000.0));
+}
+
+static void bench_decode(int indexed) {
+	size_t len = strlen(offer);
+	unsigned int found = 0;
+
+	long long start = now_ns();
+	for (int i = 0; i < ITERATIONS; i++) {
+		bencode_buffer_t buf;
+		bencode_buffer_init(&buf);
+		bencode_item_t *dict = bencode_decode_expect(&buf, offer, len, BENCODE_DICTIONARY);
+		assert(dict != NULL);
+		if (indexed)
+			bencode_dictionary_index(dict, key_lookup, NUM_KEYS);
+		for (int k = 0; k < NUM_KEYS; k++)
+			if (bencode_dictionary_get(dict, lookups[k]))
+				found++;
+		bencode_buffer_free(&buf);
+	}
+	long long elapsed = now_ns() - start;
+
+	assert(found == ITERATIONS * 13);
+	report(indexed ? "decode+lookup-indexed" : "decode+lookup", len, ITERATIONS, elapsed);
+}
+
+// TCP framing: separate validation pass followed by decoding, versus a single validating decode
+static void bench_stream(int prefix) {
+	size_t len = strlen(offer);
+
+	long long start = now_ns();
+	for (int i = 0; i < ITERATIONS; i++) {
+		bencode_buffer_t buf;
+		bencode_buffer_init(&buf);
+		bencode_item_t *dict;
+		if (prefix) {
+			ssize_t used;
+			dict = bencode_decode_prefix(&buf, offer, len, &used);
+			assert(used == len);
+		}
+		else {
+			ssize_t used = bencode_valid(offer, len);
+			assert(used == len);
+			dict = bencode_decode(&buf, offer, used);
+		}
+		assert(dict != NULL);
+		bencode_buffer_free(&buf);
+	}
+	long long elapsed = now_ns() - start;
+
+	report(prefix ? "stream-decode-prefix" : "stream-valid+decode", len, ITERATIONS, elapsed);
+}
+
+// a large "list"-style reply
+static bencode_item_t *build_reply(bencode_buffer_t *buf) {
+	bencode_item_t *resp = bencode_dictionary(buf);
+	bencode_item_t *calls = bencode_dictionary_add_list(resp, "calls");
+	char callid[64];
+	for (int i = 0; i < 2000; i++) {
+		snprintf(callid, sizeof(callid), "call-%08i@bench.example.com", i);
+		bencode_list_add_string_dup(calls, callid);
+	}
+	bencode_dictionary_add_string(resp, "result", "ok");
+	return resp;
+}
+
+static void bench_encode(int vectored) {
+	size_t bytes = 0;
+
+	long long start = now_ns();
+	for (int i = 0; i < ITERATIONS / 100; i++) {
+		bencode_buffer_t buf;
+		bencode_buffer_init(&buf);
+		bencode_item_t *resp = build_reply(&buf);
+		if (vectored) {
+			int cnt;
+			struct iovec *iov = bencode_iovec(resp, &cnt, 2, 0);
+			assert(iov != NULL);
+			bytes = resp->str_len;
+		}
+		else {
+			str s;
+			bencode_collapse_str(resp, &s);
+			assert(s.s != NULL);
+			bytes = s.len;
+		}
+		bencode_buffer_free(&buf);
+	}
+	long long elapsed = now_ns() - start;
+
+	report(vectored ? "encode-iovec" : "encode-collapse", bytes, ITERATIONS / 100, elapsed);
+}
+
+int main(void) {
+	bench_decode(0);
+	bench_decode(1);
+	bench_stream(0);
+	bench_stream(1);
+	bench_encode(0);
+	bench_encode(1);
+	return 0;
+}
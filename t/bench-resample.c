@@ -0,0 +1,76 @@
+#include <libavutil/frame.h>
+#include <assert.h>
+#include <time.h>
+#include "resample.h"
+#include "codeclib.h"
+
+static AVFrame *make_frame(int samples, int format, int rate, int channels) {
+	AVFrame *f = av_frame_alloc();
+	f->nb_samples = samples;
+	f->format = format;
+	f->sample_rate = rate;
+	f->channel_layout = av_get_default_channel_layout(channels);
+	int ret = av_frame_get_buffer(f, 0);
+	assert(ret == 0);
+	memset(f->extended_data[0], 0, f->nb_samples * av_get_bytes_per_sample(f->format) * channels);
+	return f;
+}
+
+static long long now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#define BENCH_ITERATIONS 100000
+
+static void bench_1(const char *name, int reuse, int in_rate, int out_rate) {
+	AVFrame *in_f = make_frame(in_rate / 50, AV_SAMPLE_FMT_S16, in_rate, 1); // 20 ms
+
+	resample_t resampler;
+	ZERO(resampler);
+
+	format_t out_fmt = {
+		.channels = 1,
+		.clockrate = out_rate,
+		.format = AV_SAMPLE_FMT_S16,
+	};
+
+	long long start = now_ns();
+	for (int i = 0; i < BENCH_ITERATIONS; i++) {
+		in_f->pts = i * in_f->nb_samples;
+		if (reuse) {
+			AVFrame *out_f = resample_frame_reuse(&resampler, in_f, &out_fmt);
+			assert(out_f != NULL);
+		}
+		else {
+			AVFrame *out_f = resample_frame(&resampler, in_f, &out_fmt);
+			assert(out_f != NULL);
+			av_frame_free(&out_f);
+		}
+	}
+	long long elapsed = now_ns() - start;
+
+	// machine readable: name, iterations, ns per frame
+	printf("resample %s %i %.1f\n", name, BENCH_ITERATIONS, (double) elapsed / BENCH_ITERATIONS);
+
+	av_frame_free(&in_f);
+	resample_shutdown(&resampler);
+}
+
+int main(void) {
+	codeclib_init(0);
+
+	bench_1("alloc-passthrough", 0, 8000, 8000);
+	bench_1("reuse-passthrough", 1, 8000, 8000);
+	bench_1("alloc-16k-8k", 0, 16000, 8000);
+	bench_1("reuse-16k-8k", 1, 16000, 8000);
+	bench_1("alloc-8k-48k", 0, 8000, 48000);
+	bench_1("reuse-8k-48k", 1, 8000, 48000);
+
+	return 0;
+}
+
+int get_local_log_level(unsigned int u) {
+	return 7;
+}
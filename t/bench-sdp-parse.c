@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <time.h>
+#include <assert.h>
+#include "sdp.h"
+#include "call_interfaces.h"
+#include "log.h"
+#include "main.h"
+
+int _log_facility_rtcp;
+int _log_facility_cdr;
+int _log_facility_dtmf;
+struct rtpengine_config rtpe_config;
+struct poller *rtpe_poller;
+struct poller_map *rtpe_poller_map;
+GString *dtmf_logs;
+
+// corpus of typical SDP bodies seen in production
+
+static const char *sip_pcmu =
+	"v=0\r\n"
+	"o=- 1545997027 1 IN IP4 198.51.100.1\r\n"
+	"s=tester\r\n"
+	"c=IN IP4 198.51.100.1\r\n"
+	"t=0 0\r\n"
+	"m=audio 2000 RTP/AVP 0 8 101\r\n"
+	"a=rtpmap:0 PCMU/8000\r\n"
+	"a=rtpmap:8 PCMA/8000\r\n"
+	"a=rtpmap:101 telephone-event/8000\r\n"
+	"a=fmtp:101 0-16\r\n"
+	"a=ptime:20\r\n"
+	"a=sendrecv\r\n";
+
+static const char *sip_sdes =
+	"v=0\r\n"
+	"o=- 1545997027 1 IN IP4 198.51.100.1\r\n"
+	"s=tester\r\n"
+	"t=0 0\r\n"
+	"m=audio 2000 RTP/SAVP 0 8 9 18 101\r\n"
+	"c=IN IP4 198.51.100.1\r\n"
+	"a=rtpmap:0 PCMU/8000\r\n"
+	"a=rtpmap:8 PCMA/8000\r\n"
+	"a=rtpmap:9 G722/8000\r\n"
+	"a=rtpmap:18 G729/8000\r\n"
+	"a=fmtp:18 annexb=no\r\n"
+	"a=rtpmap:101 telephone-event/8000\r\n"
+	"a=fmtp:101 0-16\r\n"
+	"a=crypto:1 AES_CM_128_HMAC_SHA1_80 inline:ZQsUIrbIqvR3wyPELt9yjgPoTMiGcawRy0LZoFZO\r\n"
+	"a=crypto:2 AES_CM_128_HMAC_SHA1_32 inline:mt5lvEPE8ZgmnTmCAKXvwu9m9pgTNYnqCQHYUbXd\r\n"
+	"a=rtcp:2001\r\n"
+	"a=sendrecv\r\n";
+
+static const char *sip_t38 =
+	"v=0\r\n"
+	"o=- 1545997027 1 IN IP4 198.51.100.1\r\n"
+	"s=tester\r\n"
+	"c=IN IP4 198.51.100.1\r\n"
+	"t=0 0\r\n"
+	"m=image 2000 udptl t38\r\n"
+	"a=T38FaxVersion:0\r\n"
+	"a=T38MaxBitRate:14400\r\n"
+	"a=T38FaxRateManagement:transferredTCF\r\n"
+	"a=T38FaxMaxBuffer:262\r\n"
+	"a=T38FaxMaxDatagram:90\r\n"
+	"a=T38FaxUdpEC:t38UDPRedundancy\r\n";
+
+static const char *webrtc =
+	"v=0\r\n"
+	"o=- 4611731400430051336 2 IN IP4 127.0.0.1\r\n"
+	"s=-\r\n"
+	"t=0 0\r\n"
+	"a=group:BUNDLE 0 1\r\n"
+	"a=msid-semantic: WMS lgsCFqt9kN2fVKw5wXHbrt9fQ2ypPdGHbHvy\r\n"
+	"m=audio 9 UDP/TLS/RTP/SAVPF 111 103 104 9 0 8 106 105 13 110 112 113 126\r\n"
+	"c=IN IP4 0.0.0.0\r\n"
+	"a=rtcp:9 IN IP4 0.0.0.0\r\n"
+	"a=candidate:1467250027 1 udp 2122260223 192.168.0.196 46243 typ host generation 0\r\n"
+	"a=candidate:1467250027 2 udp 2122260222 192.168.0.196 56280 typ host generation 0\r\n"
+	"a=candidate:435653019 1 tcp 1845501695 192.168.0.196 0 typ host tcptype active generation 0\r\n"
+	"a=candidate:1853887674 1 udp 1518280447 47.61.61.61 36768 typ srflx raddr 192.168.0.196 rport 36768 generation 0\r\n"
+	"a=ice-ufrag:Oyef7uvBlwafI3hT\r\n"
+	"a=ice-pwd:T0teqPLNQQOf+5W+ls+P2p16\r\n"
+	"a=ice-options:trickle\r\n"
+	"a=fingerprint:sha-256 49:66:12:17:0D:1C:91:AE:57:4C:C6:36:DD:D5:97:D2:7D:62:C9:9A:7F:B9:A3:F4:70:03:E7:43:91:73:23:5E\r\n"
+	"a=setup:actpass\r\n"
+	"a=mid:0\r\n"
+	"a=extmap:1 urn:ietf:params:rtp-hdrext:ssrc-audio-level\r\n"
+	"a=extmap:2 http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time\r\n"
+	"a=extmap:3 http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01\r\n"
+	"a=sendrecv\r\n"
+	"a=msid:lgsCFqt9kN2fVKw5wXHbrt9fQ2ypPdGHbHvy 6d3c6b4f-b29c-4c85-8e5c-0a4b1c7e3bdb\r\n"
+	"a=rtcp-mux\r\n"
+	"a=rtpmap:111 opus/48000/2\r\n"
+	"a=rtcp-fb:111 transport-cc\r\n"
+	"a=fmtp:111 minptime=10;useinbandfec=1\r\n"
+	"a=rtpmap:103 ISAC/16000\r\n"
+	"a=rtpmap:104 ISAC/32000\r\n"
+	"a=rtpmap:9 G722/8000\r\n"
+	"a=rtpmap:0 PCMU/8000\r\n"
+	"a=rtpmap:8 PCMA/8000\r\n"
+	"a=rtpmap:106 CN/32000\r\n"
+	"a=rtpmap:105 CN/16000\r\n"
+	"a=rtpmap:13 CN/8000\r\n"
+	"a=rtpmap:110 telephone-event/48000\r\n"
+	"a=rtpmap:112 telephone-event/32000\r\n"
+	"a=rtpmap:113 telephone-event/16000\r\n"
+	"a=rtpmap:126 telephone-event/8000\r\n"
+	"a=ssrc:3570614608 cname:4TOk42mSjXCkVIa6\r\n"
+	"a=ssrc:3570614608 msid:lgsCFqt9kN2fVKw5wXHbrt9fQ2ypPdGHbHvy 6d3c6b4f-b29c-4c85-8e5c-0a4b1c7e3bdb\r\n"
+	"a=ssrc:3570614608 mslabel:lgsCFqt9kN2fVKw5wXHbrt9fQ2ypPdGHbHvy\r\n"
+	"a=ssrc:3570614608 label:6d3c6b4f-b29c-4c85-8e5c-0a4b1c7e3bdb\r\n"
+	"m=video 9 UDP/TLS/RTP/SAVPF 96 97 98 99 100 101 102\r\n"
+	"c=IN IP4 0.0.0.0\r\n"
+	"a=rtcp:9 IN IP4 0.0.0.0\r\n"
+	"a=ice-ufrag:Oyef7uvBlwafI3hT\r\n"
+	"a=ice-pwd:T0teqPLNQQOf+5W+ls+P2p16\r\n"
+	"a=ice-options:trickle\r\n"
+	"a=fingerprint:sha-256 49:66:12:17:0D:1C:91:AE:57:4C:C6:36:DD:D5:97:D2:7D:62:C9:9A:7F:B9:A3:F4:70:03:E7:43:91:73:23:5E\r\n"
+	"a=setup:actpass\r\n"
+	"a=mid:1\r\n"
+	"a=extmap:14 urn:ietf:params:rtp-hdrext:toffset\r\n"
+	"a=extmap:13 urn:3gpp:video-orientation\r\n"
+	"a=sendrecv\r\n"
+	"a=rtcp-mux\r\n"
+	"a=rtcp-rsize\r\n"
+	"a=rtpmap:96 VP8/90000\r\n"
+	"a=rtcp-fb:96 goog-remb\r\n"
+	"a=rtcp-fb:96 transport-cc\r\n"
+	"a=rtcp-fb:96 ccm fir\r\n"
+	"a=rtcp-fb:96 nack\r\n"
+	"a=rtcp-fb:96 nack pli\r\n"
+	"a=rtpmap:97 rtx/90000\r\n"
+	"a=fmtp:97 apt=96\r\n"
+	"a=rtpmap:98 VP9/90000\r\n"
+	"a=rtcp-fb:98 goog-remb\r\n"
+	"a=rtcp-fb:98 nack\r\n"
+	"a=fmtp:98 profile-id=0\r\n"
+	"a=rtpmap:99 rtx/90000\r\n"
+	"a=fmtp:99 apt=98\r\n"
+	"a=rtpmap:100 H264/90000\r\n"
+	"a=rtcp-fb:100 nack pli\r\n"
+	"a=fmtp:100 level-asymmetry-allowed=1;packetization-mode=1;profile-level-id=42e01f\r\n"
+	"a=rtpmap:101 rtx/90000\r\n"
+	"a=fmtp:101 apt=100\r\n"
+	"a=rtpmap:102 red/90000\r\n"
+	"a=ssrc-group:FID 2231627014 632943048\r\n"
+	"a=ssrc:2231627014 cname:4TOk42mSjXCkVIa6\r\n"
+	"a=ssrc:632943048 cname:4TOk42mSjXCkVIa6\r\n";
+
+static const struct {
+	const char *name;
+	const char **sdp;
+} corpus[] = {
+	{ "sip-pcmu",	&sip_pcmu },
+	{ "sip-sdes",	&sip_sdes },
+	{ "sip-t38",	&sip_t38 },
+	{ "webrtc",	&webrtc },
+};
+
+#define ITERATIONS 20000
+
+static long long now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void bench(const char *name, const char *sdp) {
+	struct sdp_ng_flags flags;
+	ZERO(flags);
+	size_t len = strlen(sdp);
+	// the parser works on a mutable buffer
+	char *buf = malloc(len);
+
+	long long start = now_ns();
+	for (int i = 0; i < ITERATIONS; i++) {
+		GQueue sessions = G_QUEUE_INIT;
+		memcpy(buf, sdp, len);
+		str body;
+		str_init_len(&body, buf, len);
+		int ret = sdp_parse(&body, &sessions, &flags);
+		assert(ret == 0);
+		sdp_free(&sessions);
+	}
+	long long elapsed = now_ns() - start;
+
+	// machine readable: name, bytes, iterations, ns per parse, MB/s
+	printf("sdp_parse %s %zu %i %.1f %.1f\n", name, len, ITERATIONS,
+			(double) elapsed / ITERATIONS,
+			(double) len * ITERATIONS / ((double) elapsed / 1000.0));
+
+	free(buf);
+}
+
+int main(void) {
+	rtpe_common_config_ptr = &rtpe_config.common;
+
+	for (int i = 0; i < G_N_ELEMENTS(corpus); i++)
+		bench(corpus[i].name, *corpus[i].sdp);
+
+	return 0;
+}
+
+int get_local_log_level(unsigned int u) {
+	return 4;
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <glib.h>
+#include "codeclib.h"
+#include "auxlib.h"
+
+// the previous GTree-based sequencer, kept here as the baseline
+
+struct tree_seq {
+	GTree *packets;
+	int seq;
+};
+
+static int ptr_cmp(const void *a, const void *b, void *dummy) {
+	if (a < b)
+		return -1;
+	if (a > b)
+		return 1;
+	return 0;
+}
+struct tree_searcher {
+	int find_seq,
+	    found_seq;
+};
+static int packet_tree_search(const void *testseq_p, const void *ts_p) {
+	struct tree_searcher *ts = (void *) ts_p;
+	int testseq = GPOINTER_TO_INT(testseq_p);
+	if (G_UNLIKELY(testseq == ts->find_seq)) {
+		ts->found_seq = testseq;
+		return 0;
+	}
+	if (testseq < ts->find_seq)
+		return 1;
+	if (ts->found_seq == -1 || testseq < ts->found_seq)
+		ts->found_seq = testseq;
+	return -1;
+}
+static void tree_init(struct tree_seq *ps) {
+	ps->packets = g_tree_new_full(ptr_cmp, NULL, NULL, g_free);
+	ps->seq = -1;
+}
+static seq_packet_t *tree_next(struct tree_seq *ps, int num_wait) {
+	seq_packet_t *packet = g_tree_lookup(ps->packets, GINT_TO_POINTER(ps->seq));
+	if (packet)
+		goto out;
+	int nnodes = g_tree_nnodes(ps->packets);
+	if (nnodes == 0 || nnodes < num_wait)
+		return NULL;
+	struct tree_searcher ts = { .find_seq = ps->seq + 1, .found_seq = -1 };
+	packet = g_tree_search(ps->packets, packet_tree_search, &ts);
+	if (packet)
+		goto out;
+	if (ts.found_seq == -1) {
+		ts.find_seq = 0;
+		packet = g_tree_search(ps->packets, packet_tree_search, &ts);
+		if (packet)
+			goto out;
+		assert(ts.found_seq != -1);
+	}
+	packet = g_tree_lookup(ps->packets, GINT_TO_POINTER(ts.found_seq));
+out:
+	g_tree_steal(ps->packets, GINT_TO_POINTER(packet->seq));
+	ps->seq = (packet->seq + 1) & 0xffff;
+	return packet;
+}
+static int tree_insert(struct tree_seq *ps, seq_packet_t *p) {
+	if (ps->seq == -1)
+		ps->seq = p->seq;
+	else {
+		int diff = p->seq - ps->seq;
+		if (!(diff >= 0 && diff < 100) && !(diff < (-0xffff + 100)))
+			return -1;
+	}
+	if (g_tree_lookup(ps->packets, GINT_TO_POINTER(p->seq)))
+		return -1;
+	g_tree_insert(ps->packets, GINT_TO_POINTER(p->seq), p);
+	return 0;
+}
+
+
+#define NUM_PACKETS 1000000
+
+static long long now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void report(const char *impl, const char *name, int sent, int recv, long long elapsed) {
+	// machine readable: implementation, input pattern, packets sent, packets received, ns per packet
+	printf("sequencer %s %s %i %i %.1f\n", impl, name, sent, recv, (double) elapsed / sent);
+}
+
+// produces the arrival order: in order, locally reordered, or with random loss
+static int *make_seqs(const char *pattern, int *num) {
+	int *seqs = malloc(sizeof(*seqs) * NUM_PACKETS);
+	int n = 0;
+	srandom(1234);
+	for (int i = 0; i < NUM_PACKETS; i++) {
+		if (!strcmp(pattern, "lossy") && random() % 20 == 0)
+			continue; // 5% loss
+		seqs[n++] = (i + 60000) & 0xffff; // include wrap-arounds
+	}
+	if (!strcmp(pattern, "reordered")) {
+		// swap neighbours now and then, and occasionally delay a packet by a few slots
+		for (int i = 0; i + 4 < n; i++) {
+			long r = random() % 10;
+			if (r == 0) {
+				int t = seqs[i];
+				seqs[i] = seqs[i + 1];
+				seqs[i + 1] = t;
+				i++;
+			}
+			else if (r == 1) {
+				int t = seqs[i];
+				memmove(&seqs[i], &seqs[i + 1], sizeof(*seqs) * 3);
+				seqs[i + 3] = t;
+				i += 3;
+			}
+		}
+	}
+	*num = n;
+	return seqs;
+}
+
+static void bench_tree(const char *pattern) {
+	int num;
+	int *seqs = make_seqs(pattern, &num);
+	struct tree_seq ps;
+	tree_init(&ps);
+	int recv = 0;
+
+	long long start = now_ns();
+	for (int i = 0; i < num; i++) {
+		seq_packet_t *p = g_new0(seq_packet_t, 1);
+		p->seq = seqs[i];
+		if (tree_insert(&ps, p))
+			g_free(p);
+		while ((p = tree_next(&ps, 10))) {
+			recv++;
+			g_free(p);
+		}
+	}
+	seq_packet_t *p;
+	while ((p = tree_next(&ps, 0))) {
+		recv++;
+		g_free(p);
+	}
+	long long elapsed = now_ns() - start;
+
+	assert(recv == num);
+	report("gtree", pattern, num, recv, elapsed);
+	g_tree_destroy(ps.packets);
+	free(seqs);
+}
+
+static void bench_ring(const char *pattern) {
+	int num;
+	int *seqs = make_seqs(pattern, &num);
+	packet_sequencer_t ps = {0,};
+	packet_sequencer_init(&ps, g_free);
+	int recv = 0;
+
+	long long start = now_ns();
+	for (int i = 0; i < num; i++) {
+		seq_packet_t *p = g_new0(seq_packet_t, 1);
+		p->seq = seqs[i];
+		if (packet_sequencer_insert(&ps, p) < 0)
+			g_free(p);
+		while ((p = packet_sequencer_next_packet(&ps))) {
+			recv++;
+			g_free(p);
+		}
+	}
+	seq_packet_t *p;
+	while ((p = packet_sequencer_force_next_packet(&ps))) {
+		recv++;
+		g_free(p);
+	}
+	long long elapsed = now_ns() - start;
+
+	assert(recv == num);
+	report("ring", pattern, num, recv, elapsed);
+	packet_sequencer_destroy(&ps);
+	free(seqs);
+}
+
+int main(void) {
+	const char *patterns[] = { "in-order", "reordered", "lossy" };
+	for (int i = 0; i < G_N_ELEMENTS(patterns); i++) {
+		bench_tree(patterns[i]);
+		bench_ring(patterns[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,448 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+#include <errno.h>
+#include <math.h>
+#include "codec.h"
+#include "call.h"
+#include "call_interfaces.h"
+#include "log.h"
+#include "main.h"
+#include "ssrc.h"
+
+int _log_facility_rtcp;
+int _log_facility_cdr;
+int _log_facility_dtmf;
+struct rtpengine_config rtpe_config;
+struct poller *rtpe_poller;
+struct poller_map *rtpe_poller_map;
+GString *dtmf_logs;
+
+
+// Throughput of the complete transcoding path (codec_handlers_update() to set up the
+// handlers, then the handler function per packet) for every pair of supported codecs.
+// Output is one line per codec pair, ptime and channel count:
+//
+// transcode <from> <to> <ptime> <channels> <frames> <frames/s> <us/frame> <allocs/frame> <RSS kB/channel>
+//
+// where a frame is one received RTP packet, and RSS is the growth in peak resident memory
+// while NUM_CHANNELS channels are set up and running concurrently.
+
+static const struct bench_codec {
+	const char *name;
+	int clock_rate; // RTP clock rate
+	int min_channels, max_channels;
+	const char *fmtp;
+	int payload_type;
+} codecs[] = {
+	{ "PCMU",	8000,	1, 2,	"",			0 },
+	{ "PCMA",	8000,	1, 2,	"",			8 },
+	{ "G722",	8000,	1, 1,	"",			9 },
+	{ "G729",	8000,	1, 1,	"",			18 },
+	{ "opus",	48000,	2, 2,	"",			96 },
+	{ "AMR",	8000,	1, 1,	"octet-align=1",	96 },
+	{ "AMR-WB",	16000,	1, 1,	"octet-align=1",	96 },
+	{ "iLBC",	8000,	1, 1,	"mode=20",		96 },
+	{ "speex",	16000,	1, 1,	"",			96 },
+};
+
+static const int ptimes[] = { 20, 40, 60 };
+
+#define NUM_CHANNELS 10
+#define FRAMES_PER_CHANNEL 100
+#define CORPUS_FRAMES 50
+
+
+// count all heap allocations, including those made by glib and the codec libraries
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void *__libc_memalign(size_t, size_t);
+
+static unsigned long allocs;
+
+void *malloc(size_t size) {
+	__atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+void *calloc(size_t n, size_t size) {
+	__atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(n, size);
+}
+void *realloc(void *p, size_t size) {
+	__atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(p, size);
+}
+void *memalign(size_t align, size_t size) {
+	__atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+	return __libc_memalign(align, size);
+}
+void *aligned_alloc(size_t align, size_t size) {
+	return memalign(align, size);
+}
+int posix_memalign(void **p, size_t align, size_t size) {
+	*p = memalign(align, size);
+	return *p ? 0 : ENOMEM;
+}
+
+
+struct bench_chan {
+	struct call call;
+	struct call_monologue ml_A, ml_B;
+	struct call_media *media_A, *media_B;
+	struct codec_handler *h;
+	struct ssrc_ctx *ssrc_in, *ssrc_out;
+	uint32_t ssrc;
+	uint32_t ts;
+	uint16_t seq;
+	char *spec_from, *spec_to;
+};
+
+static long long now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long proc_status_kb(const char *field) {
+	FILE *fp = fopen("/proc/self/status", "r");
+	if (!fp)
+		return 0;
+	char line[256];
+	long ret = 0;
+	size_t len = strlen(field);
+	while (fgets(line, sizeof(line), fp)) {
+		if (!strncmp(line, field, len) && line[len] == ':') {
+			ret = atol(line + len + 1);
+			break;
+		}
+	}
+	fclose(fp);
+	return ret;
+}
+
+static bool reset_peak_rss(void) {
+	// supported since Linux 4.0
+	FILE *fp = fopen("/proc/self/clear_refs", "w");
+	if (!fp)
+		return false;
+	bool ok = fputs("5", fp) >= 0;
+	if (fclose(fp))
+		ok = false;
+	return ok;
+}
+
+static int chan_channels(const struct bench_codec *c, int channels) {
+	if (channels < c->min_channels)
+		return c->min_channels;
+	if (channels > c->max_channels)
+		return c->max_channels;
+	return channels;
+}
+
+static char *codec_spec(const struct bench_codec *c, int ptime, int channels) {
+	// encoding/clockrate/channels/bitrate/ptime/fmtp
+	return g_strdup_printf("%s/%i/%i//%i/%s", c->name, c->clock_rate, chan_channels(c, channels),
+			ptime, c->fmtp);
+}
+
+static bool codec_supported(const struct bench_codec *c) {
+	str name;
+	str_init(&name, (char *) c->name);
+	const codec_def_t *def = codec_find(&name, MT_AUDIO);
+	return def && def->support_encoding && def->support_decoding;
+}
+
+static struct rtp_payload_type *find_pt(GQueue *prefs, const struct bench_codec *c) {
+	for (GList *l = prefs->head; l; l = l->next) {
+		struct rtp_payload_type *pt = l->data;
+		if (!str_cmp(&pt->encoding, c->name) && pt->clock_rate == c->clock_rate)
+			return pt;
+	}
+	return NULL;
+}
+
+static void flags_free(struct sdp_ng_flags *flags) {
+	g_hash_table_destroy(flags->codec_except);
+	g_hash_table_destroy(flags->codec_set);
+	g_queue_clear_full(&flags->codec_transcode, free);
+	memset(flags, 0, sizeof(*flags));
+}
+
+static void flags_init(struct sdp_ng_flags *flags, enum call_opmode opmode) {
+	memset(flags, 0, sizeof(*flags));
+	flags->opmode = opmode;
+	flags->codec_except = g_hash_table_new_full(str_case_hash, str_case_equal, free, NULL);
+	flags->codec_set = g_hash_table_new_full(str_case_hash, str_case_equal, free, free);
+}
+
+static void chan_free(struct bench_chan *ch) {
+	ssrc_ctx_put(&ch->ssrc_in);
+	ssrc_ctx_put(&ch->ssrc_out);
+	call_media_free(&ch->media_A);
+	call_media_free(&ch->media_B);
+	free_ssrc_hash(&ch->ml_A.ssrc_hash);
+	free_ssrc_hash(&ch->ml_B.ssrc_hash);
+	bencode_buffer_free(&ch->call.buffer);
+	g_hash_table_destroy(ch->call.tags);
+	g_queue_clear(&ch->call.medias);
+	g_free(ch->spec_from);
+	g_free(ch->spec_to);
+	g_slice_free1(sizeof(*ch), ch);
+}
+
+// offer `from` and transcode to `to` through a regular offer/answer exchange, which sets up the
+// handlers through codec_handlers_update()
+static struct bench_chan *chan_new(const struct bench_codec *from, const struct bench_codec *to,
+		int ptime, int channels, uint32_t ssrc)
+{
+	struct bench_chan *ch = g_slice_alloc0(sizeof(*ch));
+	ch->call.tags = g_hash_table_new(g_str_hash, g_str_equal);
+	str_init(&ch->call.callid, "bench-call");
+	bencode_buffer_init(&ch->call.buffer);
+	ch->media_A = call_media_new(&ch->call);
+	ch->media_B = call_media_new(&ch->call);
+	str_init(&ch->ml_A.tag, "tag_A");
+	str_init(&ch->ml_B.tag, "tag_B");
+	ch->ml_A.ssrc_hash = create_ssrc_hash_call();
+	ch->ml_B.ssrc_hash = create_ssrc_hash_call();
+	ch->media_A->monologue = &ch->ml_A;
+	ch->media_A->protocol = &transport_protocols[PROTO_RTP_AVP];
+	ch->media_B->monologue = &ch->ml_B;
+	ch->media_B->protocol = &transport_protocols[PROTO_RTP_AVP];
+	ch->ssrc = ssrc;
+
+	ch->spec_from = codec_spec(from, ptime, channels);
+	ch->spec_to = codec_spec(to, ptime, channels);
+	str s;
+
+	struct sdp_ng_flags flags;
+	struct stream_params sp;
+	ZERO(sp);
+
+	// offer
+	flags_init(&flags, OP_OFFER);
+	codec_store_init(&sp.codecs, NULL);
+	str_init(&s, ch->spec_from);
+	struct rtp_payload_type *pt = codec_make_payload_type(&s, MT_AUDIO);
+	pt->payload_type = from->payload_type;
+	codec_store_add_raw(&sp.codecs, pt);
+	str_init(&s, ch->spec_to);
+	g_queue_push_tail(&flags.codec_transcode, str_dup(&s));
+	codecs_offer_answer(ch->media_B, ch->media_A, &sp, &flags);
+	codec_store_cleanup(&sp.codecs);
+	flags_free(&flags);
+
+	// answer with only the transcoded codec, using the payload type we've assigned
+	pt = find_pt(&ch->media_B->codecs.codec_prefs, to);
+	if (!pt)
+		goto err;
+	flags_init(&flags, OP_ANSWER);
+	codec_store_init(&sp.codecs, NULL);
+	codec_store_add_raw(&sp.codecs, rtp_payload_type_dup(pt));
+	codecs_offer_answer(ch->media_A, ch->media_B, &sp, &flags);
+	codec_store_cleanup(&sp.codecs);
+	flags_free(&flags);
+
+	ch->h = codec_handler_get(ch->media_A, from->payload_type, ch->media_B);
+	if (!ch->h || !ch->h->transcoder)
+		goto err;
+
+	// from media_packet_rtp() and __stream_ssrc()
+	ch->ssrc_in = get_ssrc_ctx(ssrc, ch->ml_A.ssrc_hash, SSRC_DIR_INPUT, NULL);
+	if (!MEDIA_ISSET(ch->media_A, TRANSCODE))
+		ch->ssrc_in->ssrc_map_out = ssrc;
+	ch->ssrc_out = get_ssrc_ctx(ch->ssrc_in->ssrc_map_out, ch->ml_B.ssrc_hash, SSRC_DIR_OUTPUT, NULL);
+
+	return ch;
+
+err:
+	chan_free(ch);
+	return NULL;
+}
+
+// runs one packet through the handler. optionally collects the output payloads
+static unsigned int chan_packet(struct bench_chan *ch, const str *payload, int ptime, GPtrArray *out) {
+	char buf[RTP_BUFFER_SIZE];
+	struct rtp_header *rtp = (void *) buf;
+	*rtp = (struct rtp_header) {
+		.v_p_x_cc = 0x80,
+		.m_pt = ch->h->source_pt.payload_type,
+		.ssrc = htonl(ch->ssrc),
+		.seq_num = htons(ch->seq),
+		.timestamp = htonl(ch->ts),
+	};
+	memcpy(buf + sizeof(*rtp), payload->s, payload->len);
+	ch->seq++;
+	ch->ts += ptime * ch->h->source_pt.clock_rate / 1000;
+
+	struct media_packet mp = {
+		.call = &ch->call,
+		.media = ch->media_A,
+		.media_out = ch->media_B,
+		.ssrc_in = ch->ssrc_in,
+		.ssrc_out = ch->ssrc_out,
+		.rtp = rtp,
+	};
+	str_init_len(&mp.payload, buf + sizeof(*rtp), payload->len);
+	str_init_len(&mp.raw, buf, sizeof(*rtp) + payload->len);
+	payload_tracker_add(&ch->ssrc_in->tracker, rtp->m_pt);
+
+	ch->h->func(ch->h, &mp);
+
+	unsigned int num = mp.packets_out.length;
+	struct codec_packet *cp;
+	while ((cp = g_queue_pop_head(&mp.packets_out))) {
+		if (out && cp->s.len > sizeof(struct rtp_header)) {
+			str pl = cp->s;
+			str_shift(&pl, sizeof(struct rtp_header));
+			g_ptr_array_add(out, str_dup(&pl));
+		}
+		codec_packet_free(cp);
+	}
+	return num;
+}
+
+static uint8_t lin2ulaw(int16_t sample) {
+	int s = sample;
+	int sign = s < 0 ? 0x80 : 0;
+	if (sign)
+		s = -s;
+	if (s > 32635)
+		s = 32635;
+	s += 0x84;
+	int exp = 7;
+	for (int mask = 0x4000; !(s & mask) && exp > 0; mask >>= 1)
+		exp--;
+	int mant = (s >> (exp + 3)) & 0x0f;
+	return ~(sign | (exp << 4) | mant);
+}
+
+// encoded frames of a two-tone signal in the given codec, transcoded from generated PCMU
+static GPtrArray *corpus_new(const struct bench_codec *c, int ptime, int channels) {
+	GPtrArray *pcmu = g_ptr_array_new_with_free_func(free);
+	int pcmu_channels = chan_channels(&codecs[0], channels);
+	unsigned int samples = 8000 * ptime / 1000;
+	unsigned int t = 0;
+	for (int i = 0; i < CORPUS_FRAMES; i++) {
+		str *s = str_alloc(samples * pcmu_channels);
+		s->len = samples * pcmu_channels;
+		for (unsigned int j = 0; j < samples; j++, t++) {
+			for (int k = 0; k < pcmu_channels; k++) {
+				double v = sin(2 * M_PI * (440 + 110 * k) * t / 8000)
+					+ 0.5 * sin(2 * M_PI * 1300 * t / 8000);
+				s->s[j * pcmu_channels + k] = lin2ulaw(v * 8000);
+			}
+		}
+		g_ptr_array_add(pcmu, s);
+	}
+
+	if (c == &codecs[0])
+		return pcmu;
+
+	GPtrArray *ret = g_ptr_array_new_with_free_func(free);
+	struct bench_chan *ch = chan_new(&codecs[0], c, ptime, channels, 0x1234);
+	if (ch) {
+		for (int i = 0; i < pcmu->len; i++)
+			chan_packet(ch, pcmu->pdata[i], ptime, ret);
+		chan_free(ch);
+	}
+	g_ptr_array_free(pcmu, TRUE);
+	return ret;
+}
+
+static void bench(const struct bench_codec *from, const struct bench_codec *to, int ptime, int channels,
+		GPtrArray *corpus)
+{
+	struct bench_chan *chans[NUM_CHANNELS];
+
+	malloc_trim(0);
+	bool peak = reset_peak_rss();
+	long rss_start = proc_status_kb("VmRSS");
+
+	for (int i = 0; i < NUM_CHANNELS; i++) {
+		chans[i] = chan_new(from, to, ptime, channels, 0x10000 + i);
+		if (!chans[i]) {
+			fprintf(stderr, "skipping %s -> %s (ptime %i, %i channels): no transcoder\n",
+					from->name, to->name, ptime, channels);
+			while (--i >= 0)
+				chan_free(chans[i]);
+			return;
+		}
+	}
+
+	unsigned long allocs_start = __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+	long long start = now_ns();
+
+	unsigned int frames = 0;
+	for (int i = 0; i < FRAMES_PER_CHANNEL; i++) {
+		for (int j = 0; j < NUM_CHANNELS; j++) {
+			chan_packet(chans[j], corpus->pdata[i % corpus->len], ptime, NULL);
+			frames++;
+		}
+	}
+
+	long long elapsed = now_ns() - start;
+	unsigned long num_allocs = __atomic_load_n(&allocs, __ATOMIC_RELAXED) - allocs_start;
+	long rss = proc_status_kb(peak ? "VmHWM" : "VmRSS") - rss_start;
+
+	for (int i = 0; i < NUM_CHANNELS; i++)
+		chan_free(chans[i]);
+
+	printf("transcode %s %s %i %i %u %.1f %.2f %.2f %li\n", from->name, to->name, ptime,
+			chan_channels(from, channels), frames,
+			(double) frames * 1000000000.0 / elapsed,
+			(double) elapsed / 1000.0 / frames,
+			(double) num_allocs / frames,
+			rss / NUM_CHANNELS);
+}
+
+int main(void) {
+	rtpe_common_config_ptr = &rtpe_config.common;
+
+	unsigned long random_seed = 0;
+
+	codeclib_init(0);
+	RAND_seed(&random_seed, sizeof(random_seed));
+	statistics_init();
+	codecs_init();
+
+	for (int f = 0; f < G_N_ELEMENTS(codecs); f++) {
+		const struct bench_codec *from = &codecs[f];
+		if (!codec_supported(from)) {
+			fprintf(stderr, "skipping %s: not supported\n", from->name);
+			continue;
+		}
+		for (int p = 0; p < G_N_ELEMENTS(ptimes); p++) {
+			for (int channels = 1; channels <= 2; channels++) {
+				if (channels > 1 && chan_channels(from, channels) == chan_channels(from, channels - 1))
+					continue; // same as the previous run
+				GPtrArray *corpus = corpus_new(from, ptimes[p], channels);
+				if (!corpus->len) {
+					fprintf(stderr, "skipping %s (ptime %i): no encoded frames\n",
+							from->name, ptimes[p]);
+					g_ptr_array_free(corpus, TRUE);
+					continue;
+				}
+				for (int t = 0; t < G_N_ELEMENTS(codecs); t++) {
+					const struct bench_codec *to = &codecs[t];
+					if (to == from || !codec_supported(to))
+						continue;
+					bench(from, to, ptimes[p], channels, corpus);
+				}
+				g_ptr_array_free(corpus, TRUE);
+			}
+		}
+	}
+
+	codeclib_free();
+
+	return 0;
+}
+
+int get_local_log_level(unsigned int u) {
+	return 4;
+}
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "dsp.h"
+
+static const char *impls[] = { "sse2", "avx2", "neon" };
+
+#define NUM 1024
+
+static struct dsp_funcs ref;
+static int16_t all_s16[65536];
+
+static void test_scan_s16(void) {
+	// every possible sample value, against a range of thresholds, from different offsets
+	int16_t thresholds[] = { 0, 1, 100, 4096, INT16_MAX - 1, INT16_MAX };
+	for (int t = 0; t < sizeof(thresholds) / sizeof(*thresholds); t++) {
+		for (int silent = 0; silent < 2; silent++) {
+			for (unsigned int off = 0; off < 65536; off += 997) {
+				unsigned int num = 65536 - off;
+				const int16_t *s = all_s16 + off;
+				unsigned int pos = 0;
+				while (pos < num) {
+					unsigned int a = dsp.scan_s16(s + pos, num - pos, thresholds[t], silent);
+					unsigned int b = ref.scan_s16(s + pos, num - pos, thresholds[t], silent);
+					assert(a == b);
+					pos += a + 1;
+				}
+			}
+		}
+	}
+}
+
+static void test_scan_runs(void) {
+	// alternating runs of silence and noise with every length up to 40 samples
+	int16_t s[NUM];
+	float f[NUM];
+	for (unsigned int len = 1; len <= 40; len++) {
+		for (unsigned int i = 0; i < NUM; i++) {
+			s[i] = ((i / len) & 1) ? ((i & 1) ? 3000 : -3000) : ((i % 7) - 3);
+			f[i] = s[i] / 32768.0f;
+		}
+		for (int silent = 0; silent < 2; silent++) {
+			for (unsigned int pos = 0; pos < NUM; pos++) {
+				assert(dsp.scan_s16(s + pos, NUM - pos, 10, silent)
+						== ref.scan_s16(s + pos, NUM - pos, 10, silent));
+				assert(dsp.scan_flt(f + pos, NUM - pos, 0.001, silent)
+						== ref.scan_flt(f + pos, NUM - pos, 0.001, silent));
+			}
+		}
+	}
+
+	// NaN is never silent
+	for (unsigned int i = 0; i < NUM; i++)
+		f[i] = 0;
+	f[NUM - 5] = NAN;
+	assert(dsp.scan_flt(f, NUM, 0.1, true) == NUM - 5);
+	assert(ref.scan_flt(f, NUM, 0.1, true) == NUM - 5);
+}
+
+static void test_thres_clamp(void) {
+	int16_t s[NUM];
+	memcpy(s, all_s16 + 30000, sizeof(s));
+	assert(dsp_scan_s16(s, NUM, -1, false) == NUM);
+	assert(dsp_scan_s16(s, NUM, -1, true) == 0);
+	assert(dsp_scan_s16(s, NUM, 100000, true) == NUM);
+	assert(dsp_scan_s16(s, NUM, 100000, false) == 0);
+}
+
+static void test_goertzel(void) {
+	float fac[8];
+	for (int i = 0; i < 8; i++)
+		fac[i] = 2.0f * cosf(2.0f * M_PI * (697 + i * 130) / 8000);
+	for (unsigned int num = 0; num < 700; num += 7) {
+		for (unsigned int off = 0; off < 65536 - num; off += 4099) {
+			float v2[8] = {1, 2, 3, 4, 5, 6, 7, 8}, v3[8] = {-1, -2, -3, -4, -5, -6, -7, -8};
+			float rv2[8], rv3[8];
+			memcpy(rv2, v2, sizeof(v2));
+			memcpy(rv3, v3, sizeof(v3));
+			dsp.goertzel8(v2, v3, fac, all_s16 + off, num);
+			ref.goertzel8(rv2, rv3, fac, all_s16 + off, num);
+			for (int k = 0; k < 8; k++) {
+				assert(fabsf(v2[k] - rv2[k]) <= fabsf(rv2[k]) * 1e-5f);
+				assert(fabsf(v3[k] - rv3[k]) <= fabsf(rv3[k]) * 1e-5f);
+			}
+		}
+	}
+}
+
+int main(void) {
+	for (int i = 0; i < 65536; i++)
+		all_s16[i] = i - 32768;
+
+	assert(dsp_select("scalar") == 0);
+	ref = dsp;
+	assert(dsp_select("foobar") == -1);
+
+	for (int i = 0; i < sizeof(impls) / sizeof(*impls); i++) {
+		if (dsp_select(impls[i])) {
+			printf("skipping %s: not supported\n", impls[i]);
+			continue;
+		}
+		printf("testing %s\n", dsp.name);
+		test_scan_s16();
+		test_scan_runs();
+		test_thres_clamp();
+		test_goertzel();
+	}
+
+	dsp_init();
+	printf("default is %s\n", dsp.name);
+
+	return 0;
+}
+
+int get_local_log_level(unsigned int u) {
+	return 7;
+}
@@ -2,12 +2,16 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include <stdbool.h>
+#include <string.h>
+#include <assert.h>
 #include <endian.h>
 #include <spandsp/telephony.h>
 #include <spandsp/super_tone_rx.h>
 #include <spandsp/logging.h>
 #include <spandsp/dtmf.h>
 #include <glib.h>
+#include "dtmflib.h"
+#include "dsp.h"
 
 static unsigned char samples[] = {
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
@@ -649,5 +653,67 @@ int main(int argc, char **argv) {
 	g_string_free(output, TRUE);
 	dtmf_rx_free(dtmf_dsp);
 
+	// same vectors through the native detector, with different packet sizes
+	dsp_init();
+	int packet_sizes[] = { 160, 37, 102, 1 };
+	for (int i = 0; i < G_N_ELEMENTS(packet_sizes); i++) {
+		output = g_string_new("");
+		struct dtmf_det *det = dtmf_det_new(8000, report_func, output);
+		assert(det != NULL);
+
+		packetise = packet_sizes[i];
+		int16_t *s = (void *) samples;
+		int num = sizeof(samples) / 2;
+		for (int j = 0; j + packetise <= num; j += packetise)
+			dtmf_det_process(det, s + j, packetise);
+
+		printf("native %s %i result: %s\n", dsp.name, packetise, output->str);
+		if (strcmp(output->str, "code 56 level -4 delay 1020, "
+					"code 0 level -99 delay 918, "
+					"code 56 level -4 delay 510, "
+					"code 0 level -99 delay 816, "))
+			abort();
+
+		g_string_free(output, TRUE);
+		dtmf_det_free(det);
+	}
+
+	// native sample rates: delays scale with the rate, everything else must be the same
+	unsigned int rates[] = { 8000, 16000, 32000, 48000 };
+	for (int i = 0; i < G_N_ELEMENTS(rates); i++) {
+		unsigned int rate = rates[i];
+		unsigned int ms = rate / 1000;
+		int16_t *buf = g_new0(int16_t, rate);
+		// 100 ms silence, '5' for 80 ms, 60 ms silence, '#' for 50 ms, then silence
+		dtmf_samples(buf + 100 * ms, 0, 80 * ms, 5, 10, rate);
+		dtmf_samples(buf + 240 * ms, 0, 50 * ms, 11, 20, rate);
+
+		output = g_string_new("");
+		struct dtmf_det *det = dtmf_det_new(rate, report_func, output);
+		assert(det != NULL);
+		for (unsigned int j = 0; j < rate; j += 20 * ms)
+			dtmf_det_process(det, buf + j, 20 * ms);
+
+		char *exp = g_strdup_printf("code 53 level -10 delay %u, "
+				"code 0 level -99 delay %u, "
+				"code 35 level -20 delay %u, "
+				"code 0 level -99 delay %u, ",
+				1020 * rate / 8000, 612 * rate / 8000, 510 * rate / 8000, 306 * rate / 8000);
+		printf("native %u result: %s\n", rate, output->str);
+		if (strcmp(output->str, exp))
+			abort();
+
+		g_free(exp);
+		g_string_free(output, TRUE);
+		dtmf_det_free(det);
+		g_free(buf);
+	}
+
+	assert(dtmf_det_new(96000, report_func, NULL) == NULL);
+
 	return 0;
 }
+
+int get_local_log_level(unsigned int u) {
+	return 7;
+}
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <libavcodec/avcodec.h>
+#include "codeclib.h"
+
+// runs all 256 codes through a libavcodec decoder and encoder
+static void roundtrip(enum AVCodecID from, enum AVCodecID to, unsigned char *out) {
+	AVCodecContext *dec = avcodec_alloc_context3(avcodec_find_decoder(from));
+	assert(dec != NULL);
+	dec->sample_rate = 8000;
+	dec->channels = 1;
+	dec->channel_layout = AV_CH_LAYOUT_MONO;
+	assert(avcodec_open2(dec, dec->codec, NULL) == 0);
+
+	AVCodecContext *enc = avcodec_alloc_context3(avcodec_find_encoder(to));
+	assert(enc != NULL);
+	enc->sample_rate = 8000;
+	enc->channels = 1;
+	enc->channel_layout = AV_CH_LAYOUT_MONO;
+	enc->sample_fmt = AV_SAMPLE_FMT_S16;
+	enc->time_base = (AVRational){1, 8000};
+	assert(avcodec_open2(enc, enc->codec, NULL) == 0);
+
+	unsigned char codes[256];
+	for (int i = 0; i < 256; i++)
+		codes[i] = i;
+
+	AVPacket *pkt = av_packet_alloc();
+	pkt->data = codes;
+	pkt->size = sizeof(codes);
+	AVFrame *frame = av_frame_alloc();
+	assert(avcodec_send_packet(dec, pkt) == 0);
+	assert(avcodec_receive_frame(dec, frame) == 0);
+	assert(frame->nb_samples == 256);
+	assert(frame->format == AV_SAMPLE_FMT_S16);
+
+	AVPacket *opkt = av_packet_alloc();
+	assert(avcodec_send_frame(enc, frame) == 0);
+	assert(avcodec_receive_packet(enc, opkt) == 0);
+	assert(opkt->size == 256);
+	memcpy(out, opkt->data, 256);
+
+	av_packet_free(&opkt);
+	av_frame_free(&frame);
+	pkt->data = NULL;
+	pkt->size = 0;
+	av_packet_free(&pkt);
+	avcodec_free_context(&enc);
+	avcodec_free_context(&dec);
+}
+
+static void check(const char *name, const unsigned char *table, const unsigned char *exp) {
+	for (int i = 0; i < 256; i++) {
+		if (table[i] != exp[i]) {
+			printf("%s mismatch for code %02x: got %02x, expected %02x\n", name, i, table[i], exp[i]);
+			abort();
+		}
+	}
+	printf("%s ok\n", name);
+}
+
+int main(void) {
+	unsigned char exp[256];
+
+	codeclib_init(0);
+
+	roundtrip(AV_CODEC_ID_PCM_ALAW, AV_CODEC_ID_PCM_MULAW, exp);
+	check("A-law to mu-law", g711_alaw2ulaw, exp);
+
+	roundtrip(AV_CODEC_ID_PCM_MULAW, AV_CODEC_ID_PCM_ALAW, exp);
+	check("mu-law to A-law", g711_ulaw2alaw, exp);
+
+	codeclib_free();
+
+	return 0;
+}
+
+int get_local_log_level(unsigned int u) {
+	return 7;
+}
@@ -0,0 +1,139 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <openssl/rand.h>
+#include "call.h"
+#include "log.h"
+#include "main.h"
+#include "media_player.h"
+#include "ssrc.h"
+#include "statistics.h"
+
+int _log_facility_rtcp;
+int _log_facility_cdr;
+int _log_facility_dtmf;
+struct rtpengine_config rtpe_config;
+struct poller *rtpe_poller;
+struct poller_map *rtpe_poller_map;
+GString *dtmf_logs;
+
+static struct call call;
+static struct call_monologue ml;
+static struct media_player *mp;
+
+// stub for the database query
+static unsigned int fetches;
+static size_t blob_size = 64;
+
+static str *fetch(long long id) {
+	fetches++;
+	if (id < 0)
+		return NULL; // not found
+	char *buf = g_malloc0(blob_size);
+	str blob;
+	str_init_len(&blob, buf, blob_size);
+	str *ret = str_dup(&blob);
+	g_free(buf);
+	return ret;
+}
+
+static void __check(long long id, int exp_ret, unsigned int exp_queued, unsigned int exp_fetches,
+		const char *file, int line)
+{
+	gettimeofday(&rtpe_now, NULL);
+	int ret = media_player_play_db(mp, id, 1);
+	unsigned int queued = media_player_db_run();
+
+	if (ret != exp_ret || queued != exp_queued || fetches != exp_fetches) {
+		printf("test nok: %s:%i\n", file, line);
+		printf("expected: ret %i, %u fetches run, %u total\n", exp_ret, exp_queued, exp_fetches);
+		printf("got: ret %i, %u fetches run, %u total\n", ret, queued, fetches);
+		abort();
+	}
+
+	printf("test ok: %s:%i\n", file, line);
+}
+
+// playback from a cache hit is started right away, and fails as there's no media to play to
+#define hit(id, total) __check(id, -1, 0, total, __FILE__, __LINE__)
+// a miss returns success and leaves the fetch to the DB thread
+#define miss(id, total) __check(id, 0, 1, total, __FILE__, __LINE__)
+
+int main(void) {
+	rtpe_common_config_ptr = &rtpe_config.common;
+
+	unsigned long random_seed = 0;
+	RAND_seed(&random_seed, sizeof(random_seed));
+
+	rtpe_config.mysql_host = "localhost";
+	rtpe_config.mysql_query = "select data from files where id = %llu";
+	rtpe_config.mysql_cache_size = 1; // MB
+	rtpe_config.mysql_cache_ttl = 300;
+	media_player_db_fetch = fetch;
+
+	statistics_init();
+	media_player_init();
+
+	rwlock_init(&call.master_lock);
+	obj_hold(&call); // static, must never be freed
+	str_init(&call.callid, "test-call");
+	ml.call = &call;
+	ml.ssrc_hash = create_ssrc_hash_call();
+	mp = media_player_new(&ml);
+
+	// fill
+	miss(1, 1);
+	hit(1, 1);
+	hit(1, 1);
+	miss(2, 2);
+	hit(2, 2);
+	hit(1, 2);
+
+	// concurrent requests for the same ID share one query
+	gettimeofday(&rtpe_now, NULL);
+	assert(media_player_play_db(mp, 3, 1) == 0);
+	assert(media_player_play_db(mp, 3, 1) == 0);
+	assert(media_player_db_run() == 1);
+	assert(fetches == 3);
+	hit(3, 3);
+
+	// failed fetches aren't cached
+	miss(-1, 4);
+	miss(-1, 5);
+
+	// expiry
+	rtpe_config.mysql_cache_ttl = 1;
+	sleep(1);
+	miss(1, 6);
+	hit(1, 6);
+	rtpe_config.mysql_cache_ttl = 300;
+
+	// least recently used entries are evicted first
+	blob_size = 400 * 1024;
+	miss(10, 7);
+	miss(11, 8);
+	hit(10, 8);
+	miss(12, 9); // evicts 11
+	hit(10, 9);
+	hit(12, 9);
+	miss(11, 10); // evicts 10
+	hit(12, 10);
+	miss(10, 11);
+
+	// too large to be cached at all
+	blob_size = 2 * 1024 * 1024;
+	miss(20, 12);
+	miss(20, 13);
+
+	// cache disabled
+	blob_size = 64;
+	rtpe_config.mysql_cache_size = 0;
+	miss(30, 14);
+	miss(30, 15);
+
+	media_player_stop(mp);
+
+	return 0;
+}
@@ -41,6 +41,58 @@ void test_1(int in_samples, int in_format, int in_rate, int in_channels, bool no
 	resample_shutdown(&resampler);
 }
 
+static AVFrame *make_frame(int samples, int format, int rate, int channels) {
+	AVFrame *f = av_frame_alloc();
+	f->nb_samples = samples;
+	f->format = format;
+	f->sample_rate = rate;
+	f->channel_layout = av_get_default_channel_layout(channels);
+	int ret = av_frame_get_buffer(f, 0);
+	assert(ret == 0);
+	memset(f->extended_data[0], 0, f->nb_samples * av_get_bytes_per_sample(f->format) * channels);
+	return f;
+}
+
+// recycled output frame must give the same results, and pass through matching formats
+void test_reuse(int in_samples, int in_rate, int out_rate, int out_exp_samples) {
+	printf("testing reuse %i %i %i %i\n", in_samples, in_rate, out_rate, out_exp_samples);
+
+	AVFrame *in_f = make_frame(in_samples, AV_SAMPLE_FMT_S16, in_rate, 1);
+
+	resample_t resampler;
+	ZERO(resampler);
+	resampler.no_filter = true;
+
+	format_t out_fmt = {
+		.channels = 1,
+		.clockrate = out_rate,
+		.format = AV_SAMPLE_FMT_S16,
+	};
+
+	AVFrame *first = NULL;
+	for (int i = 0; i < 3; i++) {
+		AVFrame *out_f = resample_frame_reuse(&resampler, in_f, &out_fmt);
+		assert(out_f != NULL);
+		printf("received samples %i\n", out_f->nb_samples);
+		if (i == 0)
+			assert(out_f->nb_samples == out_exp_samples);
+		else
+			assert(out_f->nb_samples > 0);
+		if (in_rate == out_rate)
+			assert(out_f == in_f);
+		else {
+			assert(out_f != in_f);
+			// same frame every time
+			if (first)
+				assert(out_f == first);
+			first = out_f;
+		}
+	}
+
+	av_frame_free(&in_f);
+	resample_shutdown(&resampler);
+}
+
 int main(void) {
 	codeclib_init(0);
 
@@ -50,6 +102,10 @@ int main(void) {
 	test_1(320, AV_SAMPLE_FMT_S16, 16000, 1, true, AV_SAMPLE_FMT_S16, 8000, 1, 160);
 	test_1(160, AV_SAMPLE_FMT_S16, 8000, 1, true, AV_SAMPLE_FMT_S16, 16000, 1, 320);
 
+	test_reuse(320, 16000, 8000, 160);
+	test_reuse(160, 8000, 16000, 320);
+	test_reuse(160, 8000, 8000, 160);
+
 	return 0;
 }
 